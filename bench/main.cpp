@@ -0,0 +1,662 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Time.hpp>
+#include <SFML/Graphics/Image.hpp>
+
+#include <GL/glew.h>
+
+#include "BarnesHutTree.hpp"
+#include "Camera.hpp"
+#include "CPUSimulation.hpp"
+#include "GLFramebuffer.hpp"
+#include "GLTexture.hpp"
+#include "HeadlessContext.hpp"
+#include "Options.hpp"
+#include "Particles.hpp"
+#include "ThreadPool.hpp"
+#include "VectorFieldGenerator.hpp"
+
+
+/* Headless benchmark: runs a fixed number of frames of a fixed duration,
+ * each one made of fixed simulation steps, the magnet following a scripted
+ * path, and prints the results as JSON.
+ * Each pass is followed by glFinish so that GPU time is measured.
+ * With --integrators, compares instead the accuracy and cost of each
+ * integrator at several step rates over the same simulated time.
+ * With --check-forces, compares the neighbour forces of the CPU backend,
+ * found through its spatial grid, and its gravity, approximated by a
+ * Barnes-Hut tree, with sums over every pair. */
+
+namespace
+{
+    /* Duration of every frame, as if running at 60 fps */
+    const float FRAME_DURATION = 1.f / 60.f;
+
+    /* Step rates compared by --integrators, and the reference they are
+     * compared to: RK2 on the CPU (float32 state) at a much smaller step */
+    const int INTEGRATOR_STEP_RATES[] = {30, 60, 120, 240};
+    const int REFERENCE_STEP_RATE = 3840;
+
+    /* With --curl-noise, a new field is started every this many frames,
+     * computed in the background and set once ready */
+    const int CURL_NOISE_INTERVAL = 15;
+
+    /* Particles of --check-forces, few enough for the O(N^2) sums, spread
+     * so that each one has about 30 neighbours. An error above the
+     * tolerance, relative to the largest force, fails the check */
+    const unsigned int CHECK_FORCES_SIZE = 64;
+    const float CHECK_FORCES_SPREAD = 64.f;
+    const double CHECK_FORCES_TOLERANCE = 1e-4;
+
+    /* Opening angles of the gravity checked, with their tolerance: the
+     * exact sum for 0, the approximation otherwise */
+    struct OpeningAngleCheck
+    {
+        float openingAngle;
+        double tolerance;
+    };
+    const OpeningAngleCheck CHECK_OPENING_ANGLES[] = {{0.f, CHECK_FORCES_TOLERANCE}, {0.5f, 0.02}, {1.f, 0.2}};
+    const float CHECK_SOFTENING = 0.5f;
+    const std::size_t CHECK_CLUSTERS = 16;
+
+    struct Options
+    {
+        Particles::Settings settings;
+        int nbParticles = 512 * 512;
+        int nbFrames = 1000;
+        int nbWarmupFrames = 10;
+        int stepRate = 60;
+        int maxSubsteps = 4;
+        int nbAttractors = 0;
+        bool render = false;
+        bool passTimings = false;
+        PassTimer::Source passTimerSource = PassTimer::Source::GPUQueries;
+        bool integrators = false;
+        bool checkForces = false;
+    };
+
+    struct Statistics
+    {
+        float mean;
+        float p50;
+        float p95;
+        float p99;
+        float max;
+    };
+
+    /* Nearest-rank percentiles */
+    Statistics computeStatistics(std::vector<float> samples)
+    {
+        Statistics statistics = {0.f, 0.f, 0.f, 0.f, 0.f};
+        if (samples.empty())
+            return statistics;
+
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&samples](float p) {
+            std::size_t rank = static_cast<std::size_t>(std::ceil(p * static_cast<float>(samples.size())));
+            return samples[std::max<std::size_t>(rank, 1) - 1];
+        };
+
+        float sum = 0.f;
+        for (float sample : samples)
+            sum += sample;
+
+        statistics.mean = sum / static_cast<float>(samples.size());
+        statistics.p50 = percentile(0.50f);
+        statistics.p95 = percentile(0.95f);
+        statistics.p99 = percentile(0.99f);
+        statistics.max = samples.back();
+        return statistics;
+    }
+
+    void printStatistics(std::vector<float> const& milliseconds)
+    {
+        Statistics statistics = computeStatistics(milliseconds);
+        std::cout << "{\"mean_ms\": " << statistics.mean
+                  << ", \"p50_ms\": " << statistics.p50
+                  << ", \"p95_ms\": " << statistics.p95
+                  << ", \"p99_ms\": " << statistics.p99
+                  << ", \"max_ms\": " << statistics.max << "}";
+    }
+
+    /* Per-pass statistics of the pass timer, over its last samples */
+    void printPassTimer(PassTimer const& passTimer)
+    {
+        std::cout << "{" << std::endl;
+        std::cout << "    \"source\": \"" << (passTimer.getSource() == PassTimer::Source::GPUQueries ? "gpu_queries" : "cpu_clock") << "\"," << std::endl;
+        std::cout << "    \"histogram_bounds_ms\": [";
+        for (unsigned int bin = 0 ; bin + 1 < PassTimer::Statistics::NB_BINS ; ++bin)
+            std::cout << (bin > 0 ? ", " : "") << PassTimer::Statistics::getBinUpperBound(bin);
+        std::cout << "]";
+
+        for (unsigned int pass = 0 ; pass < PassTimer::NB_PASSES ; ++pass) {
+            PassTimer::Statistics statistics = passTimer.getStatistics(static_cast<PassTimer::Pass>(pass));
+            if (statistics.nbSamples == 0)
+                continue;
+
+            std::cout << "," << std::endl << "    \"" << PassTimer::getPassName(static_cast<PassTimer::Pass>(pass)) << "\": "
+                      << "{\"samples\": " << statistics.nbSamples
+                      << ", \"mean_ms\": " << statistics.average
+                      << ", \"max_ms\": " << statistics.max
+                      << ", \"histogram\": [";
+            for (unsigned int bin = 0 ; bin < PassTimer::Statistics::NB_BINS ; ++bin)
+                std::cout << (bin > 0 ? ", " : "") << statistics.histogram[bin];
+            std::cout << "]}";
+        }
+        std::cout << std::endl << "  }";
+    }
+
+    std::string escapeJSON(const char* text)
+    {
+        std::string escaped;
+        for ( ; text != nullptr && *text != '\0' ; ++text) {
+            if (*text == '"' || *text == '\\')
+                escaped += '\\';
+            escaped += *text;
+        }
+        return escaped;
+    }
+
+    /* Roughly square image with nbParticles pixels or slightly more,
+     * colored with a gradient so that the draw isn't uniform */
+    sf::Image createImage(int nbParticles)
+    {
+        unsigned int width = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(nbParticles))));
+        unsigned int height = (nbParticles + width - 1) / width;
+
+        std::vector<unsigned char> pixels(width * height * 4);
+        for (unsigned int y = 0 ; y < height ; ++y) {
+            for (unsigned int x = 0 ; x < width ; ++x) {
+                unsigned char* pixel = &pixels[4 * (y * width + x)];
+                pixel[0] = static_cast<unsigned char>(255 * x / width);
+                pixel[1] = static_cast<unsigned char>(255 * y / height);
+                pixel[2] = 128;
+                pixel[3] = 255;
+            }
+        }
+
+        sf::Image image;
+        image.create(width, height, pixels.data());
+        return image;
+    }
+
+    /* The magnet circles around the origin, one turn every 5 seconds */
+    sf::Vector2f getMagnetPosition(float time)
+    {
+        const float radius = 200.f;
+        const float angularSpeed = 2.f * 3.14159265f / 5.f;
+        return sf::Vector2f(radius * std::cos(angularSpeed * time),
+                            radius * std::sin(angularSpeed * time));
+    }
+
+    /* Alternately attracting and repelling, evenly spread on a ring
+     * crossed by the magnet */
+    std::vector<Particles::Attractor> createAttractors(int nbAttractors)
+    {
+        std::vector<Particles::Attractor> attractors(nbAttractors);
+        for (int i = 0 ; i < nbAttractors ; ++i) {
+            float angle = 2.f * 3.14159265f * static_cast<float>(i) / static_cast<float>(nbAttractors);
+            attractors[i].position = glm::vec2(250.f * std::cos(angle), 250.f * std::sin(angle));
+            attractors[i].strength = (i % 2 == 0) ? 20.f : -20.f;
+            attractors[i].falloff = 1;
+            attractors[i].radius = 150.f;
+        }
+        return attractors;
+    }
+
+    /* Pointing to the center from the corners of a square, together
+     * keeping about 90% of the particles alive */
+    std::vector<Particles::Emitter> createEmitters(int nbParticles)
+    {
+        const float lifetime = 2.f;
+        std::vector<Particles::Emitter> emitters(4);
+        for (std::size_t i = 0 ; i < emitters.size() ; ++i) {
+            glm::vec2 corner((i % 2 == 0) ? -200.f : 200.f, (i < 2) ? -200.f : 200.f);
+            emitters[i].position = corner;
+            emitters[i].direction = -corner;
+            emitters[i].spread = 0.5f;
+            emitters[i].speed = 6.f;
+            emitters[i].rate = Particles::computeEmitterRate(nbParticles, emitters.size(), lifetime, 0.9f);
+            emitters[i].lifetime = lifetime;
+        }
+        return emitters;
+    }
+
+    void printConfiguration(Particles const& particles)
+    {
+        std::cout << "  \"backend\": \"" << Particles::getBackendName(particles.getBackend()) << "\"," << std::endl;
+        std::cout << "  \"storage\": \"" << Particles::getStorageName(particles.getStorage()) << "\"," << std::endl;
+        std::cout << "  \"fused_update\": " << (particles.isUpdateFused() ? "true" : "false") << "," << std::endl;
+        std::cout << "  \"renderer\": \"" << escapeJSON(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) << "\"," << std::endl;
+        std::cout << "  \"gl_version\": \"" << escapeJSON(reinterpret_cast<const char*>(glGetString(GL_VERSION))) << "\"," << std::endl;
+        std::cout << "  \"cpu_threads\": " << std::thread::hardware_concurrency() << "," << std::endl;
+        std::cout << "  \"particles\": " << particles.getNbParticles() << "," << std::endl;
+    }
+
+    void runFrames(Options const& options)
+    {
+        Particles::Settings settings = options.settings;
+        settings.maxAttractors = options.nbAttractors;
+        Particles particles(createImage(options.nbParticles), settings);
+        particles.setAttractors(createAttractors(options.nbAttractors));
+        if (particles.hasEmitters())
+            particles.setEmitters(createEmitters(options.nbParticles));
+        particles.setMagnetState(true);
+        particles.setTimeStep(sf::seconds(1.f / static_cast<float>(options.stepRate)), options.maxSubsteps);
+
+        const unsigned int width = 800, height = 600;
+        Camera camera(width, height, glm::vec2(0.f,0.f), 1.f);
+        GLTexture renderTexture;
+        GLFramebuffer renderTarget;
+        if (options.render && (!renderTexture.create(width, height, GL_RGBA8) || !renderTarget.create({&renderTexture})))
+            throw std::runtime_error("unable to create the offscreen framebuffer");
+
+        std::unique_ptr<VectorFieldGenerator> generator;
+        VectorField vectorField;
+        int nbVectorFields = 0;
+        if (particles.hasVectorField())
+            generator.reset(new VectorFieldGenerator());
+
+        std::vector<float> simulationTimes, drawTimes, frameTimes;
+        float totalSimulation = 0.f;
+        int nbSteps = 0;
+        sf::Clock clock;
+        for (int frame = 0 ; frame < options.nbWarmupFrames + options.nbFrames ; ++frame) {
+            float time = FRAME_DURATION * static_cast<float>(frame);
+            particles.setMagnetPosition(getMagnetPosition(time));
+            if (options.passTimings && frame == options.nbWarmupFrames)
+                particles.enablePassTimer(options.passTimerSource);
+
+            clock.restart();
+            if (generator) {
+                if (generator->poll(vectorField)) {
+                    particles.setVectorField(vectorField);
+                    nbVectorFields += (frame >= options.nbWarmupFrames);
+                }
+                if (frame % CURL_NOISE_INTERVAL == 0) {
+                    generator->start(256, 256, glm::vec2(-512.f, -512.f), glm::vec2(1024.f, 1024.f),
+                                     [time](VectorField& field, ThreadPool& threadPool) {
+                                         field.computeCurlNoise(8, 0.3f * time, 0.2f, threadPool);
+                                     });
+                }
+            }
+            unsigned int nbFrameSteps = particles.update(sf::seconds(FRAME_DURATION));
+            glFinish();
+            float simulationTime = clock.getElapsedTime().asSeconds();
+
+            float drawTime = 0.f;
+            if (options.render) {
+                clock.restart();
+                particles.draw(renderTarget, camera);
+                glFinish();
+                drawTime = clock.getElapsedTime().asSeconds();
+            }
+
+            if (frame < options.nbWarmupFrames)
+                continue;
+
+            totalSimulation += simulationTime;
+            nbSteps += nbFrameSteps;
+            simulationTimes.push_back(1000.f * simulationTime);
+            if (options.render)
+                drawTimes.push_back(1000.f * drawTime);
+            frameTimes.push_back(1000.f * (simulationTime + drawTime));
+        }
+
+        std::cout << "{" << std::endl;
+        printConfiguration(particles);
+        std::cout << "  \"integrator\": \"" << Particles::getIntegratorName(particles.getIntegrator()) << "\"," << std::endl;
+        std::cout << "  \"vertex_id_addressing\": " << (particles.isAddressedByVertexID() ? "true" : "false") << "," << std::endl;
+        std::cout << "  \"colors_from_texture\": " << (particles.areColorsFromTexture() ? "true" : "false") << "," << std::endl;
+        std::cout << "  \"attractors\": " << particles.getAttractors().size() << "," << std::endl;
+        std::cout << "  \"vector_fields\": " << nbVectorFields << "," << std::endl;
+        std::cout << "  \"neighbour_forces\": " << (particles.hasNeighbourForces() ? "true" : "false") << "," << std::endl;
+        std::cout << "  \"force_model\": \"" << Particles::getForceModelName(particles.getForceModel()) << "\"," << std::endl;
+        std::cout << "  \"live_particles\": " << particles.countLiveParticles() << "," << std::endl;
+        std::cout << "  \"frames\": " << options.nbFrames << "," << std::endl;
+        std::cout << "  \"warmup_frames\": " << options.nbWarmupFrames << "," << std::endl;
+        std::cout << "  \"frame_s\": " << FRAME_DURATION << "," << std::endl;
+        std::cout << "  \"step_s\": " << particles.getTimeStep().asSeconds() << "," << std::endl;
+        std::cout << "  \"steps\": " << nbSteps << "," << std::endl;
+        std::cout << "  \"passes\": {" << std::endl;
+        std::cout << "    \"simulation\": ";
+        printStatistics(simulationTimes);
+        if (options.render) {
+            std::cout << "," << std::endl << "    \"draw\": ";
+            printStatistics(drawTimes);
+        }
+        std::cout << std::endl << "  }," << std::endl;
+        std::cout << "  \"frame_latency\": ";
+        printStatistics(frameTimes);
+        std::cout << "," << std::endl;
+        std::cout << "  \"particles_per_second\": "
+                  << static_cast<double>(particles.getNbParticles()) * static_cast<double>(nbSteps) / totalSimulation
+                  << (options.passTimings ? "," : "") << std::endl;
+        if (options.passTimings) {
+            std::cout << "  \"pass_timer\": ";
+            printPassTimer(particles.getPassTimer());
+            std::cout << std::endl;
+        }
+        std::cout << "}" << std::endl;
+    }
+
+    /* Simulates duration seconds from the initial state by steps of
+     * 1/stepRate, and returns the time spent in seconds.
+     * The magnet stands still: moved once per step, it would add an error
+     * of the first order whatever the integrator */
+    float simulateFor(Particles& particles, float duration, int stepRate)
+    {
+        const sf::Time dt = sf::seconds(1.f / static_cast<float>(stepRate));
+        const int nbSteps = static_cast<int>(std::lround(duration * static_cast<float>(stepRate)));
+
+        /* The first steps also pay for lazy allocations and shader compilation */
+        for (int step = 0 ; step < 4 ; ++step)
+            particles.computeNewPositions(dt);
+        particles.initialize();
+        particles.setMagnetState(true);
+        particles.setMagnetPosition(getMagnetPosition(0.f));
+
+        glFinish();
+        sf::Clock clock;
+        for (int step = 0 ; step < nbSteps ; ++step)
+            particles.computeNewPositions(dt);
+        glFinish();
+        return clock.getElapsedTime().asSeconds();
+    }
+
+    /* Distance of each particle to its reference position */
+    void printErrors(std::vector<glm::vec2> const& positions, std::vector<glm::vec2> const& reference)
+    {
+        std::vector<float> errors(positions.size());
+        double squaredSum = 0.0;
+        for (std::size_t i = 0 ; i < positions.size() ; ++i) {
+            errors[i] = glm::length(positions[i] - reference[i]);
+            squaredSum += static_cast<double>(errors[i]) * static_cast<double>(errors[i]);
+        }
+        std::sort(errors.begin(), errors.end());
+
+        std::cout << "\"rms_error\": " << std::sqrt(squaredSum / static_cast<double>(errors.size()))
+                  << ", \"median_error\": " << errors[errors.size() / 2]
+                  << ", \"max_error\": " << errors.back();
+    }
+
+    /* Error after the same simulated time against cost, for each integrator
+     * at each step rate of INTEGRATOR_STEP_RATES */
+    void compareIntegrators(Options const& options)
+    {
+        const sf::Image image = createImage(options.nbParticles);
+        const float duration = FRAME_DURATION * static_cast<float>(options.nbFrames);
+        const Particles::Integrator integrators[] = {Particles::Integrator::SemiImplicitEuler,
+                                                     Particles::Integrator::Verlet,
+                                                     Particles::Integrator::RK2};
+
+        std::vector<glm::vec2> reference, positions;
+        {
+            Particles::Settings referenceSettings(Particles::Backend::CPU);
+            referenceSettings.integrator = Particles::Integrator::RK2;
+            Particles particles(image, referenceSettings);
+            simulateFor(particles, duration, REFERENCE_STEP_RATE);
+            particles.readPositions(reference);
+        }
+
+        std::cout << "{" << std::endl;
+        bool first = true;
+        for (Particles::Integrator integrator : integrators) {
+            Particles::Settings settings = options.settings;
+            settings.integrator = integrator;
+
+            for (int stepRate : INTEGRATOR_STEP_RATES) {
+                Particles particles(image, settings);
+                float time = simulateFor(particles, duration, stepRate);
+                particles.readPositions(positions);
+
+                if (first) {
+                    printConfiguration(particles);
+                    std::cout << "  \"simulated_s\": " << duration << "," << std::endl;
+                    std::cout << "  \"reference\": {\"backend\": \"" << Particles::getBackendName(Particles::Backend::CPU)
+                              << "\", \"integrator\": \"" << Particles::getIntegratorName(Particles::Integrator::RK2)
+                              << "\", \"step_rate\": " << REFERENCE_STEP_RATE << "}," << std::endl;
+                    std::cout << "  \"integrators\": [" << std::endl;
+                }
+                std::cout << (first ? "" : ",\n")
+                          << "    {\"integrator\": \"" << Particles::getIntegratorName(integrator) << "\""
+                          << ", \"step_rate\": " << stepRate << ", ";
+                printErrors(positions, reference);
+                std::cout << ", \"ms_per_simulated_s\": " << 1000.f * time / duration << "}";
+                first = false;
+            }
+        }
+        std::cout << std::endl << "  ]" << std::endl << "}" << std::endl;
+    }
+
+    /* Neighbour forces of every particle, summed over all the others */
+    std::vector<glm::dvec2> sumNeighbourForces(std::vector<float> const& state, std::size_t nbParticles,
+                                               CPUSimulation::NeighbourForces const& forces)
+    {
+        float const* px = state.data();
+        float const* py = px + nbParticles;
+        float const* vx = py + nbParticles;
+        float const* vy = vx + nbParticles;
+        const float squaredRadius = forces.radius * forces.radius;
+
+        std::vector<glm::dvec2> accelerations(nbParticles, glm::dvec2(0.0));
+        for (std::size_t i = 0 ; i < nbParticles ; ++i) {
+            glm::dvec2 repulsion(0.0), sumOfOffsets(0.0), sumOfVelocities(0.0);
+            unsigned int nbNeighbours = 0;
+            for (std::size_t j = 0 ; j < nbParticles ; ++j) {
+                /* Same test as the grid, in float, so that both agree on
+                 * the particles at the radius */
+                glm::vec2 offset(px[j] - px[i], py[j] - py[i]);
+                float squaredDistance = glm::dot(offset, offset);
+                if (j == i || !(squaredDistance < squaredRadius))
+                    continue;
+
+                ++nbNeighbours;
+                glm::dvec2 doubleOffset(offset);
+                if (squaredDistance > 0.f)
+                    repulsion -= doubleOffset * (1.0 / glm::length(doubleOffset) - 1.0 / forces.radius);
+                sumOfOffsets += doubleOffset;
+                sumOfVelocities += glm::dvec2(vx[j], vy[j]);
+            }
+
+            if (nbNeighbours > 0) {
+                double count = static_cast<double>(nbNeighbours);
+                accelerations[i] = static_cast<double>(forces.separation) * repulsion
+                                 + static_cast<double>(forces.cohesion) * sumOfOffsets / count
+                                 + static_cast<double>(forces.alignment) * (sumOfVelocities / count - glm::dvec2(vx[i], vy[i]));
+            }
+        }
+        return accelerations;
+    }
+
+    /* Same sum as BarnesHutTree::getAcceleration() with an angle of 0,
+     * in the order of the particles */
+    std::vector<glm::dvec2> sumGravity(std::vector<float> const& state, std::size_t nbParticles, float softening)
+    {
+        float const* px = state.data();
+        float const* py = px + nbParticles;
+        const double squaredSoftening = static_cast<double>(softening) * static_cast<double>(softening);
+
+        std::vector<glm::dvec2> accelerations(nbParticles, glm::dvec2(0.0));
+        for (std::size_t i = 0 ; i < nbParticles ; ++i) {
+            for (std::size_t j = 0 ; j < nbParticles ; ++j) {
+                glm::dvec2 offset(static_cast<double>(px[j]) - px[i], static_cast<double>(py[j]) - py[i]);
+                double squaredDistance = glm::dot(offset, offset) + squaredSoftening;
+                if (j != i && squaredDistance > 0.0)
+                    accelerations[i] += offset / (squaredDistance * std::sqrt(squaredDistance));
+            }
+        }
+        return accelerations;
+    }
+
+    /* Largest distance between the accelerations and their reference,
+     * relative to the largest reference. Prints it and returns whether
+     * it is within tolerance */
+    bool printForceErrors(std::vector<glm::dvec2> const& accelerations, std::vector<glm::dvec2> const& reference,
+                          double tolerance)
+    {
+        double maxError = 0.0, maxReference = 0.0;
+        for (std::size_t i = 0 ; i < accelerations.size() ; ++i) {
+            maxError = std::max(maxError, glm::length(accelerations[i] - reference[i]));
+            maxReference = std::max(maxReference, glm::length(reference[i]));
+        }
+
+        double relativeError = (maxReference > 0.0) ? maxError / maxReference : maxError;
+        bool passed = (relativeError <= tolerance);
+        std::cout << "\"max_error\": " << maxError << ", \"max_relative_error\": " << relativeError
+                  << ", \"passed\": " << (passed ? "true" : "false");
+        return passed;
+    }
+
+    /* Runs a single step without friction, speed limit nor attractor from
+     * a random state, so that the change of velocity is the neighbour
+     * forces alone, and compares it to sumNeighbourForces(). Then compares
+     * the tree's gravity on clustered positions to sumGravity() */
+    bool checkForces()
+    {
+        const std::size_t nbParticles = CHECK_FORCES_SIZE * CHECK_FORCES_SIZE;
+        std::mt19937 generator(0);
+        std::uniform_real_distribution<float> positions(0.f, CHECK_FORCES_SPREAD);
+        std::uniform_real_distribution<float> velocities(-1.f, 1.f);
+
+        std::vector<float> state(CPUSimulation::STATE_ARRAYS * nbParticles);
+        for (std::size_t i = 0 ; i < 2 * nbParticles ; ++i)
+            state[i] = positions(generator);
+        for (std::size_t i = 2 * nbParticles ; i < 4 * nbParticles ; ++i)
+            state[i] = velocities(generator);
+        std::copy(state.begin(), state.begin() + 2 * nbParticles, state.begin() + 4 * nbParticles);
+
+        ThreadPool threadPool;
+        CPUSimulation simulation(CHECK_FORCES_SIZE, CHECK_FORCES_SIZE, threadPool);
+        simulation.loadState(state.data());
+
+        /* No cap on the neighbours, which would depend on the grid's order */
+        CPUSimulation::NeighbourForces forces = {3.f, 1.f, 0.5f, 0.25f, static_cast<unsigned int>(nbParticles)};
+        CPUSimulation::Parameters parameters = {1.f, std::numeric_limits<float>::max(), 1.f, {}, nullptr, &forces, nullptr};
+        simulation.update(parameters);
+
+        std::vector<float> newState(state.size());
+        simulation.saveState(newState.data());
+        std::vector<glm::dvec2> accelerations(nbParticles);
+        for (std::size_t i = 0 ; i < nbParticles ; ++i) {
+            accelerations[i] = glm::dvec2(newState[2 * nbParticles + i] - state[2 * nbParticles + i],
+                                          newState[3 * nbParticles + i] - state[3 * nbParticles + i]);
+        }
+
+        std::cout << "{" << std::endl;
+        std::cout << "  \"particles\": " << nbParticles << "," << std::endl;
+        std::cout << "  \"neighbour_forces\": {\"radius\": " << forces.radius << ", ";
+        bool passed = printForceErrors(accelerations, sumNeighbourForces(state, nbParticles, forces),
+                                       CHECK_FORCES_TOLERANCE);
+        std::cout << "}," << std::endl;
+
+        /* Gathered into clusters, as gravity does, with a few particles
+         * left between them, so that the tree is deeper and unbalanced */
+        std::uniform_int_distribution<std::size_t> clusters(0, CHECK_CLUSTERS - 1);
+        std::normal_distribution<float> spread(0.f, 1.f);
+        std::vector<glm::vec2> centers(CHECK_CLUSTERS);
+        for (glm::vec2& center : centers)
+            center = glm::vec2(positions(generator), positions(generator));
+        for (std::size_t i = 0 ; i < nbParticles ; ++i) {
+            if (i % CHECK_CLUSTERS == 0)
+                continue;
+            glm::vec2 const& center = centers[clusters(generator)];
+            state[i] = center.x + spread(generator);
+            state[nbParticles + i] = center.y + spread(generator);
+        }
+
+        BarnesHutTree tree(nbParticles, threadPool);
+        tree.build(state.data(), state.data() + nbParticles);
+        std::vector<std::uint32_t> const& sortedIndices = tree.getSortedIndices();
+        const std::vector<glm::dvec2> gravity = sumGravity(state, nbParticles, CHECK_SOFTENING);
+
+        std::cout << "  \"gravity\": [" << std::endl;
+        bool first = true;
+        for (OpeningAngleCheck const& check : CHECK_OPENING_ANGLES) {
+            for (std::size_t k = 0 ; k < nbParticles ; ++k)
+                accelerations[sortedIndices[k]] = glm::dvec2(tree.getAcceleration(k, check.openingAngle, CHECK_SOFTENING));
+
+            std::cout << (first ? "" : ",\n") << "    {\"opening_angle\": " << check.openingAngle << ", ";
+            passed = printForceErrors(accelerations, gravity, check.tolerance) && passed;
+            std::cout << "}";
+            first = false;
+        }
+        std::cout << std::endl << "  ]" << std::endl << "}" << std::endl;
+        return passed;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    for (int i = 1 ; i < argc ; ++i) {
+        std::string option(argv[i]);
+        if (parseSettingsOption(option, options.settings) ||
+            parsePositiveOption(option, "--particles", options.nbParticles) ||
+            parsePositiveOption(option, "--frames", options.nbFrames) ||
+            parsePositiveOption(option, "--warmup", options.nbWarmupFrames) ||
+            parsePositiveOption(option, "--step-rate", options.stepRate) ||
+            parsePositiveOption(option, "--max-substeps", options.maxSubsteps) ||
+            parsePositiveOption(option, "--attractors", options.nbAttractors))
+            continue;
+
+        if (option == "--render") {
+            options.render = true;
+        } else if (option == "--pass-timings" || option == "--pass-timings=gpu") {
+            options.passTimings = true;
+            options.passTimerSource = PassTimer::Source::GPUQueries;
+        } else if (option == "--pass-timings=cpu") {
+            options.passTimings = true;
+            options.passTimerSource = PassTimer::Source::CPUClock;
+        } else if (option == "--integrators") {
+            options.integrators = true;
+        } else if (option == "--check-forces") {
+            options.checkForces = true;
+        } else {
+            std::cerr << "Unknown option " << option << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--particles=N] [--frames=N] [--warmup=N] [--step-rate=HZ] [--max-substeps=N]"
+                      << " [--attractors=N] [--render] [--pass-timings[=gpu|cpu]] [--integrators] [--check-forces] "
+                      << getSettingsUsage() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        /* On the CPU only, no context needed */
+        if (options.checkForces)
+            return checkForces() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+        bool needsCompute = (options.settings.backend == Particles::Backend::ComputeShader);
+        HeadlessContext context(needsCompute ? 4 : 3, needsCompute ? 3 : 0);
+        if (context.getMajorVersion() < 3) {
+            std::cerr << "This program requires at least OpenGL 3.0" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        /* GLEW may look for a GLX display and fail, the entry points
+         * are loaded anyway */
+        glewExperimental = GL_TRUE;
+        glewInit();
+
+        if (options.integrators)
+            compareIntegrators(options);
+        else
+            runFrames(options);
+    } catch (std::exception const& exception) {
+        std::cerr << exception.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#ifndef BARNESHUTTREE_HPP_INCLUDED
+#define BARNESHUTTREE_HPP_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+#include "ThreadPool.hpp"
+
+
+/* Quadtree over the particles, for an approximate sum of the attractions
+ * of all of them in O(n log n) (Barnes-Hut).
+ * build() sorts the particles by the Morton code of their position in
+ * the bounding square, so that each node of the tree is a contiguous
+ * range of the sorted particles. The tree is built one level at a time,
+ * the nodes of a level being split in parallel, then the masses and
+ * centers of mass are summed from the deepest level up to the root.
+ * All the particles have the same mass, 1. */
+class BarnesHutTree
+{
+    public:
+        /* Particles of a node that isn't split. The nodes of the deepest
+         * level, whose particles share their Morton code, can hold more */
+        static const std::uint32_t LEAF_SIZE = 8;
+
+        /* Bits of the Morton code per coordinate, one level each */
+        static const unsigned int MAX_DEPTH = 16;
+
+    public:
+        BarnesHutTree(std::size_t nbParticles, ThreadPool& threadPool);
+
+        void build(float const* positionsX, float const* positionsY);
+
+        /* Particle indices sorted by Morton code, then by index */
+        std::vector<std::uint32_t> const& getSortedIndices() const;
+
+        /* Sum of mass * offset / (distance^2 + softening^2)^(3/2) over the
+         * other particles, seen from the particle at sortedIndex in
+         * getSortedIndices(). A node whose size is less than openingAngle
+         * times its distance counts as a single particle at its center
+         * of mass: 0 gives the exact sum, larger angles open fewer nodes.
+         * The nodes containing the particle are always opened */
+        glm::vec2 getAcceleration(std::size_t sortedIndex, float openingAngle, float softening) const;
+
+    private:
+        BarnesHutTree(BarnesHutTree const&);
+        BarnesHutTree& operator=(BarnesHutTree const&);
+
+        /* Square containing all the particles, the Morton codes of each
+         * particle, then both sorted by code */
+        void computeBounds(float const* positionsX, float const* positionsY);
+        void computeMortonCodes(float const* positionsX, float const* positionsY);
+        void sortByMortonCode();
+
+        /* Splits the nodes of each level into their non empty quadrants */
+        void buildNodes();
+
+        /* From the leaves to the root */
+        void computeCentersOfMass();
+
+    private:
+        struct Node
+        {
+            glm::vec2 centerOfMass;
+            float mass; //number of particles
+            float size; //side of the node's square
+            std::uint32_t begin, end; //range of the sorted particles
+            std::uint32_t firstChild; //children are contiguous
+            std::uint32_t nbChildren; //0 for a leaf
+        };
+
+        std::size_t _nbParticles;
+
+        ThreadPool& _threadPool;
+
+        glm::vec2 _origin;
+        float _size;
+
+        /* Sorted by the radix sort, the temporary ones holding each pass' input */
+        std::vector<std::uint32_t> _codes;
+        std::vector<std::uint32_t> _sortedIndices;
+        std::vector<std::uint32_t> _temporaryCodes;
+        std::vector<std::uint32_t> _temporaryIndices;
+        std::vector<std::uint32_t> _digitOffsets; //of each block, for each digit
+
+        /* Positions copied in the order of the codes */
+        std::vector<float> _sortedPositionsX;
+        std::vector<float> _sortedPositionsY;
+
+        /* Breadth first, levels[l] being the first node of the level l,
+         * and the last element the number of nodes */
+        std::vector<Node> _nodes;
+        std::vector<std::uint32_t> _levels;
+        std::vector<std::uint32_t> _childBounds; //5 boundaries per node of the level being split
+};
+
+#endif // BARNESHUTTREE_HPP_INCLUDED
@@ -0,0 +1,145 @@
+#ifndef CPUSIMULATION_HPP_INCLUDED
+#define CPUSIMULATION_HPP_INCLUDED
+
+#include <memory>
+#include <vector>
+
+#include "glm.hpp"
+
+#include "BarnesHutTree.hpp"
+#include "SpatialGrid.hpp"
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+
+/* CPU counterpart of the integrate() function of physics.glsl.
+ * Positions and velocities are stored as structure of arrays so that
+ * the kernels can process 8 (AVX2) or 4 (SSE) particles at once.
+ * The work is split across the threads of a ThreadPool. */
+class CPUSimulation
+{
+    public:
+        /* Point pulling the particles within its radius, with an
+         * acceleration of strength / distance^falloff */
+        struct Attractor
+        {
+            glm::vec2 position;
+            float strength; //negative for a repulsor
+            unsigned int falloff; //0, 1 (like the magnet) or 2
+            float radius; //0 for an unlimited range
+        };
+
+        /* Interactions between the particles closer than radius, applied
+         * as a change of velocity at the beginning of each step */
+        struct NeighbourForces
+        {
+            float radius; //also the size of the cells of the spatial grid
+            float separation; //repulsion, from 0 at radius to separation at contact
+            float cohesion; //toward the center of the neighbours
+            float alignment; //toward the average velocity of the neighbours
+            unsigned int maxNeighbours; //the next ones are ignored, bounds the cost in dense clusters
+        };
+
+        /* Attraction of every particle by all the others, applied as a
+         * change of velocity at the beginning of each step. The sum is
+         * approximated by a Barnes-Hut tree rebuilt at each step */
+        struct Gravity
+        {
+            float strength; //gravitational constant times the total mass of the particles
+            float openingAngle; //0 for the exact sum, 0.5 is a common tradeoff
+            float softening; //length added to the distances, avoids infinite forces at contact
+        };
+
+        /* Same meaning as the Parameters block of parameters.glsl */
+        struct Parameters
+        {
+            float dt;
+            float maxSpeed;
+            float friction; //already raised to the power dt
+            std::vector<Attractor> attractors;
+            VectorField const* vectorField; //acceleration added everywhere, can be null
+            NeighbourForces const* neighbourForces; //can be null
+            Gravity const* gravity; //can be null, CPU only
+        };
+
+        /* Integration scheme of each step, see physics.glsl */
+        enum class Integrator
+        {
+            SemiImplicitEuler, //velocity first, then position with the new velocity
+            Verlet, //velocity Verlet: two half kicks around the drift
+            RK2 //midpoint method: derivatives at the middle of the step
+        };
+
+    public:
+        /* The particles are laid out around layoutCenter */
+        CPUSimulation(unsigned int width, unsigned int height,
+                      ThreadPool& threadPool,
+                      Integrator integrator=Integrator::SemiImplicitEuler,
+                      glm::vec2 const& layoutCenter=glm::vec2(0.f));
+
+        unsigned int getNbParticles() const;
+        Integrator getIntegrator() const;
+
+        /* Name of the instruction set used by the kernels */
+        static const char* getInstructionSet();
+
+        /* Centers particles with zero initial speed,
+         * same layout as computeInitialPositions.frag */
+        void initialize();
+
+        /* Runs nbSteps steps. The positions before the last one are kept
+         * for copyPositions(). With neighbour forces or gravity, the spatial
+         * grid or the tree is rebuilt at each step, and the steps are run
+         * one after the other over all the particles instead of block by block */
+        void update(Parameters const& parameters, unsigned int nbSteps=1);
+
+        /* Writes interleaved (x,y) positions, ready to be used as a VBO,
+         * between the previous (0) and current (1) positions */
+        void copyPositions(glm::vec2* destination, float interpolation=1.f) const;
+
+        /* Whole state, for checkpoints: the positions, velocities and
+         * previous positions, as STATE_ARRAYS arrays of getNbParticles() floats */
+        static const unsigned int STATE_ARRAYS = 6;
+        void saveState(float* destination) const;
+        void loadState(float const* source);
+
+    private:
+        /* Builds the grid, then adds dt times the neighbour forces to the velocities */
+        void applyNeighbourForces(NeighbourForces const& forces, float dt);
+
+        /* Sum of the forces of the neighbours of the particle at sortedIndex
+         * in the grid's order */
+        glm::vec2 getNeighbourAcceleration(std::size_t sortedIndex, NeighbourForces const& forces) const;
+
+        /* Builds the tree, then adds dt times the gravity to the velocities */
+        void applyGravity(Gravity const& gravity, float dt);
+
+    private:
+        unsigned int _width;
+        unsigned int _height;
+        Integrator _integrator;
+        glm::vec2 _layoutCenter;
+
+        ThreadPool& _threadPool;
+
+        std::vector<float> _positionsX;
+        std::vector<float> _positionsY;
+        std::vector<float> _velocitiesX;
+        std::vector<float> _velocitiesY;
+        std::vector<float> _previousPositionsX;
+        std::vector<float> _previousPositionsY;
+
+        /* Neighbour forces only, allocated by the first step using them.
+         * State copied in the order of the grid, so that the particles of
+         * a bucket are read contiguously */
+        std::unique_ptr<SpatialGrid> _grid;
+        std::vector<float> _sortedPositionsX;
+        std::vector<float> _sortedPositionsY;
+        std::vector<float> _sortedVelocitiesX;
+        std::vector<float> _sortedVelocitiesY;
+
+        /* Gravity only, allocated by the first step using it */
+        std::unique_ptr<BarnesHutTree> _tree;
+};
+
+#endif // CPUSIMULATION_HPP_INCLUDED
@@ -0,0 +1,54 @@
+#ifndef CHECKPOINTFILE_HPP_INCLUDED
+#define CHECKPOINTFILE_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/* File of raw chunks of data, such as the state of some particles: a
+ * header listing the chunks, then each chunk aligned to CHUNK_ALIGNMENT,
+ * so that the chunks of a mapped file can be handed as they are to
+ * OpenGL, without parsing them. The layout of the chunks is up to the
+ * writer, and versioned by VERSION */
+class CheckpointFile
+{
+    public:
+        /* Incremented whenever the layout of the file, or of a chunk
+         * written by Particles, changes */
+        static const std::uint32_t VERSION = 1;
+
+        static const std::size_t CHUNK_ALIGNMENT = 4096;
+        static const unsigned int MAX_CHUNKS = 8;
+
+        struct Chunk
+        {
+            void const* data;
+            std::size_t size;
+        };
+
+        /* Writes a temporary file, renamed to path once complete: path
+         * always holds a whole checkpoint. Throws if it can't be written */
+        static void write(std::string const& path, std::vector<Chunk> const& chunks);
+
+    public:
+        /* Maps the file. Throws if it can't be read, or isn't a
+         * checkpoint of this version */
+        explicit CheckpointFile(std::string const& path);
+        ~CheckpointFile();
+
+        /* Pointing into the mapping */
+        std::vector<Chunk> const& getChunks() const;
+
+    private:
+        CheckpointFile(CheckpointFile const&);
+        CheckpointFile& operator=(CheckpointFile const&);
+
+    private:
+        void* _mapping;
+        std::size_t _mappingSize;
+        std::vector<Chunk> _chunks;
+};
+
+#endif // CHECKPOINTFILE_HPP_INCLUDED
@@ -0,0 +1,56 @@
+#ifndef CHECKPOINTWRITER_HPP_INCLUDED
+#define CHECKPOINTWRITER_HPP_INCLUDED
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CheckpointFile.hpp"
+
+
+/* Writes checkpoint files on a background thread, so that saving one
+ * never blocks the frame. The chunks aren't copied: their data must
+ * stay valid until the file is written. */
+class CheckpointWriter
+{
+    public:
+        CheckpointWriter();
+
+        /* Waits for the file being written, ignoring its errors */
+        ~CheckpointWriter();
+
+        /* Starts writing a file with CheckpointFile::write(), unless
+         * one is still being written: returns false then */
+        bool start(std::string const& path, std::vector<CheckpointFile::Chunk> const& chunks);
+
+        /* Never blocks. Returns false while a file is being written,
+         * and throws if the last one couldn't be */
+        bool poll();
+
+        /* Blocks until the file is written, throws if it couldn't be */
+        void wait();
+
+    private:
+        CheckpointWriter(CheckpointWriter const&);
+        CheckpointWriter& operator=(CheckpointWriter const&);
+
+        void run();
+
+        /* With _mutex locked */
+        void throwError();
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _taskAvailable;
+        std::condition_variable _taskDone;
+        std::string _path; //empty when idle
+        std::vector<CheckpointFile::Chunk> _chunks;
+        std::string _error; //of the last file, until reported
+        bool _stopping;
+
+        std::thread _thread; //last, started once the other members are initialized
+};
+
+#endif // CHECKPOINTWRITER_HPP_INCLUDED
@@ -0,0 +1,39 @@
+#ifndef FULLSCREENPASS_HPP_INCLUDED
+#define FULLSCREENPASS_HPP_INCLUDED
+
+#include <initializer_list>
+
+#include <GL/glew.h>
+
+#include "GLFramebuffer.hpp"
+#include "GLProgram.hpp"
+#include "GLTexture.hpp"
+
+
+/* Runs a fragment shader once per texel of a framebuffer, by drawing
+ * a single triangle covering it. The triangle's corners are generated
+ * from gl_VertexID by shaders/fullscreen.vert, so the vertex array object
+ * is empty: it is created once and only bound for each pass.
+ * Like GLFramebuffer, it must be used in the context it was created in. */
+class FullscreenPass
+{
+    public:
+        FullscreenPass();
+        ~FullscreenPass();
+
+        void create();
+
+        /* The program must be bound, with its uniforms set.
+         * Inputs are bound to texture units 0, 1... in that order. */
+        void run(GLFramebuffer const& target,
+                 std::initializer_list<GLTexture const*> inputs) const;
+
+    private:
+        FullscreenPass(FullscreenPass const&);
+        FullscreenPass& operator=(FullscreenPass const&);
+
+    private:
+        GLuint _vertexArrayID;
+};
+
+#endif // FULLSCREENPASS_HPP_INCLUDED
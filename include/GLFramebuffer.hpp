@@ -0,0 +1,42 @@
+#ifndef GLFRAMEBUFFER_HPP_INCLUDED
+#define GLFRAMEBUFFER_HPP_INCLUDED
+
+#include <initializer_list>
+
+#include <GL/glew.h>
+
+#include <SFML/System/Vector2.hpp>
+
+#include "GLTexture.hpp"
+
+
+/* Framebuffer object rendering to one or several textures.
+ * Framebuffer objects aren't shared between OpenGL contexts: it must be
+ * used in the context it was created in. */
+class GLFramebuffer
+{
+    public:
+        GLFramebuffer();
+        ~GLFramebuffer();
+
+        /* The i-th texture is bound to GL_COLOR_ATTACHMENTi,
+         * which is written by gl_FragData[i] */
+        bool create(std::initializer_list<GLTexture const*> colorAttachments);
+
+        GLuint getNativeHandle() const;
+        sf::Vector2u const& getSize() const;
+
+        /* Also sets the viewport to cover the whole framebuffer.
+         * Null binds the default framebuffer (viewport left unchanged) */
+        static void bind(GLFramebuffer const* framebuffer);
+
+    private:
+        GLFramebuffer(GLFramebuffer const&);
+        GLFramebuffer& operator=(GLFramebuffer const&);
+
+    private:
+        GLuint _framebufferID;
+        sf::Vector2u _size;
+};
+
+#endif // GLFRAMEBUFFER_HPP_INCLUDED
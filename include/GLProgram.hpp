@@ -0,0 +1,57 @@
+#ifndef GLPROGRAM_HPP_INCLUDED
+#define GLPROGRAM_HPP_INCLUDED
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+class ProgramCache;
+
+/* OpenGL program built directly from GLSL sources.
+ * Unlike sf::Shader, it accepts any shader stage (compute shaders...) */
+class GLProgram
+{
+    public:
+        /* Shader stage (GL_VERTEX_SHADER...) and its source code */
+        typedef std::pair<GLenum, std::string> Source;
+
+        /* Every program loaded afterwards is looked up in the cache, and
+         * saved there once compiled. nullptr disables it */
+        static void setCache(ProgramCache* cache);
+
+    public:
+        GLProgram();
+        ~GLProgram();
+
+        /* Compiles and links the sources, unless the cache holds them. On
+         * failure, the compilation log is printed to std::cerr and false is returned.
+         * feedbackVaryings are the outputs captured, interleaved, by transform feedback */
+        bool loadFromMemory(std::vector<Source> const& sources,
+                            std::vector<std::string> const& feedbackVaryings=std::vector<std::string>());
+
+        GLuint getNativeHandle() const;
+
+        /* Locations are meant to be retrieved once after loading,
+         * not before each use */
+        GLint getUniformLocation(std::string const& name) const;
+        GLint getAttributeLocation(std::string const& name) const;
+
+        /* Makes the uniform block read the buffer bound to the given
+         * GL_UNIFORM_BUFFER binding point. Does nothing if there is no such block */
+        void setUniformBlockBinding(std::string const& name, GLuint binding) const;
+
+        static void bind(GLProgram const* program);
+
+    private:
+        GLProgram(GLProgram const&);
+        GLProgram& operator=(GLProgram const&);
+
+    private:
+        static ProgramCache* _cache;
+
+        GLuint _programID;
+};
+
+#endif // GLPROGRAM_HPP_INCLUDED
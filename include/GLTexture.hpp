@@ -0,0 +1,45 @@
+#ifndef GLTEXTURE_HPP_INCLUDED
+#define GLTEXTURE_HPP_INCLUDED
+
+#include <GL/glew.h>
+
+#include <SFML/System/Vector2.hpp>
+
+
+/* 2D texture with any internal format (RG32F...), nearest filtering
+ * (unless changed) and no mipmaps. Unlike sf::Texture, it doesn't need
+ * a SFML context. */
+class GLTexture
+{
+    public:
+        GLTexture();
+        ~GLTexture();
+
+        /* pixels can be null, the content is then undefined */
+        bool create(unsigned int width, unsigned int height, GLenum internalFormat,
+                    GLenum format=GL_RGBA, GLenum type=GL_UNSIGNED_BYTE,
+                    const void* pixels=nullptr);
+
+        /* Replaces the whole content, the size being unchanged */
+        void update(GLenum format, GLenum type, const void* pixels);
+
+        /* Bilinear filtering and repetition beyond the borders,
+         * instead of nearest texel and clamping */
+        void setBilinearRepeat();
+
+        GLuint getNativeHandle() const;
+        sf::Vector2u const& getSize() const;
+
+        /* Binds to the given texture unit, null unbinds */
+        static void bind(GLTexture const* texture, unsigned int unit=0);
+
+    private:
+        GLTexture(GLTexture const&);
+        GLTexture& operator=(GLTexture const&);
+
+    private:
+        GLuint _textureID;
+        sf::Vector2u _size;
+};
+
+#endif // GLTEXTURE_HPP_INCLUDED
@@ -0,0 +1,36 @@
+#ifndef HEADLESSCONTEXT_HPP_INCLUDED
+#define HEADLESSCONTEXT_HPP_INCLUDED
+
+#include <EGL/egl.h>
+
+
+/* OpenGL context without any window nor display server, created with
+ * EGL on Mesa's surfaceless platform (llvmpipe works on CPU-only machines).
+ * The default framebuffer is a 1x1 pbuffer: images must be rendered to
+ * framebuffer objects. The context is made current on construction. */
+class HeadlessContext
+{
+    public:
+        /* Compatibility profile of at least the requested version,
+         * or the driver's default context if it can't be created.
+         * Throws std::runtime_error if EGL isn't usable */
+        HeadlessContext(int majorVersion, int minorVersion);
+        ~HeadlessContext();
+
+        int getMajorVersion() const;
+        int getMinorVersion() const;
+
+    private:
+        HeadlessContext(HeadlessContext const&);
+        HeadlessContext& operator=(HeadlessContext const&);
+
+    private:
+        EGLDisplay _display;
+        EGLSurface _surface;
+        EGLContext _context;
+
+        int _majorVersion;
+        int _minorVersion;
+};
+
+#endif // HEADLESSCONTEXT_HPP_INCLUDED
@@ -0,0 +1,59 @@
+#ifndef INPUTLOG_HPP_INCLUDED
+#define INPUTLOG_HPP_INCLUDED
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <SFML/System/Time.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "glm.hpp"
+
+
+/* Input of the viewer frame after frame, recorded by InputRecorder and
+ * read back to replay a run: the same frames fed to the same particles
+ * give the same state. The file is a header, then one record per frame
+ * holding its duration and only what changed since the previous frame */
+class InputLog
+{
+    public:
+        /* Incremented whenever the layout of the file changes */
+        static const std::uint32_t VERSION = 1;
+
+        /* What the viewer applies at the beginning of a frame */
+        struct Frame
+        {
+            sf::Time frameTime; //handed to ParticlePages::update()
+            bool magnetActive = false;
+            sf::Vector2f magnetPosition; //in the coordinates of the particles
+            glm::vec2 cameraMovement = glm::vec2(0.f); //Camera::moveInPixels()
+            float cameraZoom = 1.f;
+            sf::Vector2u screenSize; //(0,0) unless the window was resized
+            bool reinitialized = false; //R
+            bool forceModelSwitched = false; //G
+        };
+
+        static void writeHeader(std::ostream& stream, sf::Vector2u const& screenSize);
+
+        /* Only the fields that differ from previous are written */
+        static void writeFrame(std::ostream& stream, Frame const& frame, Frame const& previous);
+
+    public:
+        /* Reads the whole file. Throws if it can't be read, or isn't a
+         * log of this version. A last frame cut short, as left by a run
+         * that didn't exit properly, is ignored */
+        explicit InputLog(std::string const& path);
+
+        /* Of the window when the recording started */
+        sf::Vector2u const& getScreenSize() const;
+
+        std::vector<Frame> const& getFrames() const;
+
+    private:
+        sf::Vector2u _screenSize;
+        std::vector<Frame> _frames;
+};
+
+#endif // INPUTLOG_HPP_INCLUDED
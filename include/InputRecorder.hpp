@@ -0,0 +1,39 @@
+#ifndef INPUTRECORDER_HPP_INCLUDED
+#define INPUTRECORDER_HPP_INCLUDED
+
+#include <fstream>
+#include <string>
+
+#include <SFML/System/Vector2.hpp>
+
+#include "InputLog.hpp"
+
+
+/* Appends the frames of the viewer to an InputLog as they are run. The
+ * file is buffered, and flushed every FLUSH_INTERVAL frames, so that a
+ * run that crashes still leaves most of its log */
+class InputRecorder
+{
+    public:
+        static const unsigned int FLUSH_INTERVAL = 600;
+
+        /* Truncates path. Throws if it can't be opened */
+        InputRecorder(std::string const& path, sf::Vector2u const& screenSize);
+
+        /* Throws if the file couldn't be written */
+        void record(InputLog::Frame const& frame);
+
+        unsigned int getNbFrames() const;
+
+    private:
+        InputRecorder(InputRecorder const&);
+        InputRecorder& operator=(InputRecorder const&);
+
+    private:
+        std::string _path;
+        std::ofstream _file;
+        InputLog::Frame _previous;
+        unsigned int _nbFrames;
+};
+
+#endif // INPUTRECORDER_HPP_INCLUDED
@@ -0,0 +1,22 @@
+#ifndef OPTIONS_HPP_INCLUDED
+#define OPTIONS_HPP_INCLUDED
+
+#include <string>
+
+#include "Particles.hpp"
+
+/* Command line options shared by the viewer and the benchmark.
+ * Returns false if option doesn't set a Particles::Settings field */
+bool parseSettingsOption (std::string const& option,
+                          Particles::Settings& settings);
+
+/* Usage line of the options above */
+const char* getSettingsUsage();
+
+/* Value of an option of the form "--name=value", false if the name differs
+ * or the value isn't a strictly positive integer */
+bool parsePositiveOption (std::string const& option,
+                          std::string const& name,
+                          int& value);
+
+#endif // OPTIONS_HPP_INCLUDED
@@ -0,0 +1,86 @@
+#ifndef PARTICLEPAGES_HPP_INCLUDED
+#define PARTICLEPAGES_HPP_INCLUDED
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/System/Time.hpp>
+
+#include "Camera.hpp"
+#include "GLFramebuffer.hpp"
+#include "Particles.hpp"
+#include "ThreadPool.hpp"
+#include "TiledImage.hpp"
+
+
+/* Particles of a picture larger than a single Particles can hold: the
+ * picture is cut into pages, each one a Particles of its own, laid out
+ * where its part of the picture is. Every page is simulated, then drawn,
+ * in turn. Pages don't interact: neighbour forces and gravity only act
+ * between particles of the same page.
+ * The tiles are read one page at a time, so that the whole picture is
+ * never decoded in RAM when it is mapped (see TiledImage) */
+class ParticlePages
+{
+    public:
+        /* Side of the pages when the driver accepts larger textures */
+        static const unsigned int DEFAULT_PAGE_SIZE = 4096;
+
+        /* Pages of at most pageSize x pageSize particles. 0 stands for
+         * DEFAULT_PAGE_SIZE, or GL_MAX_TEXTURE_SIZE if it is smaller.
+         * Storage::Packed and Storage::Float16 are replaced by
+         * Storage::Float32 if the picture is too large for the positions
+         * they can store precisely */
+        ParticlePages(TiledImage const& image, Particles::Settings const& settings=Particles::Settings(),
+                      unsigned int pageSize=0);
+
+        unsigned int getNbPages() const;
+
+        /* Settings that aren't forwarded below are set page by page */
+        Particles& getPage(unsigned int index);
+        Particles const& getPage(unsigned int index) const;
+
+        /* Of all the pages */
+        unsigned int getNbParticles() const;
+
+        void initialize();
+        void setMagnetState(bool activation);
+        void setMagnetPosition(sf::Vector2f const& position);
+        void setTimeStep(sf::Time const& step, unsigned int maxSubsteps);
+
+        /* Every page runs the same steps, whose number is returned */
+        unsigned int update(sf::Time const& frameTime);
+
+        void draw(sf::RenderWindow &window, Camera const& camera) const;
+        void draw(GLFramebuffer const& target, Camera const& camera) const;
+
+        /* Hash of the hashes of the pages, see Particles::computeStateHash() */
+        std::uint64_t computeStateHash() const;
+
+        /* A checkpoint per page, see Particles::saveCheckpoint(): path
+         * itself for a single page, path.N for the page N otherwise.
+         * Returns false, saving none, while a page is still saving.
+         * Throws, saving none, with emitters */
+        bool saveCheckpoint(std::string const& path);
+        bool isSavingCheckpoint();
+        void finishCheckpoint();
+        void loadCheckpoint(std::string const& path);
+
+    private:
+        ParticlePages(ParticlePages const&);
+        ParticlePages& operator=(ParticlePages const&);
+
+        std::string getCheckpointPath(std::string const& path, unsigned int page) const;
+
+    private:
+        /* CPU backend only, shared by the pages, and destroyed after them */
+        std::unique_ptr<ThreadPool> _threadPool;
+
+        std::vector<std::unique_ptr<Particles>> _pages;
+        unsigned int _nbParticles;
+};
+
+#endif // PARTICLEPAGES_HPP_INCLUDED
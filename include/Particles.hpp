@@ -2,61 +2,581 @@
 #define PARTICLES_HPP_INCLUDED
 
 #include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 #include <GL/glew.h>
 #include "glm.hpp"
 
-#include <SFML/Graphics/Shader.hpp>
-#include <SFML/Graphics/RenderTexture.hpp>
+#include <SFML/Graphics/Image.hpp>
 #include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/System/Time.hpp>
 #include <SFML/OpenGL.hpp>
 
 #include "Camera.hpp"
+#include "CheckpointWriter.hpp"
+#include "CPUSimulation.hpp"
+#include "FullscreenPass.hpp"
+#include "GLFramebuffer.hpp"
+#include "GLProgram.hpp"
+#include "GLTexture.hpp"
+#include "PassTimer.hpp"
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
 
 
 /* Class for handling particles that can be moved with the mouse.
- * Stores the particles' positions and velocities on a texture in GPU memory */
+ * Stores the particles' positions and velocities on a texture in GPU memory,
+ * or in RAM when the simulation runs on the CPU.
+ * OpenGL objects are created in the context active at construction,
+ * which must be active whenever the particles are used */
 class Particles
 {
     public:
-        Particles(std::string const& image);
+        /* Where the simulation runs */
+        enum class Backend
+        {
+            FragmentShaders, //textures updated by updateVelocity.frag and updatePosition.frag
+            CPU, //SIMD kernels run by a thread pool, positions streamed to a VBO
+            ComputeShader, //one dispatch of updateState.comp over a SSBO, requires OpenGL 4.3
+            TransformFeedback //update.vert streams each particle into the other VBO of a pair
+        };
+
+        /* Format of the positions and velocities textures (Backend::FragmentShaders only) */
+        enum class Storage
+        {
+            Packed, //RGBA8, each coordinate encoded in two channels (see utils.glsl)
+            Float16, //RG16F, raw half floats: less precise than Packed far from the origin
+            Float32 //RG32F, raw floats: twice the memory of Packed
+        };
+
+        /* Scheme of each simulation step, shared by every backend */
+        typedef CPUSimulation::Integrator Integrator;
+
+        /* Attractor or repulsor, in addition to the magnet */
+        typedef CPUSimulation::Attractor Attractor;
+
+        /* Separation, cohesion and alignment between close particles */
+        typedef CPUSimulation::NeighbourForces NeighbourForces;
+
+        /* Attraction between all the particles */
+        typedef CPUSimulation::Gravity Gravity;
+
+        /* Long range forces acting on the particles, besides the magnet */
+        enum class ForceModel
+        {
+            Attractors, //the attractors and the vector field only
+            Gravity //also the attraction of every other particle (Backend::CPU only)
+        };
+
+        /* Upper bound of Settings::maxAttractors */
+        static const unsigned int MAX_ATTRACTORS = 64;
+
+        /* Source of particles with a limited lifetime (Settings::emitters) */
+        struct Emitter
+        {
+            glm::vec2 position;
+            glm::vec2 direction; //of the initial velocity, normalized by setEmitters()
+            float spread; //half angle around direction, in radians
+            float speed;
+            float rate; //particles per second
+            float lifetime; //in seconds, each particle living 75% to 125% of it
+        };
+
+        /* Upper bound of the number of emitters */
+        static const unsigned int MAX_EMITTERS = 64;
+
+        /* Up to this number of slots (the magnet's included), the GPU
+         * shaders loop over a constant count, which the compiler unrolls */
+        static const unsigned int MAX_UNROLLED_SLOTS = 8;
+
+        /* Options chosen at construction */
+        struct Settings
+        {
+            explicit Settings(Backend backend=Backend::FragmentShaders,
+                              Storage storage=Storage::Packed,
+                              bool fusedUpdate=false,
+                              bool vertexIDAddressing=false,
+                              bool colorsFromTexture=false,
+                              Integrator integrator=Integrator::SemiImplicitEuler,
+                              unsigned int maxAttractors=0,
+                              bool vectorField=false,
+                              bool neighbourForces=false,
+                              ForceModel forceModel=ForceModel::Attractors,
+                              bool emitters=false);
+
+            Backend backend;
+            Storage storage;
+
+            /* Backend::FragmentShaders only: velocity and position are
+             * updated by a single pass (updateState.frag) writing to two
+             * render targets, instead of two passes */
+            bool fusedUpdate;
+
+            /* Backend::FragmentShaders only: displayParticles.vert finds the
+             * texel of each particle from gl_VertexID, instead of reading it
+             * from a texture coordinates buffer (8 bytes per particle) */
+            bool vertexIDAddressing;
+
+            /* The image is kept as a RGBA8 texture read by the display
+             * shader, instead of a color buffer (RGBA8 vertex attribute) */
+            bool colorsFromTexture;
+
+            /* Verlet and RK2 are more accurate at large steps, but
+             * cost a second evaluation of the acceleration. Without
+             * fusedUpdate, the position pass of the fragment shaders
+             * backend also computes the whole step again */
+            Integrator integrator;
+
+            /* Number of attractors that setAttractors() accepts, at most
+             * MAX_ATTRACTORS. The shaders are specialized for it, so
+             * keep it as small as the application needs */
+            unsigned int maxAttractors;
+
+            /* An acceleration field, given by setVectorField(), is added
+             * to the attractors'. Costs a bilinear sample per evaluation */
+            bool vectorField;
+
+            /* Backend::CPU and Backend::ComputeShader only: particles
+             * interact with their neighbours (see setNeighbourForces()),
+             * found by sorting them into a spatial grid at each step */
+            bool neighbourForces;
+
+            /* Initial force model, see setForceModel() */
+            ForceModel forceModel;
+
+            /* Backend::ComputeShader only: the particles are slots
+             * spawned by the emitters (see setEmitters()) and recycled
+             * when they die, instead of the picture's pixels living
+             * forever. Only the live ones are drawn. Not compatible
+             * with neighbourForces */
+            bool emitters;
+        };
+
+    public:
+        /* Falls back to Backend::FragmentShaders if the requested backend
+         * isn't supported by the current OpenGL context */
+        Particles(std::string const& image, Settings const& settings=Settings());
+
+        /* One particle per pixel, with the pixel's color. The picture is
+         * laid out around layoutCenter: a part of a larger one can be
+         * placed where it is in the whole (see ParticlePages).
+         * The CPU backend runs on sharedThreadPool, which must outlive the
+         * particles, so that several of them share its threads, or on a
+         * pool of its own if it is null */
+        Particles(sf::Image const& image, Settings const& settings=Settings(),
+                  glm::vec2 const& layoutCenter=glm::vec2(0.f), ThreadPool* sharedThreadPool=nullptr);
         ~Particles();
 
+        Backend getBackend() const;
+        static const char* getBackendName(Backend backend);
+
+        /* Threads of the CPU backend's pool, 0 with the other backends */
+        unsigned int getNbThreads() const;
+
+        Storage getStorage() const;
+        static const char* getStorageName(Storage storage);
+
+        Integrator getIntegrator() const;
+        static const char* getIntegratorName(Integrator integrator);
+
+        bool isUpdateFused() const;
+        bool isAddressedByVertexID() const;
+        bool areColorsFromTexture() const;
+
+        /* Per-pass timings, off by default. Statistics are updated
+         * at the beginning of each step */
+        void enablePassTimer(PassTimer::Source source);
+        PassTimer const& getPassTimer() const;
+
         unsigned int getNbParticles() const;
         sf::Vector2u const& getBuffersSize() const;
 
-        /* Centers particles with zero initial speed */
+        /* Center of the picture's layout, see the constructor */
+        glm::vec2 const& getLayoutCenter() const;
+
+        /* Centers particles with zero initial speed. With Settings::emitters,
+         * kills every particle instead */
         void initialize();
 
         /* Activation and movement of the magnet attracting the particles */
         void setMagnetState (bool activation);
         void setMagnetPosition(sf::Vector2f const& position);
 
+        /* Replaces the attractors, applied from the next step. Throws if
+         * there are more than Settings::maxAttractors, or if a falloff
+         * isn't 0, 1 or 2 */
+        void setAttractors(std::vector<Attractor> const& attractors);
+        std::vector<Attractor> const& getAttractors() const;
+        unsigned int getMaxAttractors() const;
+
+        /* Settings::vectorField only. Replaces the acceleration field,
+         * tiled over the plane, from the next step. The GPU backends
+         * upload it to the texture not in use, then swap */
+        bool hasVectorField() const;
+        void setVectorField(VectorField const& field);
+
+        /* Settings::neighbourForces only, with a supported backend. The
+         * cost of a step grows with the number of particles within the
+         * radius, at most maxNeighbours */
+        bool hasNeighbourForces() const;
+        void setNeighbourForces(NeighbourForces const& forces);
+        NeighbourForces const& getNeighbourForces() const;
+
+        /* Applied from the next step. ForceModel::Gravity throws with a
+         * backend other than Backend::CPU. Its cost is O(n log n) per step,
+         * lower with a larger opening angle (see setGravity()) */
+        void setForceModel(ForceModel model);
+        ForceModel getForceModel() const;
+        static const char* getForceModelName(ForceModel model);
+
+        /* Throws if the opening angle is negative or the softening isn't
+         * positive. Defaults to a strength of 200000, an opening angle of
+         * 0.5 and a softening of 2 */
+        void setGravity(Gravity const& gravity);
+        Gravity const& getGravity() const;
+
+        /* Settings::emitters only. Replaces the emitters, applied from the
+         * next step. Throws if there are more than MAX_EMITTERS, if a rate
+         * is negative or a lifetime isn't positive. The particles due
+         * while every slot is alive are dropped */
+        bool hasEmitters() const;
+        void setEmitters(std::vector<Emitter> const& emitters);
+        std::vector<Emitter> const& getEmitters() const;
+
+        /* Rate of each of nbEmitters emitters of particles living lifetime
+         * on average, that together keep about liveFraction of the
+         * nbParticles slots alive */
+        static float computeEmitterRate(unsigned int nbParticles, std::size_t nbEmitters,
+                                        float lifetime, float liveFraction);
+
+        /* As of the last step, every particle without Settings::emitters.
+         * Waits for the GPU: meant for tests and benchmarks */
+        unsigned int countLiveParticles() const;
+
+        /* Fixed time step used by update(). After a hitch, at most maxSubsteps
+         * steps are run in a frame and the remaining time is dropped.
+         * Defaults to 1/60 s and 4 substeps */
+        void setTimeStep(sf::Time const& step, unsigned int maxSubsteps);
+        sf::Time const& getTimeStep() const;
+        unsigned int getMaxSubsteps() const;
+
+        /* Accumulates the frame time and consumes it by fixed steps, all
+         * submitted at once. draw() then interpolates between the last two
+         * states according to the time left. Returns the number of steps run */
+        unsigned int update(sf::Time const& frameTime);
+
+        /* Single step of the given duration, drawn without interpolation */
         void computeNewPositions(sf::Time const& dt);
 
-        void draw(sf::RenderWindow &window, Camera const& camera) const;
+        /* Copies the current positions back to RAM, in the order of the
+         * image's pixels. Waits for the GPU: meant for tests and benchmarks */
+        void readPositions(std::vector<glm::vec2>& positions) const;
+
+        /* FNV-1a hash of the whole state, as a checkpoint would save it,
+         * and of the time not simulated yet: equal hashes after the same
+         * frames mean the runs matched bit for bit. Waits for the GPU */
+        std::uint64_t computeStateHash() const;
+
+        /* Saves both states of each pair, the magnet and the parameters
+         * of the simulation (attractors, forces, time step) to a file
+         * (see CheckpointFile), without waiting for the GPU: the state is
+         * copied into pixel buffers, which a background thread writes
+         * once the copy is over, as seen by the next steps. Returns false
+         * if the previous checkpoint isn't written yet. The vector field
+         * isn't saved. Throws with Settings::emitters */
+        bool saveCheckpoint(std::string const& path);
+
+        /* Never blocks. Throws if the last checkpoint couldn't be written */
+        bool isSavingCheckpoint();
+
+        /* Blocks until the last checkpoint is written */
+        void finishCheckpoint();
+
+        /* Replaces the state and the parameters by those of a checkpoint
+         * of particles of the same size, backend and storage. The chunks
+         * of the mapped file are uploaded as they are. Throws if the file
+         * doesn't match, the particles being left unchanged */
+        void loadCheckpoint(std::string const& path);
+
+        /* Without clear, the particles are drawn over what the target
+         * already shows, such as the other pages of a ParticlePages */
+        void draw(sf::RenderWindow &window, Camera const& camera, bool clear=true) const;
+
+        /* Renders into a framebuffer object instead of a window (headless mode) */
+        void draw(GLFramebuffer const& target, Camera const& camera, bool clear=true) const;
+
+    private:
+        /* Draws to the bound framebuffer, the viewport being already set */
+        void drawParticles(Camera const& camera) const;
+
+        /* Runs nbSteps steps of dt, then draw() shows the state at
+         * interpolation between the last two ones (0: previous, 1: current) */
+        void simulate(float dt, unsigned int nbSteps, float interpolation);
+
+        void computeNewPositionsOnCPU(float dt, unsigned int nbSteps);
+        void uploadCPUPositions();
+
+        /* The magnet, when active, followed by the attractors */
+        void getActiveAttractors(std::vector<Attractor>& attractors) const;
+
+        /* Writes the Parameters block read by the GPU backends */
+        void updateParameters(float dt);
+
+        void computeNewPositionsInTwoPasses();
+        void computeNewPositionsFused();
+
+        void computeNewPositionsWithComputeShader();
+
+        /* Settings::emitters: spawns the particles due over a step of dt,
+         * in the slots found dead by the previous step */
+        void emitParticles(float dt);
+
+        /* Compute shader backend with neighbour forces: sorts the current
+         * state by bucket of the spatial grid, into _sortedStateBufferID */
+        void binParticles();
+        void dispatchPrefixSum(GLProgram const& program, GLuint valuesBufferID, GLuint blockSumsBufferID,
+                               GLuint nbValues) const;
+        /* One invocation per particle, or nbInvocations if not 0 */
+        void dispatchCompute(GLProgram const& program, GLuint sourceBufferID, GLuint destinationBufferID,
+                             GLuint nbInvocations=0) const;
+
+        void computeNewPositionsWithTransformFeedback();
+        void runTransformFeedback(GLProgram const& program, GLuint sourceBufferID, GLuint destinationBufferID) const;
+
+        /* Chunks of state of a checkpoint, following CheckpointParameters,
+         * and the size of each one */
+        unsigned int getNbCheckpointChunks() const;
+        std::size_t getCheckpointChunkSize() const;
+
+        /* Once the state is copied, hands it to _checkpointWriter, then
+         * releases the copy once written. With wait, blocks until then */
+        void pollCheckpoint(bool wait);
+        void startWritingCheckpoint();
+        void releaseCheckpointCopy();
+
+        /* Same layout as the Parameters block of parameters.glsl (std140) */
+        struct AttractorBlock
+        {
+            glm::vec2 position;
+            float strength;
+            float squaredRadius;
+            GLint falloff;
+            GLint padding[3]; //structures are aligned to 16 bytes
+        };
+
+        /* Same layout as the Emitters buffer of emitParticles.comp (std430) */
+        struct EmitterBlock
+        {
+            glm::vec2 position;
+            glm::vec2 direction;
+            float spread;
+            float speed;
+            float lifetime; //in units of dt
+            GLuint firstParticle; //index of its first invocation
+        };
+
+        /* Same layout as the Counters buffer of updateState.comp: a
+         * DrawElementsIndirectCommand drawing the live particles, then
+         * the number of dead ones */
+        struct EmissionCounters
+        {
+            GLuint nbLiveParticles;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+            GLuint nbDeadParticles;
+        };
+
+        /* First chunk of a checkpoint. Changing its layout requires a new
+         * CheckpointFile::VERSION */
+        struct CheckpointParameters
+        {
+            GLint64 timeStep; //microseconds
+            GLint64 accumulatedTime;
+            GLuint backend;
+            GLuint storage;
+            GLuint width;
+            GLuint height;
+            GLuint currentBufferIndex;
+            GLuint maxSubsteps;
+            float interpolation;
+            float maxSpeed;
+            float attraction; //of the magnet, 0 when inactive
+            float friction;
+            glm::vec2 magnetPosition;
+            GLuint forceModel;
+            Gravity gravity;
+            NeighbourForces neighbourForces;
+            GLuint nbAttractors;
+            Attractor attractors[MAX_ATTRACTORS];
+        };
+
+        struct ParametersBlock
+        {
+            glm::vec2 bufferSize;
+            float dt;
+            float maxSpeed;
+            float friction; //already raised to the power dt
+            GLint nbAttractors;
+            glm::vec2 vectorFieldOrigin;
+            glm::vec2 vectorFieldScale;
+            float neighbourRadius;
+            float separation;
+            float cohesion;
+            float alignment;
+            GLint maxNeighbours;
+            GLuint nbBuckets;
+            AttractorBlock attractors[MAX_ATTRACTORS + 1]; //only the first _nbAttractorSlots are uploaded
+        };
 
     private:
+        Backend _backend;
+        Storage _storage;
+        bool _fusedUpdate;
+        bool _vertexIDAddressing;
+        bool _colorsFromTexture;
+        Integrator _integrator;
+
         float _maxSpeed;
         float _attraction;
         float _friction;
 
         sf::Vector2f _magnetPosition;
 
+        std::vector<Attractor> _attractors;
+        unsigned int _maxAttractors;
+        unsigned int _nbAttractorSlots; //size of the attractors array of the shaders
+
+        /* Vector field: sampled from _vectorFieldTextures[_currentVectorFieldIndex]
+         * by the GPU backends, from _cpuVectorField by the CPU one */
+        bool _vectorField;
+        std::array<GLTexture, 2> _vectorFieldTextures;
+        int _currentVectorFieldIndex;
+        VectorField _cpuVectorField;
+        glm::vec2 _vectorFieldOrigin;
+        glm::vec2 _vectorFieldScale; //inverse of the size of a tile
+
+        bool _neighbourForces;
+        NeighbourForces _neighbourParameters;
+
+        ForceModel _forceModel;
+        Gravity _gravity;
+
+        bool _emitters;
+        std::vector<Emitter> _emitterList;
+        std::vector<float> _emissionCredits; //fraction of particle left to emit by each emitter
+        GLuint _emissionSeed; //incremented by each step
+
         sf::Vector2u _buffersSize;
+        glm::vec2 _layoutCenter;
 
         int _currentBufferIndex; //0 or 1 alternatively
-        std::array<sf::RenderTexture, 2> _positions;
-        std::array<sf::RenderTexture, 3> _velocities;
 
-        sf::Shader _computeInitialPositionsShader;
-        sf::Shader _computeInitialVelocitiesShader;
-        sf::Shader _updateVelocityShader;
-        sf::Shader _updatePositionShader;
-        mutable sf::Shader _displayVerticesShader;
+        sf::Time _timeStep;
+        unsigned int _maxSubsteps;
+        sf::Time _accumulatedTime; //not simulated yet, less than _timeStep
+        float _interpolation; //between the previous (0) and current (1) states
+
+        mutable PassTimer _passTimer; //also measures draw()
+
+        /* Checkpoint being saved: the state is copied into the pixel
+         * buffers _checkpointBufferIDs (GPU backends) or _checkpointState
+         * (CPU backend), then written from their mappings by
+         * _checkpointWriter, once _checkpointFence is signaled */
+        CheckpointWriter _checkpointWriter;
+        std::string _checkpointPath;
+        CheckpointParameters _checkpointParameters;
+        std::vector<GLuint> _checkpointBufferIDs;
+        std::vector<float> _checkpointState;
+        GLsync _checkpointFence; //null without ARB_sync
+        bool _checkpointCopying;
+        bool _checkpointWriting;
+        std::string _checkpointError; //of the last checkpoint, until reported
 
+        GLProgram _displayVerticesProgram;
+
+        GLTexture _colorTexture;
         GLuint _colorBufferID;
         GLuint _texCoordBufferID;
+
+        /* Locations in _displayVerticesProgram, retrieved once after loading */
+        GLint _viewMatrixLocation;
+        GLint _locationAttributeID; //position or coordsOnBuffer, -1 if unused
+        GLint _colorAttributeID; //-1 if unused
+        GLint _interpolationLocation;
+        GLint _previousPositionAttributeID; //compute shader and transform feedback only
+
+        /* GPU backends only: ParametersBlock, bound to the Parameters block */
+        GLuint _parametersBufferID;
+
+        /* Fragment shaders backend only. Each pass renders to one of the
+         * framebuffers with the fullscreen triangle of _fullscreenPass */
+        std::array<GLTexture, 2> _positions;
+        std::array<GLTexture, 2> _velocities;
+        std::array<GLFramebuffer, 2> _positionFramebuffers;
+        std::array<GLFramebuffer, 2> _velocityFramebuffers;
+        FullscreenPass _fullscreenPass;
+        GLProgram _computeInitialPositionsProgram;
+        GLProgram _computeInitialVelocitiesProgram;
+        GLProgram _updateVelocityProgram;
+        GLProgram _updatePositionProgram;
+
+        /* Fused update only: _stateFramebuffers[i] renders to
+         * _velocities[i] and _positions[i] at once */
+        std::array<GLFramebuffer, 2> _stateFramebuffers;
+        GLProgram _fusedUpdateProgram;
+
+        /* CPU backend only */
+        std::unique_ptr<ThreadPool> _ownThreadPool; //when none is shared
+        ThreadPool* _threadPool;
+        std::unique_ptr<CPUSimulation> _cpuSimulation;
+        GLuint _positionBufferID;
+
+        /* Compute shader backend only. updateState.comp reads
+         * _stateBufferIDs[_currentBufferIndex] and writes the other one */
+        GLProgram _computeInitialStateProgram;
+        GLProgram _updateStateProgram;
+        std::array<GLuint, 2> _stateBufferIDs;
+
+        /* Compute shader backend with neighbour forces only: spatial grid
+         * built by binParticles() (see SpatialGrid for the CPU backend) */
+        GLProgram _binParticlesProgram;
+        GLProgram _prefixSumProgram;
+        GLProgram _addBlockOffsetsProgram;
+        GLProgram _sortParticlesProgram;
+        GLuint _nbBuckets;
+        GLuint _bucketStartsBufferID; //counts, then their exclusive prefix sum
+        GLuint _particleBucketsBufferID; //bucket and rank in the bucket of each particle
+        GLuint _blockSumsBufferID;
+        GLuint _scanTotalBufferID; //sum of the block sums, unused
+        GLuint _sortedStateBufferID;
+        GLuint _sortedIndicesBufferID;
+
+        /* Compute shader backend with emitters only. The dead and live
+         * slots are listed again by each step of updateState.comp: the
+         * dead ones are the free list of emitParticles.comp, the live ones
+         * the index buffer of an indirect draw */
+        GLProgram _emitParticlesProgram;
+        GLint _nbEmittersLocation;
+        GLint _nbEmittedLocation;
+        GLint _emissionSeedLocation;
+        GLuint _lifeBufferID; //age and lifetime of each particle
+        GLuint _deadIndicesBufferID;
+        GLuint _liveIndicesBufferID;
+        GLuint _emissionCountersBufferID; //EmissionCounters
+        GLuint _emittersBufferID; //EmitterBlock[MAX_EMITTERS]
+
+        /* Transform feedback backend only. Same layout as _stateBufferIDs,
+         * _transformFeedbackBufferIDs[_currentBufferIndex] holds the current state */
+        GLProgram _transformFeedbackInitialStateProgram;
+        GLProgram _transformFeedbackUpdateProgram;
+        std::array<GLuint, 2> _transformFeedbackBufferIDs;
+        GLint _transformFeedbackPositionAttributeID;
+        GLint _transformFeedbackVelocityAttributeID;
+        GLuint _transformFeedbackVertexArrayID; //empty, bound for the initialization
 };
 
 #endif // PARTICLES_HPP_INCLUDED
@@ -0,0 +1,124 @@
+#ifndef PASSTIMER_HPP_INCLUDED
+#define PASSTIMER_HPP_INCLUDED
+
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "Tracer.hpp"
+
+
+/* Measures the duration of each pass of the simulation and of the display.
+ * GPU durations come from pairs of GL_TIMESTAMP queries. Each pass has a
+ * ring of them, whose results are only read once available (a few frames
+ * later), so that measuring never stalls the pipeline: if the ring is full,
+ * the pass is simply not measured.
+ * The CPU clock measures the same passes where timer queries are missing,
+ * waiting for the GPU at the end of each pass (glFinish).
+ * In trace builds, GPU durations are also added to the GPU track of the Tracer. */
+class PassTimer
+{
+    public:
+        enum Pass
+        {
+            VelocityPass, //updateVelocity.frag
+            PositionPass, //updatePosition.frag
+            BinningPass, //compute shader backend: spatial grid of the neighbour forces
+            EmissionPass, //compute shader backend: particles spawned by the emitters
+            StatePass, //fused update, compute shader, transform feedback or CPU kernels
+            UploadPass, //CPU backend: positions copied to the vertex buffer
+            DrawPass,
+            NB_PASSES
+        };
+
+        enum class Source
+        {
+            GPUQueries, //requires OpenGL 3.3 or ARB_timer_query
+            CPUClock
+        };
+
+        /* Durations in milliseconds over the last samples */
+        struct Statistics
+        {
+            static const unsigned int NB_BINS = 12;
+
+            unsigned int nbSamples;
+            float average;
+            float max;
+
+            /* histogram[i] counts the durations in ]getBinUpperBound(i-1), getBinUpperBound(i)] */
+            std::array<unsigned int, NB_BINS> histogram;
+
+            static float getBinUpperBound(unsigned int bin);
+        };
+
+    public:
+        PassTimer();
+        ~PassTimer();
+
+        /* Falls back to Source::CPUClock if timer queries aren't supported.
+         * Until then, begin() and end() do nothing */
+        void enable(Source source);
+        bool isEnabled() const;
+        Source getSource() const;
+
+        static const char* getPassName(Pass pass);
+
+        /* Passes can't overlap. With CPU passes (CPU backend), the CPU clock
+         * is used whatever the source */
+        void begin(Pass pass, bool cpuPass=false);
+        void end(Pass pass);
+
+        /* Reads the results that are available, without waiting */
+        void collect();
+
+        Statistics getStatistics(Pass pass) const;
+
+        /* One line per measured pass */
+        void printReport(std::ostream& stream) const;
+
+    private:
+        PassTimer(PassTimer const&);
+        PassTimer& operator=(PassTimer const&);
+
+        void addSample(Pass pass, float duration);
+
+#ifdef PARTICLES_TRACE
+        /* Offset from GL_TIMESTAMP to Tracer::now(), measured again from
+         * time to time since both clocks may drift */
+        void calibrateGPUClock();
+#endif
+
+    private:
+        /* Queries of a pass not read yet */
+        static const unsigned int RING_SIZE = 4;
+        /* Samples kept for the statistics */
+        static const unsigned int WINDOW_SIZE = 120;
+
+        struct PassRecord
+        {
+            std::array<GLuint, 2*RING_SIZE> queryIDs; //begin and end timestamps of each slot
+            unsigned int firstPending;
+            unsigned int nbPending;
+            bool measuring;
+            bool cpuPass;
+            std::chrono::steady_clock::time_point cpuBegin;
+
+            std::vector<float> samples; //ring of at most WINDOW_SIZE
+            unsigned int nextSample;
+        };
+
+        bool _enabled;
+        Source _source;
+        std::array<PassRecord, NB_PASSES> _passes;
+
+#ifdef PARTICLES_TRACE
+        GLint64 _gpuClockOffset;
+        unsigned int _nbCollectsSinceCalibration;
+#endif
+};
+
+#endif // PASSTIMER_HPP_INCLUDED
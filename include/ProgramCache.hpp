@@ -0,0 +1,61 @@
+#ifndef PROGRAMCACHE_HPP_INCLUDED
+#define PROGRAMCACHE_HPP_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GLProgram.hpp"
+
+
+/* Binaries of linked programs saved in a directory, one file per
+ * program, so that the next launches skip compiling and linking them
+ * (glGetProgramBinary / glProgramBinary, OpenGL 4.1).
+ * A program is keyed by a hash of its preprocessed sources and of the
+ * driver (vendor, renderer and version): editing a shader, changing the
+ * settings or updating the driver gives other keys. A binary that the
+ * driver rejects anyway is compiled again and replaced. */
+class ProgramCache
+{
+    public:
+        /* The directory is created if it doesn't exist. Needs a
+         * context, to query the driver */
+        explicit ProgramCache(std::string const& directory);
+
+        /* Without support for program binaries, nothing is cached */
+        bool isAvailable() const;
+
+        std::uint64_t computeKey(std::vector<GLProgram::Source> const& sources,
+                                 std::vector<std::string> const& feedbackVaryings) const;
+
+        /* New program linked from the binary saved for key, 0 if there
+         * is none or the driver rejects it */
+        GLuint load(std::uint64_t key);
+
+        /* Saves the binary of a linked program. Failures are printed to
+         * std::cerr, the program staying usable */
+        void store(std::uint64_t key, GLuint programID);
+
+        /* Programs loaded from the cache, and compiled instead (missing,
+         * or rejected by the driver) */
+        unsigned int getNbLoaded() const;
+        unsigned int getNbCompiled() const;
+
+    private:
+        ProgramCache(ProgramCache const&);
+        ProgramCache& operator=(ProgramCache const&);
+
+        std::string getPath(std::uint64_t key) const;
+
+    private:
+        std::string _directory;
+        std::string _driver;
+        bool _available;
+
+        unsigned int _nbLoaded;
+        unsigned int _nbCompiled;
+};
+
+#endif // PROGRAMCACHE_HPP_INCLUDED
@@ -0,0 +1,77 @@
+#ifndef SPATIALGRID_HPP_INCLUDED
+#define SPATIALGRID_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ThreadPool.hpp"
+
+
+/* Uniform grid over the whole plane, whose cells are hashed into a table
+ * of buckets: the table is a grid of cells repeated over the plane, so
+ * that neighbouring cells are in neighbouring buckets, and cells only
+ * share a bucket with those a whole table away.
+ * build() sorts the particles by bucket with a parallel counting sort,
+ * so that the particles of a bucket are contiguous: a neighbour search
+ * then reads the buckets of the 3x3 cells around a particle, three
+ * contiguous ranges. Same hash and table size as spatialGrid.glsl, whose
+ * buckets are sorted by the compute shader backend. */
+class SpatialGrid
+{
+    public:
+        /* Bounds of getNbBuckets(). The GPU prefix sum works on blocks
+         * of MIN_BUCKETS values, and scans the sums of at most that
+         * many blocks in a single one */
+        static const std::uint32_t MIN_BUCKETS = 1024;
+        static const std::uint32_t MAX_BUCKETS = MIN_BUCKETS * MIN_BUCKETS;
+
+        /* Power of two, at least one bucket per particle within the bounds.
+         * The table is 2^ceil(log2(n)/2) buckets wide */
+        static std::uint32_t getNbBuckets(std::size_t nbParticles);
+
+    public:
+        SpatialGrid(std::size_t nbParticles, ThreadPool& threadPool);
+
+        std::uint32_t getNbBuckets() const;
+
+        /* Coordinate of the cell containing a coordinate of the plane */
+        std::int32_t getCell(float coordinate) const;
+
+        /* Cells of the 3x3 block around a cell are in distinct buckets */
+        std::uint32_t getBucket(std::int32_t cellX, std::int32_t cellY) const;
+
+        /* Sorts the particles by bucket, for cells of cellSize */
+        void build(float const* positionsX, float const* positionsY, float cellSize);
+
+        /* Particle indices sorted by bucket, then by index so that the
+         * order doesn't depend on the scheduling of the threads */
+        std::vector<std::uint32_t> const& getSortedIndices() const;
+
+        /* Range of a bucket in getSortedIndices() */
+        std::uint32_t getBucketBegin(std::uint32_t bucket) const;
+        std::uint32_t getBucketEnd(std::uint32_t bucket) const;
+
+    private:
+        SpatialGrid(SpatialGrid const&);
+        SpatialGrid& operator=(SpatialGrid const&);
+
+    private:
+        std::size_t _nbParticles;
+        std::uint32_t _nbBuckets;
+        std::uint32_t _bucketsWidth;
+        float _cellSize;
+
+        ThreadPool& _threadPool;
+
+        std::unique_ptr<std::atomic<std::uint32_t>[]> _bucketCounts;
+        std::vector<std::uint32_t> _bucketStarts; //prefix sum of the counts, and the total at the end
+        std::vector<std::uint32_t> _blockOffsets; //prefix sum of the counts of each block of buckets
+
+        std::vector<std::uint32_t> _particleBuckets;
+        std::vector<std::uint32_t> _particleRanks; //in the bucket, in the order of the counting
+        std::vector<std::uint32_t> _sortedIndices;
+};
+
+#endif // SPATIALGRID_HPP_INCLUDED
@@ -0,0 +1,52 @@
+#ifndef THREADPOOL_HPP_INCLUDED
+#define THREADPOOL_HPP_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads used for data-parallel loops.
+ * The calling thread takes part in the work, so a pool of N threads
+ * spawns N-1 workers. */
+class ThreadPool
+{
+    public:
+        /* 0 means one thread per hardware core */
+        explicit ThreadPool(unsigned int nbThreads=0);
+        ~ThreadPool();
+
+        unsigned int getNbThreads() const;
+
+        /* Calls task(begin, end) on disjoint ranges covering [0, count),
+         * and returns once every range has been processed.
+         * Ranges boundaries are multiples of granularity (except the last one). */
+        void parallelFor(std::size_t count,
+                         std::function<void(std::size_t, std::size_t)> const& task,
+                         std::size_t granularity=1);
+
+    private:
+        void workerLoop();
+        void processChunks();
+
+    private:
+        std::vector<std::thread> _workers;
+
+        std::mutex _mutex;
+        std::condition_variable _jobAvailable;
+        std::condition_variable _jobDone;
+        unsigned long _jobIndex; //incremented for each new job
+        unsigned int _nbBusyWorkers;
+        bool _stopping;
+
+        /* Current job */
+        std::function<void(std::size_t, std::size_t)> const* _task;
+        std::size_t _count;
+        std::size_t _chunkSize;
+        std::atomic<std::size_t> _nextChunk;
+};
+
+#endif // THREADPOOL_HPP_INCLUDED
@@ -0,0 +1,59 @@
+#ifndef TILEDIMAGE_HPP_INCLUDED
+#define TILEDIMAGE_HPP_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/System/Vector2.hpp>
+
+
+/* Picture read one rectangle at a time, so that it needn't fit in a
+ * texture, nor its decoded pixels in RAM.
+ * Uncompressed BMPs (24 or 32 bits per pixel) are mapped in memory, and
+ * only the rows of a tile are converted when it is read. Other formats
+ * are decoded as a whole by sf::Image, then cut into tiles. */
+class TiledImage
+{
+    public:
+        /* Throws if the file can't be opened or decoded */
+        explicit TiledImage(std::string const& path);
+        ~TiledImage();
+
+        sf::Vector2u const& getSize() const;
+
+        /* Whether the file is mapped, rather than decoded as a whole */
+        bool isMapped() const;
+
+        /* Pixels of the rectangle of the given size at origin, clipped
+         * to the picture, as RGBA rows from top to bottom */
+        void readTile(sf::Vector2u const& origin, sf::Vector2u const& size, sf::Image& tile) const;
+
+    private:
+        TiledImage(TiledImage const&);
+        TiledImage& operator=(TiledImage const&);
+
+        /* Returns false, the file being left unmapped, if it isn't a BMP
+         * of a supported layout */
+        bool mapBitmap(std::string const& path);
+        void unmap();
+
+    private:
+        sf::Vector2u _size;
+
+        /* Mapped BMP */
+        void* _mapping;
+        std::size_t _mappingSize;
+        std::uint8_t const* _topRow;
+        std::ptrdiff_t _rowStride; //negative when the rows are stored bottom up
+        unsigned int _bytesPerPixel;
+        std::array<unsigned int, 4> _channelBytes; //byte of red, green, blue and alpha in a pixel
+        bool _hasAlpha;
+
+        /* Other formats */
+        sf::Image _image;
+};
+
+#endif // TILEDIMAGE_HPP_INCLUDED
@@ -0,0 +1,66 @@
+#ifndef TRACER_HPP_INCLUDED
+#define TRACER_HPP_INCLUDED
+
+/* Timeline of scoped zones, written in the Chrome trace event format
+ * (chrome://tracing, Perfetto).
+ * Only compiled with PARTICLES_TRACE defined (make TRACE=1): otherwise
+ * the macros below expand to nothing and nothing is recorded. */
+
+#ifdef PARTICLES_TRACE
+
+    #include <cstdint>
+    #include <string>
+
+    #define PARTICLES_TRACE_CONCAT2(a, b) a##b
+    #define PARTICLES_TRACE_CONCAT(a, b) PARTICLES_TRACE_CONCAT2(a, b)
+
+    /* name must be a string literal (only the pointer is stored) */
+    #define TRACE_ZONE(name) Tracer::Zone PARTICLES_TRACE_CONCAT(traceZone, __LINE__)(name)
+    #define TRACE_THREAD_NAME(name) Tracer::setThreadName(name)
+
+    class Tracer
+    {
+        public:
+            /* Records the time between its construction and its destruction */
+            class Zone
+            {
+                public:
+                    explicit Zone(const char* name);
+                    ~Zone();
+
+                private:
+                    Zone(Zone const&);
+                    Zone& operator=(Zone const&);
+
+                private:
+                    const char* _name;
+                    std::int64_t _begin;
+            };
+
+        public:
+            /* Nanoseconds since the start of the program, same clock for every thread */
+            static std::int64_t now();
+
+            /* Name of the calling thread's track */
+            static void setThreadName(const char* name);
+
+            /* Zone on the calling thread's track */
+            static void addZone(const char* name, std::int64_t begin, std::int64_t end);
+
+            /* Zone on the GPU track, times already converted to now()'s clock.
+             * Only called from the thread owning the OpenGL context */
+            static void addGPUZone(const char* name, std::int64_t begin, std::int64_t end);
+
+            /* Writes every zone recorded so far. Zones still being recorded
+             * by other threads may be missing */
+            static bool write(std::string const& filename);
+    };
+
+#else
+
+    #define TRACE_ZONE(name)
+    #define TRACE_THREAD_NAME(name)
+
+#endif // PARTICLES_TRACE
+
+#endif // TRACER_HPP_INCLUDED
@@ -1,6 +1,8 @@
 #ifndef UTILITIES_HPP_INCLUDED
 #define UTILITIES_HPP_INCLUDED
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 void loadFile(std::string const& filePath,
@@ -10,4 +12,13 @@ void searchAndReplace (std::string const& tobeReplaced,
                        std::string const& replacement,
                        std::string& container);
 
+/* Adds "#define name" right after the #version directive of a GLSL source */
+void insertDefine (std::string const& name,
+                   std::string& shaderSource);
+
+/* 64-bit FNV-1a of size bytes, continued from hash */
+const std::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+std::uint64_t hashBytes (void const* data, std::size_t size,
+                         std::uint64_t hash=FNV_OFFSET_BASIS);
+
 #endif // UTILITIES_HPP_INCLUDED
@@ -0,0 +1,51 @@
+#ifndef VECTORFIELD_HPP_INCLUDED
+#define VECTORFIELD_HPP_INCLUDED
+
+#include <vector>
+
+#include "glm.hpp"
+
+#include "ThreadPool.hpp"
+
+
+/* Grid of 2D vectors covering a rectangle of the plane, and repeated
+ * beyond it. Sampled like a GL_LINEAR, GL_REPEAT texture: values are
+ * located at the centers of the cells, and interpolated bilinearly. */
+class VectorField
+{
+    public:
+        /* Empty field, which samples to zero */
+        VectorField();
+        VectorField(unsigned int width, unsigned int height,
+                    glm::vec2 const& origin, glm::vec2 const& size);
+
+        unsigned int getWidth() const;
+        unsigned int getHeight() const;
+        bool isEmpty() const;
+
+        /* Rectangle covered by one tile, in world coordinates */
+        glm::vec2 const& getOrigin() const;
+        glm::vec2 const& getSize() const;
+
+        /* Row by row, the first row at origin.y */
+        std::vector<glm::vec2> const& getValues() const;
+        glm::vec2& at(unsigned int x, unsigned int y);
+
+        glm::vec2 sample(glm::vec2 const& position) const;
+
+        /* Divergence-free field: curl of a gradient noise made of period
+         * cells per tile, so that it tiles seamlessly. Its gradients rotate
+         * with time (flow noise), so that fields computed at close times
+         * blend smoothly. The largest vector has a norm of amplitude */
+        void computeCurlNoise(unsigned int period, float time, float amplitude,
+                              ThreadPool& threadPool);
+
+    private:
+        unsigned int _width;
+        unsigned int _height;
+        glm::vec2 _origin;
+        glm::vec2 _size;
+        std::vector<glm::vec2> _values;
+};
+
+#endif // VECTORFIELD_HPP_INCLUDED
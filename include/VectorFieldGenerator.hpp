@@ -0,0 +1,60 @@
+#ifndef VECTORFIELDGENERATOR_HPP_INCLUDED
+#define VECTORFIELDGENERATOR_HPP_INCLUDED
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "ThreadPool.hpp"
+#include "VectorField.hpp"
+
+
+/* Computes vector fields on a background thread, with its own thread
+ * pool, so that the simulation keeps running meanwhile. Two fields are
+ * swapped between the generator and the caller: the one being computed,
+ * and the last one handed out. */
+class VectorFieldGenerator
+{
+    public:
+        /* Fills the field, already sized by the caller of start() */
+        typedef std::function<void(VectorField&, ThreadPool&)> Task;
+
+    public:
+        /* 0 means one thread per hardware core */
+        explicit VectorFieldGenerator(unsigned int nbThreads=0);
+
+        /* Waits for the current task */
+        ~VectorFieldGenerator();
+
+        /* Starts computing a width x height field covering the given
+         * rectangle, unless a computation is already running or its
+         * result hasn't been retrieved: returns false then */
+        bool start(unsigned int width, unsigned int height,
+                   glm::vec2 const& origin, glm::vec2 const& size,
+                   Task const& task);
+
+        /* Never blocks. If a field is ready, swaps it with field
+         * and returns true */
+        bool poll(VectorField& field);
+
+    private:
+        VectorFieldGenerator(VectorFieldGenerator const&);
+        VectorFieldGenerator& operator=(VectorFieldGenerator const&);
+
+        void run();
+
+    private:
+        ThreadPool _threadPool;
+
+        std::mutex _mutex;
+        std::condition_variable _taskAvailable;
+        Task _task; //empty when idle
+        bool _ready; //_field holds a result not retrieved yet
+        bool _stopping;
+        VectorField _field;
+
+        std::thread _thread; //last, started once the other members are initialized
+};
+
+#endif // VECTORFIELDGENERATOR_HPP_INCLUDED
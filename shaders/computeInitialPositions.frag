@@ -2,6 +2,7 @@
 
 
 uniform vec2 bufferSize;
+uniform vec2 layoutCenter;
 
 
 __UTILS.GLSL__
@@ -9,6 +10,6 @@ __UTILS.GLSL__
 
 void main()
 {
-    gl_FragColor = coordsToColor(vec2(1.0,-1.0)*(gl_FragCoord.xy - bufferSize/2.0),
+    gl_FragColor = coordsToColor(vec2(1.0,-1.0)*(gl_FragCoord.xy - bufferSize/2.0) + layoutCenter,
                                  MAX_POSITION);
 }
@@ -0,0 +1,23 @@
+#version 130
+
+
+/* Transform feedback version of computeInitialPositions.frag and
+   computeInitialVelocities.frag: one vertex per particle, no attribute */
+
+uniform ivec2 bufferSize;
+uniform vec2 layoutCenter;
+
+out vec2 newPosition;
+out vec2 newVelocity;
+
+
+void main()
+{
+    vec2 coordsOnBuffer = vec2(gl_VertexID % bufferSize.x, gl_VertexID / bufferSize.x) + vec2(0.5);
+
+    newPosition = vec2(1.0,-1.0) * (coordsOnBuffer - vec2(bufferSize)/2.0) + layoutCenter;
+    newVelocity = vec2(0.0);
+
+    //required by GLSL 1.30, discarded before rasterization
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+}
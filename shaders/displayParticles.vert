@@ -4,8 +4,26 @@
 uniform sampler2D positions;
 uniform mat3 viewMatrix;
 
+#ifdef INTERPOLATION
+/* Positions at the previous step, and where to draw between the two (0 to 1) */
+uniform sampler2D previousPositions;
+uniform float interpolation;
+#endif
+
+#if defined(VERTEX_ID_ADDRESSING) || defined(COLOR_TEXTURE)
+/* The particle's texel is derived from its index */
+uniform int bufferWidth;
+#endif
+
+#ifndef VERTEX_ID_ADDRESSING
 attribute vec2 coordsOnBuffer;
+#endif
+
+#ifdef COLOR_TEXTURE
+uniform sampler2D colors;
+#else
 attribute vec4 color;
+#endif
 
 out vec4 fragColor;
 
@@ -15,9 +33,31 @@ __UTILS.GLSL__
 
 void main()
 {
-    vec2 pos2D = colorToCoords(texture2D(positions, coordsOnBuffer), MAX_POSITION);
+#if defined(VERTEX_ID_ADDRESSING) || defined(COLOR_TEXTURE)
+    ivec2 texel = ivec2(gl_VertexID % bufferWidth, gl_VertexID / bufferWidth);
+#endif
+
+#ifdef VERTEX_ID_ADDRESSING
+    vec4 encodedPosition = texelFetch(positions, texel, 0);
+#else
+    vec4 encodedPosition = texture2D(positions, coordsOnBuffer);
+#endif
+    vec2 pos2D = colorToCoords(encodedPosition, MAX_POSITION);
+
+#ifdef INTERPOLATION
+#ifdef VERTEX_ID_ADDRESSING
+    vec4 encodedPreviousPosition = texelFetch(previousPositions, texel, 0);
+#else
+    vec4 encodedPreviousPosition = texture2D(previousPositions, coordsOnBuffer);
+#endif
+    pos2D = mix(colorToCoords(encodedPreviousPosition, MAX_POSITION), pos2D, interpolation);
+#endif
 
     gl_Position = vec4(viewMatrix * vec3(pos2D, 1.0), 1.0);
 
+#ifdef COLOR_TEXTURE
+    fragColor = texelFetch(colors, texel, 0);
+#else
     fragColor = color;
+#endif
 }
@@ -0,0 +1,40 @@
+#version 130
+
+
+uniform mat3 viewMatrix;
+
+attribute vec2 position;
+
+#ifdef INTERPOLATION
+/* Position at the previous step, and where to draw between the two (0 to 1) */
+attribute vec2 previousPosition;
+uniform float interpolation;
+#endif
+
+#ifdef COLOR_TEXTURE
+/* The particle's texel is derived from its index */
+uniform int bufferWidth;
+uniform sampler2D colors;
+#else
+attribute vec4 color;
+#endif
+
+out vec4 fragColor;
+
+
+void main()
+{
+#ifdef INTERPOLATION
+    vec2 pos2D = mix(previousPosition, position, interpolation);
+#else
+    vec2 pos2D = position;
+#endif
+    gl_Position = vec4(viewMatrix * vec3(pos2D, 1.0), 1.0);
+
+#ifdef COLOR_TEXTURE
+    ivec2 texel = ivec2(gl_VertexID % bufferWidth, gl_VertexID / bufferWidth);
+    fragColor = texelFetch(colors, texel, 0);
+#else
+    fragColor = color;
+#endif
+}
@@ -0,0 +1,14 @@
+#version 130
+
+
+/* Corners of a triangle covering the whole viewport, without any vertex
+   attribute: (-1,-1), (3,-1) and (-1,3) for vertices 0, 1 and 2 */
+
+
+void main()
+{
+    vec2 corner = vec2(float((gl_VertexID & 1) * 4 - 1),
+                       float((gl_VertexID & 2) * 2 - 1));
+
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
@@ -0,0 +1,43 @@
+#extension GL_ARB_uniform_buffer_object : enable
+
+/* Per-step parameters of the GPU simulation paths, written at once
+   by Particles::updateParameters. The std140 layout must match
+   Particles::ParametersBlock. Must be included right after #version.
+
+   Uniform blocks are core in OpenGL 3.1, whose drivers needn't list
+   the ARB extension: it is enabled where available, not required.
+
+   ATTRACTOR_SLOTS, the size of the attractors array, is defined by
+   Particles. With UNROLL_ATTRACTORS, every slot is processed (unused
+   ones are out of range) so that the loop has a constant count. */
+
+
+struct Attractor
+{
+    vec2 position;
+    float strength; //negative for a repulsor
+    float squaredRadius; //0 for an unused slot
+    int falloff; //exponent of the distance: 0, 1 or 2
+};
+
+layout(std140) uniform Parameters
+{
+    vec2 bufferSize;
+
+    float dt;
+    float maxSpeed;
+    float friction; //already raised to the power dt
+    int nbAttractors;
+
+    vec2 vectorFieldOrigin;
+    vec2 vectorFieldScale; //inverse of the size of a tile
+
+    float neighbourRadius; //also the size of the cells of spatialGrid.glsl
+    float separation;
+    float cohesion;
+    float alignment;
+    int maxNeighbours;
+    uint nbBuckets; //power of two
+
+    Attractor attractors[ATTRACTOR_SLOTS];
+};
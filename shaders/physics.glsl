@@ -0,0 +1,71 @@
+/* Physics shared by all the GPU simulation paths.
+   The CPU backend (CPUSimulation.cpp) mirrors these functions.
+   Reads the Parameters uniform block of parameters.glsl */
+
+
+#ifdef VECTOR_FIELD
+/* Acceleration field tiling the plane (GL_LINEAR, GL_REPEAT) */
+uniform sampler2D vectorField;
+#endif
+
+
+/* Sum of the accelerations toward each attractor in range,
+   proportionnal to strength / distance^falloff, and of the vector field */
+vec2 getAcceleration(const vec2 position)
+{
+#ifdef VECTOR_FIELD
+    vec2 acceleration = textureLod(vectorField, (position - vectorFieldOrigin) * vectorFieldScale, 0.0).xy;
+#else
+    vec2 acceleration = vec2(0.0);
+#endif
+
+#ifdef UNROLL_ATTRACTORS
+    for (int i = 0 ; i < ATTRACTOR_SLOTS ; ++i) {
+#else
+    for (int i = 0 ; i < nbAttractors ; ++i) {
+#endif
+        vec2 toAttractor = attractors[i].position - position;
+        float squaredDistance = dot(toAttractor, toAttractor);
+
+        float denominator = squaredDistance;
+        if (attractors[i].falloff == 0)
+            denominator = sqrt(squaredDistance);
+        else if (attractors[i].falloff == 2)
+            denominator *= sqrt(squaredDistance);
+
+        //unused slots may give NaN, discarded by the selection
+        vec2 contribution = attractors[i].strength * toAttractor / denominator;
+        acceleration += (squaredDistance < attractors[i].squaredRadius) ? contribution : vec2(0.0);
+    }
+
+    return acceleration;
+}
+
+/* Speed cannot be greater than maxSpeed */
+vec2 clampSpeed(const vec2 velocity)
+{
+    return velocity * min(1.0, maxSpeed/length(velocity));
+}
+
+/* One step of dt. The scheme is chosen by prefixing one of
+   INTEGRATOR_VERLET or INTEGRATOR_RK2, semi-implicit Euler otherwise.
+   Friction is applied once, to the final velocity */
+void integrate(inout vec2 position, inout vec2 velocity)
+{
+#if defined(INTEGRATOR_VERLET)
+    //velocity Verlet: half kick, drift, half kick at the new position
+    velocity = clampSpeed(velocity + 0.5*dt * getAcceleration(position));
+    position = position + dt * velocity;
+    velocity = clampSpeed(velocity + 0.5*dt * getAcceleration(position)) * friction;
+#elif defined(INTEGRATOR_RK2)
+    //midpoint method: derivatives evaluated at the middle of the step
+    vec2 middlePosition = position + 0.5*dt * velocity;
+    vec2 middleVelocity = clampSpeed(velocity + 0.5*dt * getAcceleration(position));
+    velocity = clampSpeed(velocity + dt * getAcceleration(middlePosition)) * friction;
+    position = position + dt * middleVelocity;
+#else
+    //semi-implicit Euler: the new velocity moves the particle
+    velocity = clampSpeed(velocity + dt * getAcceleration(position)) * friction;
+    position = position + dt * velocity;
+#endif
+}
@@ -0,0 +1,17 @@
+/* Uniform grid of cells of neighbourRadius, hashed into nbBuckets
+   buckets. Same hash as SpatialGrid.cpp.
+   Reads the Parameters uniform block of parameters.glsl */
+
+
+ivec2 getCell(const vec2 position)
+{
+    return ivec2(floor(position / neighbourRadius));
+}
+
+/* The table is a grid of nbBuckets cells repeated over the plane */
+uint getBucket(const ivec2 cell)
+{
+    uint widthBits = uint(findMSB(nbBuckets) + 1) / 2u;
+    uvec2 wrappedCell = uvec2(cell) & uvec2((1u << widthBits) - 1u, (nbBuckets >> widthBits) - 1u);
+    return (wrappedCell.y << widthBits) | wrappedCell.x;
+}
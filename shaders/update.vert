@@ -1,11 +1,28 @@
 #version 130
 
+
+/* Transform feedback: each vertex is a particle, whose new state is
+   captured into the other buffer of a ping-pong pair.
+   Nothing is rasterized. */
+
+__PARAMETERS.GLSL__
+
 attribute vec2 position;
+attribute vec2 velocity;
+
+out vec2 newPosition;
+out vec2 newVelocity;
+
+
+__PHYSICS.GLSL__
 
-out vec2 persoPos;
 
 void main()
 {
-    persoPos = position;
-    gl_Position = vec4(position, 0.0, 1.0);
+    newPosition = position;
+    newVelocity = velocity;
+    integrate(newPosition, newVelocity);
+
+    //required by GLSL 1.30, discarded before rasterization
+    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
 }
@@ -1,15 +1,16 @@
 #version 130
 
+__PARAMETERS.GLSL__
+
 
 uniform sampler2D oldPositions;
 uniform sampler2D velocities;
-
-uniform vec2 bufferSize;
-
-uniform float dt;
+uniform sampler2D oldVelocities;
 
 __UTILS.GLSL__
 
+__PHYSICS.GLSL__
+
 
 void main()
 {
@@ -18,8 +19,18 @@ void main()
     /* Retrieving of position and velocity from texture buffers */
     vec2 position = colorToCoords(texture2D(oldPositions, coordsOnBuffer),
                                   MAX_POSITION);
+
+#if defined(INTEGRATOR_VERLET) || defined(INTEGRATOR_RK2)
+    /* The position depends on intermediate velocities that aren't stored:
+       the whole step is computed again from the old state */
+    vec2 velocity = colorToCoords(texture2D(oldVelocities, coordsOnBuffer),
+                                  MAX_SPEED);
+    integrate(position, velocity);
+#else
     vec2 velocity = colorToCoords(texture2D(velocities, coordsOnBuffer),
                                   MAX_SPEED);
+    position = position + dt*velocity;
+#endif
 
-    gl_FragColor = coordsToColor(position + dt*velocity, MAX_POSITION);
+    gl_FragColor = coordsToColor(position, MAX_POSITION);
 }
@@ -0,0 +1,32 @@
+#version 130
+
+
+/* Fused version of updateVelocity.frag and updatePosition.frag:
+   both are written at once, to two color attachments */
+
+__PARAMETERS.GLSL__
+
+
+uniform sampler2D oldPositions;
+uniform sampler2D oldVelocities;
+
+__UTILS.GLSL__
+
+__PHYSICS.GLSL__
+
+
+void main()
+{
+    vec2 coordsOnBuffer = gl_FragCoord.xy / bufferSize;
+
+    /* Retrieving of position and velocity from texture buffers */
+    vec2 position = colorToCoords(texture2D(oldPositions, coordsOnBuffer),
+                                  MAX_POSITION);
+    vec2 velocity = colorToCoords(texture2D(oldVelocities, coordsOnBuffer),
+                                  MAX_SPEED);
+
+    integrate(position, velocity);
+
+    gl_FragData[0] = coordsToColor(velocity, MAX_SPEED);
+    gl_FragData[1] = coordsToColor(position, MAX_POSITION);
+}
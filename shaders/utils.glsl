@@ -11,6 +11,10 @@
 
     To store a float value, we scale it to fit in [0, 65535],
     then project it on the base 256.
+
+    When FLOAT_STORAGE is defined, the textures have floating-point
+    channels (RG16F or RG32F): values are stored as is, without range
+    nor encoding.
 */
 
 
@@ -18,6 +22,21 @@ const float MAX_SPEED = 32.0;
 const float MAX_POSITION = 4096.0;
 
 
+#ifdef FLOAT_STORAGE
+
+/* Raw coordinates in the red and green channels */
+vec4 coordsToColor(const vec2 coords, const float zoneWidth)
+{
+    return vec4(coords, 0.0, 0.0);
+}
+
+vec2 colorToCoords(const vec4 color, const float zoneWidth)
+{
+    return color.rg;
+}
+
+#else
+
 /* Converts value stored in two color channels
    to float value in [0, 65535] */
 float fromBase256 (const vec2 digits)
@@ -56,3 +75,5 @@ vec2 colorToCoords(const vec4 color, const float zoneWidth)
     
     return (scaledCoords / 65535.0 - vec2(0.5)) * zoneWidth;
 }
+
+#endif // FLOAT_STORAGE
@@ -0,0 +1,294 @@
+#include "BarnesHutTree.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Tracer.hpp"
+
+
+namespace
+{
+    /* Particles sorted by a thread at once. Each block has its own
+     * histogram of the digits of the radix sort */
+    const std::size_t SORT_BLOCK = 16384;
+
+    const unsigned int RADIX_BITS = 8;
+    const std::uint32_t RADIX = 1u << RADIX_BITS;
+
+    /* Particles and nodes processed by a thread at once */
+    const std::size_t PARTICLES_GRANULARITY = 1024;
+    const std::size_t NODES_GRANULARITY = 256;
+
+    /* Nodes waiting to be visited by getAcceleration(): each visit of a
+     * node of the deepest levels replaces it by 4 children at most */
+    const unsigned int STACK_SIZE = 4 * BarnesHutTree::MAX_DEPTH;
+
+    /* Bits of a 16 bits integer spread to the even bits */
+    inline std::uint32_t spreadBits(std::uint32_t value)
+    {
+        value = (value | (value << 8)) & 0x00ff00ffu;
+        value = (value | (value << 4)) & 0x0f0f0f0fu;
+        value = (value | (value << 2)) & 0x33333333u;
+        value = (value | (value << 1)) & 0x55555555u;
+        return value;
+    }
+}
+
+
+BarnesHutTree::BarnesHutTree(std::size_t nbParticles, ThreadPool& threadPool):
+            _nbParticles (nbParticles),
+            _threadPool (threadPool),
+            _origin (0.f, 0.f),
+            _size (1.f),
+            _codes (nbParticles),
+            _sortedIndices (nbParticles),
+            _temporaryCodes (nbParticles),
+            _temporaryIndices (nbParticles),
+            _digitOffsets (RADIX * ((nbParticles + SORT_BLOCK - 1) / SORT_BLOCK)),
+            _sortedPositionsX (nbParticles),
+            _sortedPositionsY (nbParticles)
+{
+}
+
+void BarnesHutTree::build(float const* positionsX, float const* positionsY)
+{
+    TRACE_ZONE("Barnes-Hut tree");
+    computeBounds(positionsX, positionsY);
+    computeMortonCodes(positionsX, positionsY);
+    sortByMortonCode();
+
+    _threadPool.parallelFor(_nbParticles, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin ; k < end ; ++k) {
+            _sortedPositionsX[k] = positionsX[_sortedIndices[k]];
+            _sortedPositionsY[k] = positionsY[_sortedIndices[k]];
+        }
+    }, PARTICLES_GRANULARITY);
+
+    buildNodes();
+    computeCentersOfMass();
+}
+
+std::vector<std::uint32_t> const& BarnesHutTree::getSortedIndices() const
+{
+    return _sortedIndices;
+}
+
+void BarnesHutTree::computeBounds(float const* positionsX, float const* positionsY)
+{
+    const std::size_t nbBlocks = (_nbParticles + SORT_BLOCK - 1) / SORT_BLOCK;
+    std::vector<glm::vec2> minima(nbBlocks), maxima(nbBlocks);
+    _threadPool.parallelFor(nbBlocks, [&](std::size_t beginBlock, std::size_t endBlock) {
+        for (std::size_t block = beginBlock ; block < endBlock ; ++block) {
+            std::size_t end = std::min((block + 1) * SORT_BLOCK, _nbParticles);
+            glm::vec2 minimum(positionsX[block * SORT_BLOCK], positionsY[block * SORT_BLOCK]);
+            glm::vec2 maximum = minimum;
+            for (std::size_t i = block * SORT_BLOCK ; i < end ; ++i) {
+                minimum = glm::min(minimum, glm::vec2(positionsX[i], positionsY[i]));
+                maximum = glm::max(maximum, glm::vec2(positionsX[i], positionsY[i]));
+            }
+            minima[block] = minimum;
+            maxima[block] = maximum;
+        }
+    });
+
+    glm::vec2 minimum(0.f, 0.f), maximum(0.f, 0.f);
+    for (std::size_t block = 0 ; block < nbBlocks ; ++block) {
+        minimum = (block == 0) ? minima[0] : glm::min(minimum, minima[block]);
+        maximum = (block == 0) ? maxima[0] : glm::max(maximum, maxima[block]);
+    }
+
+    /* Slightly larger, so that the maximum is inside */
+    _origin = minimum;
+    _size = std::max(1.f, 1.001f * std::max(maximum.x - minimum.x, maximum.y - minimum.y));
+}
+
+void BarnesHutTree::computeMortonCodes(float const* positionsX, float const* positionsY)
+{
+    const float scale = static_cast<float>(1u << MAX_DEPTH) / _size;
+    const float maxCell = static_cast<float>((1u << MAX_DEPTH) - 1);
+    _threadPool.parallelFor(_nbParticles, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; ++i) {
+            float x = std::min(std::max(0.f, (positionsX[i] - _origin.x) * scale), maxCell);
+            float y = std::min(std::max(0.f, (positionsY[i] - _origin.y) * scale), maxCell);
+            _codes[i] = (spreadBits(static_cast<std::uint32_t>(y)) << 1) | spreadBits(static_cast<std::uint32_t>(x));
+            _sortedIndices[i] = i;
+        }
+    }, PARTICLES_GRANULARITY);
+}
+
+void BarnesHutTree::sortByMortonCode()
+{
+    /* Least significant digit first. Each pass is stable, so particles of
+     * the same code stay sorted by index whatever the number of threads */
+    const std::size_t nbBlocks = (_nbParticles + SORT_BLOCK - 1) / SORT_BLOCK;
+    for (unsigned int shift = 0 ; shift < 32 ; shift += RADIX_BITS) {
+        std::swap(_codes, _temporaryCodes);
+        std::swap(_sortedIndices, _temporaryIndices);
+
+        _threadPool.parallelFor(nbBlocks, [&](std::size_t beginBlock, std::size_t endBlock) {
+            for (std::size_t block = beginBlock ; block < endBlock ; ++block) {
+                std::uint32_t* counts = &_digitOffsets[block * RADIX];
+                std::fill(counts, counts + RADIX, 0u);
+                std::size_t end = std::min((block + 1) * SORT_BLOCK, _nbParticles);
+                for (std::size_t i = block * SORT_BLOCK ; i < end ; ++i)
+                    ++counts[(_temporaryCodes[i] >> shift) & (RADIX - 1)];
+            }
+        });
+
+        /* Digit by digit, then block by block */
+        std::uint32_t offset = 0;
+        for (std::uint32_t digit = 0 ; digit < RADIX ; ++digit) {
+            for (std::size_t block = 0 ; block < nbBlocks ; ++block) {
+                std::uint32_t count = _digitOffsets[block * RADIX + digit];
+                _digitOffsets[block * RADIX + digit] = offset;
+                offset += count;
+            }
+        }
+
+        _threadPool.parallelFor(nbBlocks, [&](std::size_t beginBlock, std::size_t endBlock) {
+            for (std::size_t block = beginBlock ; block < endBlock ; ++block) {
+                std::uint32_t* offsets = &_digitOffsets[block * RADIX];
+                std::size_t end = std::min((block + 1) * SORT_BLOCK, _nbParticles);
+                for (std::size_t i = block * SORT_BLOCK ; i < end ; ++i) {
+                    std::uint32_t destination = offsets[(_temporaryCodes[i] >> shift) & (RADIX - 1)]++;
+                    _codes[destination] = _temporaryCodes[i];
+                    _sortedIndices[destination] = _temporaryIndices[i];
+                }
+            }
+        });
+    }
+}
+
+void BarnesHutTree::buildNodes()
+{
+    Node root;
+    root.centerOfMass = glm::vec2(0.f, 0.f);
+    root.mass = 0.f;
+    root.size = _size;
+    root.begin = 0;
+    root.end = _nbParticles;
+    root.firstChild = 0;
+    root.nbChildren = 0;
+    _nodes.assign(1, root);
+    _levels.assign({0, 1});
+
+    for (unsigned int depth = 0 ; _levels[depth] < _levels[depth + 1] ; ++depth) {
+        const std::uint32_t levelBegin = _levels[depth];
+        const std::uint32_t nbLevelNodes = _levels[depth + 1] - levelBegin;
+        _childBounds.resize(5 * nbLevelNodes);
+
+        /* The particles of a node share the first 2*depth bits of their
+         * code, the quadrant of each one is given by the next two */
+        const unsigned int shift = 2 * (MAX_DEPTH - 1 - depth);
+        _threadPool.parallelFor(nbLevelNodes, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin ; k < end ; ++k) {
+                Node& node = _nodes[levelBegin + k];
+                node.nbChildren = 0;
+                if (depth == MAX_DEPTH || node.end - node.begin <= LEAF_SIZE)
+                    continue;
+
+                std::uint32_t prefix = (depth == 0) ? 0u : _codes[node.begin] & ~((1u << (shift + 2)) - 1u);
+                std::uint32_t* bounds = &_childBounds[5 * k];
+                bounds[0] = node.begin;
+                for (std::uint32_t quadrant = 1 ; quadrant < 4 ; ++quadrant) {
+                    bounds[quadrant] = std::lower_bound(_codes.begin() + bounds[quadrant - 1], _codes.begin() + node.end,
+                                                        prefix | (quadrant << shift)) - _codes.begin();
+                }
+                bounds[4] = node.end;
+                for (std::uint32_t quadrant = 0 ; quadrant < 4 ; ++quadrant)
+                    node.nbChildren += (bounds[quadrant] < bounds[quadrant + 1]) ? 1 : 0;
+            }
+        }, NODES_GRANULARITY);
+
+        std::uint32_t nbNodes = _nodes.size();
+        for (std::uint32_t k = 0 ; k < nbLevelNodes ; ++k) {
+            _nodes[levelBegin + k].firstChild = nbNodes;
+            nbNodes += _nodes[levelBegin + k].nbChildren;
+        }
+        _nodes.resize(nbNodes);
+        _levels.push_back(nbNodes);
+
+        _threadPool.parallelFor(nbLevelNodes, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin ; k < end ; ++k) {
+                Node const& node = _nodes[levelBegin + k];
+                if (node.nbChildren == 0)
+                    continue;
+
+                std::uint32_t const* bounds = &_childBounds[5 * k];
+                std::uint32_t child = node.firstChild;
+                for (std::uint32_t quadrant = 0 ; quadrant < 4 ; ++quadrant) {
+                    if (bounds[quadrant] == bounds[quadrant + 1])
+                        continue;
+                    _nodes[child].size = 0.5f * node.size;
+                    _nodes[child].begin = bounds[quadrant];
+                    _nodes[child].end = bounds[quadrant + 1];
+                    ++child;
+                }
+            }
+        }, NODES_GRANULARITY);
+    }
+}
+
+void BarnesHutTree::computeCentersOfMass()
+{
+    for (std::size_t level = _levels.size() - 2 ; level-- > 0 ; ) {
+        _threadPool.parallelFor(_levels[level + 1] - _levels[level], [&](std::size_t begin, std::size_t end) {
+            for (std::size_t k = begin ; k < end ; ++k) {
+                Node& node = _nodes[_levels[level] + k];
+                glm::vec2 weightedSum(0.f, 0.f);
+                node.mass = 0.f;
+                if (node.nbChildren == 0) {
+                    for (std::uint32_t j = node.begin ; j < node.end ; ++j)
+                        weightedSum += glm::vec2(_sortedPositionsX[j], _sortedPositionsY[j]);
+                    node.mass = static_cast<float>(node.end - node.begin);
+                } else {
+                    for (std::uint32_t c = node.firstChild ; c < node.firstChild + node.nbChildren ; ++c) {
+                        weightedSum += _nodes[c].mass * _nodes[c].centerOfMass;
+                        node.mass += _nodes[c].mass;
+                    }
+                }
+                node.centerOfMass = (node.mass > 0.f) ? weightedSum / node.mass : weightedSum;
+            }
+        }, NODES_GRANULARITY);
+    }
+}
+
+glm::vec2 BarnesHutTree::getAcceleration(std::size_t sortedIndex, float openingAngle, float softening) const
+{
+    const glm::vec2 position(_sortedPositionsX[sortedIndex], _sortedPositionsY[sortedIndex]);
+    const float squaredSoftening = softening * softening;
+    const float squaredAngle = openingAngle * openingAngle;
+
+    glm::vec2 acceleration(0.f, 0.f);
+    std::uint32_t stack[STACK_SIZE];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        Node const& node = _nodes[stack[--stackSize]];
+        if (node.nbChildren == 0) {
+            for (std::uint32_t j = node.begin ; j < node.end ; ++j) {
+                glm::vec2 offset(_sortedPositionsX[j] - position.x, _sortedPositionsY[j] - position.y);
+                float squaredDistance = glm::dot(offset, offset) + squaredSoftening;
+                if (j != sortedIndex && squaredDistance > 0.f)
+                    acceleration += offset / (squaredDistance * std::sqrt(squaredDistance));
+            }
+            continue;
+        }
+
+        /* Past an angle of 1/sqrt(2), the center of mass of a node can be
+         * far enough from a particle of the node itself, which would then
+         * attract itself */
+        glm::vec2 offset = node.centerOfMass - position;
+        float squaredDistance = glm::dot(offset, offset);
+        bool containsParticle = (node.begin <= sortedIndex && sortedIndex < node.end);
+        if (!containsParticle && node.size * node.size < squaredAngle * squaredDistance) {
+            squaredDistance += squaredSoftening;
+            acceleration += node.mass * offset / (squaredDistance * std::sqrt(squaredDistance));
+        } else {
+            for (std::uint32_t c = 0 ; c < node.nbChildren ; ++c)
+                stack[stackSize++] = node.firstChild + c;
+        }
+    }
+    return acceleration;
+}
@@ -0,0 +1,659 @@
+#include "CPUSimulation.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include "Tracer.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define PARTICLES_X86_KERNELS
+    #include <immintrin.h>
+#endif
+
+
+namespace
+{
+    typedef CPUSimulation::Integrator Integrator;
+
+    typedef void (*UpdateKernel)(float*, float*, float*, float*,
+                                 std::size_t, std::size_t,
+                                 CPUSimulation::Parameters const&);
+
+    /* Attractors out of range are skipped by comparing squared distances */
+    inline float getSquaredRadius(CPUSimulation::Attractor const& attractor)
+    {
+        if (attractor.radius <= 0.f)
+            return std::numeric_limits<float>::max();
+        return attractor.radius * attractor.radius;
+    }
+
+    /* Sum of the accelerations toward each attractor, see physics.glsl */
+    inline void getAcceleration(float x, float y, CPUSimulation::Parameters const& p,
+                                float& accelerationX, float& accelerationY)
+    {
+        accelerationX = 0.f;
+        accelerationY = 0.f;
+        if (p.vectorField != nullptr) {
+            glm::vec2 field = p.vectorField->sample(glm::vec2(x, y));
+            accelerationX = field.x;
+            accelerationY = field.y;
+        }
+
+        for (CPUSimulation::Attractor const& attractor : p.attractors) {
+            float toAttractorX = attractor.position.x - x;
+            float toAttractorY = attractor.position.y - y;
+            float squaredDistance = toAttractorX*toAttractorX + toAttractorY*toAttractorY;
+            if (!(squaredDistance < getSquaredRadius(attractor)))
+                continue;
+
+            float denominator = squaredDistance;
+            if (attractor.falloff == 0)
+                denominator = std::sqrt(squaredDistance);
+            else if (attractor.falloff == 2)
+                denominator *= std::sqrt(squaredDistance);
+            accelerationX += attractor.strength * toAttractorX / denominator;
+            accelerationY += attractor.strength * toAttractorY / denominator;
+        }
+    }
+
+    /* Speed cannot be greater than maxSpeed, then friction is applied */
+    inline void limitSpeed(float& velocityX, float& velocityY, float maxSpeed, float friction)
+    {
+        float speed = std::sqrt(velocityX*velocityX + velocityY*velocityY);
+        float scale = std::min(1.f, maxSpeed / speed) * friction;
+        velocityX *= scale;
+        velocityY *= scale;
+    }
+
+    /* Reference implementation of the integrate() function of physics.glsl,
+     * also used for the remaining particles that don't fill a whole SIMD register */
+    template <Integrator I>
+    void updateScalar(float* px, float* py, float* vx, float* vy,
+                      std::size_t begin, std::size_t end,
+                      CPUSimulation::Parameters const& p)
+    {
+        const float halfDt = 0.5f * p.dt;
+
+        for (std::size_t i = begin ; i < end ; ++i) {
+            float positionX = px[i], positionY = py[i];
+            float velocityX = vx[i], velocityY = vy[i];
+            float accelerationX, accelerationY;
+
+            if (I == Integrator::SemiImplicitEuler) {
+                getAcceleration(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX += p.dt * accelerationX;
+                velocityY += p.dt * accelerationY;
+                limitSpeed(velocityX, velocityY, p.maxSpeed, p.friction);
+                positionX += p.dt * velocityX;
+                positionY += p.dt * velocityY;
+            } else if (I == Integrator::Verlet) {
+                getAcceleration(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX += halfDt * accelerationX;
+                velocityY += halfDt * accelerationY;
+                limitSpeed(velocityX, velocityY, p.maxSpeed, 1.f);
+                positionX += p.dt * velocityX;
+                positionY += p.dt * velocityY;
+                getAcceleration(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX += halfDt * accelerationX;
+                velocityY += halfDt * accelerationY;
+                limitSpeed(velocityX, velocityY, p.maxSpeed, p.friction);
+            } else {
+                getAcceleration(positionX, positionY, p, accelerationX, accelerationY);
+                float middleVelocityX = velocityX + halfDt * accelerationX;
+                float middleVelocityY = velocityY + halfDt * accelerationY;
+                limitSpeed(middleVelocityX, middleVelocityY, p.maxSpeed, 1.f);
+                getAcceleration(positionX + halfDt * velocityX, positionY + halfDt * velocityY, p,
+                                accelerationX, accelerationY);
+                velocityX += p.dt * accelerationX;
+                velocityY += p.dt * accelerationY;
+                limitSpeed(velocityX, velocityY, p.maxSpeed, p.friction);
+                positionX += p.dt * middleVelocityX;
+                positionY += p.dt * middleVelocityY;
+            }
+
+            px[i] = positionX;
+            py[i] = positionY;
+            vx[i] = velocityX;
+            vy[i] = velocityY;
+        }
+    }
+
+#ifdef PARTICLES_X86_KERNELS
+    /* Parameters broadcast to every lane */
+    struct SSEParameters
+    {
+        explicit SSEParameters(CPUSimulation::Parameters const& p):
+                    dt (_mm_set1_ps(p.dt)),
+                    halfDt (_mm_set1_ps(0.5f * p.dt)),
+                    maxSpeed (_mm_set1_ps(p.maxSpeed)),
+                    friction (_mm_set1_ps(p.friction)),
+                    one (_mm_set1_ps(1.f)),
+                    attractors (p.attractors),
+                    vectorField (p.vectorField)
+        {
+        }
+
+        __m128 dt, halfDt, maxSpeed, friction, one;
+        std::vector<CPUSimulation::Attractor> const& attractors;
+        VectorField const* vectorField;
+    };
+
+    /* Bilinear sampling has no SIMD counterpart (AVX2 gathers would
+     * still need 8 of them): each lane is sampled on its own */
+    template <std::size_t NB_LANES>
+    inline void sampleLanes(VectorField const& field, float const* x, float const* y,
+                            float* fieldX, float* fieldY)
+    {
+        for (std::size_t lane = 0 ; lane < NB_LANES ; ++lane) {
+            glm::vec2 value = field.sample(glm::vec2(x[lane], y[lane]));
+            fieldX[lane] = value.x;
+            fieldY[lane] = value.y;
+        }
+    }
+
+    inline void getAccelerationSSE(__m128 x, __m128 y, SSEParameters const& p,
+                                   __m128& accelerationX, __m128& accelerationY)
+    {
+        accelerationX = _mm_setzero_ps();
+        accelerationY = _mm_setzero_ps();
+        if (p.vectorField != nullptr) {
+            alignas(16) float lanesX[4], lanesY[4], fieldX[4], fieldY[4];
+            _mm_store_ps(lanesX, x);
+            _mm_store_ps(lanesY, y);
+            sampleLanes<4>(*p.vectorField, lanesX, lanesY, fieldX, fieldY);
+            accelerationX = _mm_load_ps(fieldX);
+            accelerationY = _mm_load_ps(fieldY);
+        }
+
+        for (CPUSimulation::Attractor const& attractor : p.attractors) {
+            __m128 toAttractorX = _mm_sub_ps(_mm_set1_ps(attractor.position.x), x);
+            __m128 toAttractorY = _mm_sub_ps(_mm_set1_ps(attractor.position.y), y);
+            __m128 squaredDistance = _mm_add_ps(_mm_mul_ps(toAttractorX, toAttractorX),
+                                                _mm_mul_ps(toAttractorY, toAttractorY));
+            __m128 inRange = _mm_cmplt_ps(squaredDistance, _mm_set1_ps(getSquaredRadius(attractor)));
+
+            __m128 denominator = squaredDistance;
+            if (attractor.falloff == 0)
+                denominator = _mm_sqrt_ps(squaredDistance);
+            else if (attractor.falloff == 2)
+                denominator = _mm_mul_ps(denominator, _mm_sqrt_ps(squaredDistance));
+            __m128 strength = _mm_set1_ps(attractor.strength);
+            accelerationX = _mm_add_ps(accelerationX, _mm_and_ps(inRange, _mm_div_ps(_mm_mul_ps(strength, toAttractorX), denominator)));
+            accelerationY = _mm_add_ps(accelerationY, _mm_and_ps(inRange, _mm_div_ps(_mm_mul_ps(strength, toAttractorY), denominator)));
+        }
+    }
+
+    inline void limitSpeedSSE(__m128& velocityX, __m128& velocityY, SSEParameters const& p, __m128 friction)
+    {
+        __m128 speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(velocityX, velocityX),
+                                              _mm_mul_ps(velocityY, velocityY)));
+        __m128 scale = _mm_mul_ps(_mm_min_ps(p.one, _mm_div_ps(p.maxSpeed, speed)), friction);
+        velocityX = _mm_mul_ps(velocityX, scale);
+        velocityY = _mm_mul_ps(velocityY, scale);
+    }
+
+    template <Integrator I>
+    void updateSSE(float* px, float* py, float* vx, float* vy,
+                   std::size_t begin, std::size_t end,
+                   CPUSimulation::Parameters const& parameters)
+    {
+        const SSEParameters p(parameters);
+
+        std::size_t i = begin;
+        for ( ; i + 4 <= end ; i += 4) {
+            __m128 positionX = _mm_loadu_ps(px + i);
+            __m128 positionY = _mm_loadu_ps(py + i);
+            __m128 velocityX = _mm_loadu_ps(vx + i);
+            __m128 velocityY = _mm_loadu_ps(vy + i);
+            __m128 accelerationX, accelerationY;
+
+            if (I == Integrator::SemiImplicitEuler) {
+                getAccelerationSSE(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX = _mm_add_ps(velocityX, _mm_mul_ps(p.dt, accelerationX));
+                velocityY = _mm_add_ps(velocityY, _mm_mul_ps(p.dt, accelerationY));
+                limitSpeedSSE(velocityX, velocityY, p, p.friction);
+                positionX = _mm_add_ps(positionX, _mm_mul_ps(p.dt, velocityX));
+                positionY = _mm_add_ps(positionY, _mm_mul_ps(p.dt, velocityY));
+            } else if (I == Integrator::Verlet) {
+                getAccelerationSSE(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX = _mm_add_ps(velocityX, _mm_mul_ps(p.halfDt, accelerationX));
+                velocityY = _mm_add_ps(velocityY, _mm_mul_ps(p.halfDt, accelerationY));
+                limitSpeedSSE(velocityX, velocityY, p, p.one);
+                positionX = _mm_add_ps(positionX, _mm_mul_ps(p.dt, velocityX));
+                positionY = _mm_add_ps(positionY, _mm_mul_ps(p.dt, velocityY));
+                getAccelerationSSE(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX = _mm_add_ps(velocityX, _mm_mul_ps(p.halfDt, accelerationX));
+                velocityY = _mm_add_ps(velocityY, _mm_mul_ps(p.halfDt, accelerationY));
+                limitSpeedSSE(velocityX, velocityY, p, p.friction);
+            } else {
+                getAccelerationSSE(positionX, positionY, p, accelerationX, accelerationY);
+                __m128 middleVelocityX = _mm_add_ps(velocityX, _mm_mul_ps(p.halfDt, accelerationX));
+                __m128 middleVelocityY = _mm_add_ps(velocityY, _mm_mul_ps(p.halfDt, accelerationY));
+                limitSpeedSSE(middleVelocityX, middleVelocityY, p, p.one);
+                getAccelerationSSE(_mm_add_ps(positionX, _mm_mul_ps(p.halfDt, velocityX)),
+                                   _mm_add_ps(positionY, _mm_mul_ps(p.halfDt, velocityY)),
+                                   p, accelerationX, accelerationY);
+                velocityX = _mm_add_ps(velocityX, _mm_mul_ps(p.dt, accelerationX));
+                velocityY = _mm_add_ps(velocityY, _mm_mul_ps(p.dt, accelerationY));
+                limitSpeedSSE(velocityX, velocityY, p, p.friction);
+                positionX = _mm_add_ps(positionX, _mm_mul_ps(p.dt, middleVelocityX));
+                positionY = _mm_add_ps(positionY, _mm_mul_ps(p.dt, middleVelocityY));
+            }
+
+            _mm_storeu_ps(px + i, positionX);
+            _mm_storeu_ps(py + i, positionY);
+            _mm_storeu_ps(vx + i, velocityX);
+            _mm_storeu_ps(vy + i, velocityY);
+        }
+
+        updateScalar<I>(px, py, vx, vy, i, end, parameters);
+    }
+
+    struct AVX2Parameters
+    {
+        __attribute__((target("avx2")))
+        explicit AVX2Parameters(CPUSimulation::Parameters const& p):
+                    dt (_mm256_set1_ps(p.dt)),
+                    halfDt (_mm256_set1_ps(0.5f * p.dt)),
+                    maxSpeed (_mm256_set1_ps(p.maxSpeed)),
+                    friction (_mm256_set1_ps(p.friction)),
+                    one (_mm256_set1_ps(1.f)),
+                    attractors (p.attractors),
+                    vectorField (p.vectorField)
+        {
+        }
+
+        __m256 dt, halfDt, maxSpeed, friction, one;
+        std::vector<CPUSimulation::Attractor> const& attractors;
+        VectorField const* vectorField;
+    };
+
+    __attribute__((target("avx2")))
+    inline void getAccelerationAVX2(__m256 x, __m256 y, AVX2Parameters const& p,
+                                    __m256& accelerationX, __m256& accelerationY)
+    {
+        accelerationX = _mm256_setzero_ps();
+        accelerationY = _mm256_setzero_ps();
+        if (p.vectorField != nullptr) {
+            alignas(32) float lanesX[8], lanesY[8], fieldX[8], fieldY[8];
+            _mm256_store_ps(lanesX, x);
+            _mm256_store_ps(lanesY, y);
+            sampleLanes<8>(*p.vectorField, lanesX, lanesY, fieldX, fieldY);
+            accelerationX = _mm256_load_ps(fieldX);
+            accelerationY = _mm256_load_ps(fieldY);
+        }
+
+        for (CPUSimulation::Attractor const& attractor : p.attractors) {
+            __m256 toAttractorX = _mm256_sub_ps(_mm256_set1_ps(attractor.position.x), x);
+            __m256 toAttractorY = _mm256_sub_ps(_mm256_set1_ps(attractor.position.y), y);
+            __m256 squaredDistance = _mm256_add_ps(_mm256_mul_ps(toAttractorX, toAttractorX),
+                                                   _mm256_mul_ps(toAttractorY, toAttractorY));
+            __m256 inRange = _mm256_cmp_ps(squaredDistance, _mm256_set1_ps(getSquaredRadius(attractor)), _CMP_LT_OQ);
+
+            __m256 denominator = squaredDistance;
+            if (attractor.falloff == 0)
+                denominator = _mm256_sqrt_ps(squaredDistance);
+            else if (attractor.falloff == 2)
+                denominator = _mm256_mul_ps(denominator, _mm256_sqrt_ps(squaredDistance));
+            __m256 strength = _mm256_set1_ps(attractor.strength);
+            accelerationX = _mm256_add_ps(accelerationX, _mm256_and_ps(inRange, _mm256_div_ps(_mm256_mul_ps(strength, toAttractorX), denominator)));
+            accelerationY = _mm256_add_ps(accelerationY, _mm256_and_ps(inRange, _mm256_div_ps(_mm256_mul_ps(strength, toAttractorY), denominator)));
+        }
+    }
+
+    __attribute__((target("avx2")))
+    inline void limitSpeedAVX2(__m256& velocityX, __m256& velocityY, AVX2Parameters const& p, __m256 friction)
+    {
+        __m256 speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(velocityX, velocityX),
+                                                    _mm256_mul_ps(velocityY, velocityY)));
+        __m256 scale = _mm256_mul_ps(_mm256_min_ps(p.one, _mm256_div_ps(p.maxSpeed, speed)), friction);
+        velocityX = _mm256_mul_ps(velocityX, scale);
+        velocityY = _mm256_mul_ps(velocityY, scale);
+    }
+
+    template <Integrator I>
+    __attribute__((target("avx2")))
+    void updateAVX2(float* px, float* py, float* vx, float* vy,
+                    std::size_t begin, std::size_t end,
+                    CPUSimulation::Parameters const& parameters)
+    {
+        const AVX2Parameters p(parameters);
+
+        std::size_t i = begin;
+        for ( ; i + 8 <= end ; i += 8) {
+            __m256 positionX = _mm256_loadu_ps(px + i);
+            __m256 positionY = _mm256_loadu_ps(py + i);
+            __m256 velocityX = _mm256_loadu_ps(vx + i);
+            __m256 velocityY = _mm256_loadu_ps(vy + i);
+            __m256 accelerationX, accelerationY;
+
+            if (I == Integrator::SemiImplicitEuler) {
+                getAccelerationAVX2(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX = _mm256_add_ps(velocityX, _mm256_mul_ps(p.dt, accelerationX));
+                velocityY = _mm256_add_ps(velocityY, _mm256_mul_ps(p.dt, accelerationY));
+                limitSpeedAVX2(velocityX, velocityY, p, p.friction);
+                positionX = _mm256_add_ps(positionX, _mm256_mul_ps(p.dt, velocityX));
+                positionY = _mm256_add_ps(positionY, _mm256_mul_ps(p.dt, velocityY));
+            } else if (I == Integrator::Verlet) {
+                getAccelerationAVX2(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX = _mm256_add_ps(velocityX, _mm256_mul_ps(p.halfDt, accelerationX));
+                velocityY = _mm256_add_ps(velocityY, _mm256_mul_ps(p.halfDt, accelerationY));
+                limitSpeedAVX2(velocityX, velocityY, p, p.one);
+                positionX = _mm256_add_ps(positionX, _mm256_mul_ps(p.dt, velocityX));
+                positionY = _mm256_add_ps(positionY, _mm256_mul_ps(p.dt, velocityY));
+                getAccelerationAVX2(positionX, positionY, p, accelerationX, accelerationY);
+                velocityX = _mm256_add_ps(velocityX, _mm256_mul_ps(p.halfDt, accelerationX));
+                velocityY = _mm256_add_ps(velocityY, _mm256_mul_ps(p.halfDt, accelerationY));
+                limitSpeedAVX2(velocityX, velocityY, p, p.friction);
+            } else {
+                getAccelerationAVX2(positionX, positionY, p, accelerationX, accelerationY);
+                __m256 middleVelocityX = _mm256_add_ps(velocityX, _mm256_mul_ps(p.halfDt, accelerationX));
+                __m256 middleVelocityY = _mm256_add_ps(velocityY, _mm256_mul_ps(p.halfDt, accelerationY));
+                limitSpeedAVX2(middleVelocityX, middleVelocityY, p, p.one);
+                getAccelerationAVX2(_mm256_add_ps(positionX, _mm256_mul_ps(p.halfDt, velocityX)),
+                                    _mm256_add_ps(positionY, _mm256_mul_ps(p.halfDt, velocityY)),
+                                    p, accelerationX, accelerationY);
+                velocityX = _mm256_add_ps(velocityX, _mm256_mul_ps(p.dt, accelerationX));
+                velocityY = _mm256_add_ps(velocityY, _mm256_mul_ps(p.dt, accelerationY));
+                limitSpeedAVX2(velocityX, velocityY, p, p.friction);
+                positionX = _mm256_add_ps(positionX, _mm256_mul_ps(p.dt, middleVelocityX));
+                positionY = _mm256_add_ps(positionY, _mm256_mul_ps(p.dt, middleVelocityY));
+            }
+
+            _mm256_storeu_ps(px + i, positionX);
+            _mm256_storeu_ps(py + i, positionY);
+            _mm256_storeu_ps(vx + i, velocityX);
+            _mm256_storeu_ps(vy + i, velocityY);
+        }
+
+        updateSSE<I>(px, py, vx, vy, i, end, parameters);
+    }
+#endif // PARTICLES_X86_KERNELS
+
+    enum class InstructionSet
+    {
+        Scalar,
+        SSE,
+        AVX2
+    };
+
+    /* The instruction set is detected once at runtime, so that the same
+     * binary runs on machines without AVX2 */
+    InstructionSet detectInstructionSet()
+    {
+#ifdef PARTICLES_X86_KERNELS
+        if (__builtin_cpu_supports("avx2"))
+            return InstructionSet::AVX2;
+        return InstructionSet::SSE;
+#else
+        return InstructionSet::Scalar;
+#endif
+    }
+
+    InstructionSet const instructionSet = detectInstructionSet();
+
+    template <Integrator I>
+    UpdateKernel selectUpdateKernel()
+    {
+#ifdef PARTICLES_X86_KERNELS
+        if (instructionSet == InstructionSet::AVX2)
+            return &updateAVX2<I>;
+        return &updateSSE<I>;
+#else
+        return &updateScalar<I>;
+#endif
+    }
+
+    UpdateKernel getUpdateKernel(Integrator integrator)
+    {
+        switch (integrator) {
+            case Integrator::Verlet:
+                return selectUpdateKernel<Integrator::Verlet>();
+            case Integrator::RK2:
+                return selectUpdateKernel<Integrator::RK2>();
+            case Integrator::SemiImplicitEuler:
+                break;
+        }
+        return selectUpdateKernel<Integrator::SemiImplicitEuler>();
+    }
+
+    /* Particles processed by a thread at once, multiple of the SIMD width */
+    const std::size_t KERNEL_GRANULARITY = 1024;
+}
+
+
+CPUSimulation::CPUSimulation(unsigned int width, unsigned int height,
+                             ThreadPool& threadPool, Integrator integrator,
+                             glm::vec2 const& layoutCenter):
+            _width (width),
+            _height (height),
+            _integrator (integrator),
+            _layoutCenter (layoutCenter),
+            _threadPool (threadPool),
+            _positionsX (width * height),
+            _positionsY (width * height),
+            _velocitiesX (width * height),
+            _velocitiesY (width * height),
+            _previousPositionsX (width * height),
+            _previousPositionsY (width * height)
+{
+    initialize();
+}
+
+unsigned int CPUSimulation::getNbParticles() const
+{
+    return _width * _height;
+}
+
+CPUSimulation::Integrator CPUSimulation::getIntegrator() const
+{
+    return _integrator;
+}
+
+const char* CPUSimulation::getInstructionSet()
+{
+    switch (instructionSet) {
+        case InstructionSet::AVX2:
+            return "AVX2";
+        case InstructionSet::SSE:
+            return "SSE";
+        case InstructionSet::Scalar:
+            break;
+    }
+    return "scalar";
+}
+
+void CPUSimulation::initialize()
+{
+    _threadPool.parallelFor(_height, [this](std::size_t beginRow, std::size_t endRow) {
+        for (std::size_t y = beginRow ; y < endRow ; ++y) {
+            for (std::size_t x = 0 ; x < _width ; ++x) {
+                std::size_t i = y * _width + x;
+                /* Same as gl_FragCoord.xy - bufferSize/2, y axis inverted */
+                _positionsX[i] = static_cast<float>(x) + 0.5f - 0.5f * static_cast<float>(_width) + _layoutCenter.x;
+                _positionsY[i] = -(static_cast<float>(y) + 0.5f - 0.5f * static_cast<float>(_height)) + _layoutCenter.y;
+                _velocitiesX[i] = 0.f;
+                _velocitiesY[i] = 0.f;
+                _previousPositionsX[i] = _positionsX[i];
+                _previousPositionsY[i] = _positionsY[i];
+            }
+        }
+    });
+}
+
+void CPUSimulation::update(Parameters const& parameters, unsigned int nbSteps)
+{
+    if (nbSteps == 0)
+        return;
+
+    float* px = _positionsX.data();
+    float* py = _positionsY.data();
+    float* vx = _velocitiesX.data();
+    float* vy = _velocitiesY.data();
+    UpdateKernel updateKernel = getUpdateKernel(_integrator);
+
+    /* Each step needs the state of all the particles after the previous one */
+    if (parameters.neighbourForces != nullptr || parameters.gravity != nullptr) {
+        for (unsigned int step = 0 ; step < nbSteps ; ++step) {
+            if (parameters.neighbourForces != nullptr)
+                applyNeighbourForces(*parameters.neighbourForces, parameters.dt);
+            if (parameters.gravity != nullptr)
+                applyGravity(*parameters.gravity, parameters.dt);
+
+            bool lastStep = (step + 1 == nbSteps);
+            _threadPool.parallelFor(getNbParticles(), [&](std::size_t begin, std::size_t end) {
+                if (lastStep) {
+                    std::copy(px + begin, px + end, _previousPositionsX.begin() + begin);
+                    std::copy(py + begin, py + end, _previousPositionsY.begin() + begin);
+                }
+                updateKernel(px, py, vx, vy, begin, end, parameters);
+            }, KERNEL_GRANULARITY);
+        }
+        return;
+    }
+
+    /* Particles are independent: each block goes through all the steps
+     * while it is in the L1 cache, instead of streaming the whole
+     * state from memory once per step */
+    _threadPool.parallelFor(getNbParticles(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t blockBegin = begin ; blockBegin < end ; blockBegin += KERNEL_GRANULARITY) {
+            std::size_t blockEnd = std::min(blockBegin + KERNEL_GRANULARITY, end);
+            for (unsigned int step = 0 ; step < nbSteps ; ++step) {
+                if (step + 1 == nbSteps) {
+                    std::copy(px + blockBegin, px + blockEnd, _previousPositionsX.begin() + blockBegin);
+                    std::copy(py + blockBegin, py + blockEnd, _previousPositionsY.begin() + blockBegin);
+                }
+                updateKernel(px, py, vx, vy, blockBegin, blockEnd, parameters);
+            }
+        }
+    }, KERNEL_GRANULARITY);
+}
+
+void CPUSimulation::applyNeighbourForces(NeighbourForces const& forces, float dt)
+{
+    if (!_grid) {
+        _grid.reset(new SpatialGrid(getNbParticles(), _threadPool));
+        _sortedPositionsX.resize(getNbParticles());
+        _sortedPositionsY.resize(getNbParticles());
+        _sortedVelocitiesX.resize(getNbParticles());
+        _sortedVelocitiesY.resize(getNbParticles());
+    }
+    _grid->build(_positionsX.data(), _positionsY.data(), forces.radius);
+
+    std::vector<std::uint32_t> const& sortedIndices = _grid->getSortedIndices();
+    _threadPool.parallelFor(getNbParticles(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin ; k < end ; ++k) {
+            std::uint32_t i = sortedIndices[k];
+            _sortedPositionsX[k] = _positionsX[i];
+            _sortedPositionsY[k] = _positionsY[i];
+            _sortedVelocitiesX[k] = _velocitiesX[i];
+            _sortedVelocitiesY[k] = _velocitiesY[i];
+        }
+    }, KERNEL_GRANULARITY);
+
+    /* In the grid's order, so that consecutive particles read the same
+     * buckets. Only the sorted copies are read: writing the velocities
+     * doesn't change the forces of the other particles */
+    TRACE_ZONE("neighbour forces");
+    _threadPool.parallelFor(getNbParticles(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin ; k < end ; ++k) {
+            glm::vec2 acceleration = getNeighbourAcceleration(k, forces);
+            std::uint32_t i = sortedIndices[k];
+            _velocitiesX[i] += dt * acceleration.x;
+            _velocitiesY[i] += dt * acceleration.y;
+        }
+    }, KERNEL_GRANULARITY);
+}
+
+glm::vec2 CPUSimulation::getNeighbourAcceleration(std::size_t sortedIndex, NeighbourForces const& forces) const
+{
+    const glm::vec2 position(_sortedPositionsX[sortedIndex], _sortedPositionsY[sortedIndex]);
+    const glm::vec2 velocity(_sortedVelocitiesX[sortedIndex], _sortedVelocitiesY[sortedIndex]);
+    const float squaredRadius = forces.radius * forces.radius;
+    const float inverseRadius = 1.f / forces.radius;
+    const std::int32_t cellX = _grid->getCell(position.x), cellY = _grid->getCell(position.y);
+
+    glm::vec2 repulsion(0.f, 0.f), sumOfOffsets(0.f, 0.f), sumOfVelocities(0.f, 0.f);
+    unsigned int nbNeighbours = 0;
+
+    for (std::int32_t dy = -1 ; dy <= 1 ; ++dy) {
+        for (std::int32_t dx = -1 ; dx <= 1 ; ++dx) {
+            std::uint32_t bucket = _grid->getBucket(cellX + dx, cellY + dy);
+            std::uint32_t end = _grid->getBucketEnd(bucket);
+            for (std::uint32_t j = _grid->getBucketBegin(bucket) ; j < end && nbNeighbours < forces.maxNeighbours ; ++j) {
+                glm::vec2 offset(_sortedPositionsX[j] - position.x, _sortedPositionsY[j] - position.y);
+                float squaredDistance = glm::dot(offset, offset);
+                if (j == sortedIndex || !(squaredDistance < squaredRadius))
+                    continue;
+
+                ++nbNeighbours;
+                if (squaredDistance > 0.f)
+                    repulsion -= offset * (1.f / std::sqrt(squaredDistance) - inverseRadius);
+                sumOfOffsets += offset;
+                sumOfVelocities += glm::vec2(_sortedVelocitiesX[j], _sortedVelocitiesY[j]);
+            }
+        }
+    }
+
+    if (nbNeighbours == 0)
+        return glm::vec2(0.f, 0.f);
+
+    float inverseCount = 1.f / static_cast<float>(nbNeighbours);
+    return forces.separation * repulsion
+         + forces.cohesion * inverseCount * sumOfOffsets
+         + forces.alignment * (inverseCount * sumOfVelocities - velocity);
+}
+
+void CPUSimulation::applyGravity(Gravity const& gravity, float dt)
+{
+    if (!_tree)
+        _tree.reset(new BarnesHutTree(getNbParticles(), _threadPool));
+    _tree->build(_positionsX.data(), _positionsY.data());
+
+    /* In the tree's order, so that consecutive particles open the same
+     * nodes. Each particle has a mass of strength / nbParticles */
+    TRACE_ZONE("gravity");
+    const float scale = dt * gravity.strength / static_cast<float>(getNbParticles());
+    std::vector<std::uint32_t> const& sortedIndices = _tree->getSortedIndices();
+    _threadPool.parallelFor(getNbParticles(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin ; k < end ; ++k) {
+            glm::vec2 acceleration = _tree->getAcceleration(k, gravity.openingAngle, gravity.softening);
+            std::uint32_t i = sortedIndices[k];
+            _velocitiesX[i] += scale * acceleration.x;
+            _velocitiesY[i] += scale * acceleration.y;
+        }
+    }, KERNEL_GRANULARITY);
+}
+
+void CPUSimulation::saveState(float* destination) const
+{
+    std::array<std::vector<float> const*, STATE_ARRAYS> arrays = {{&_positionsX, &_positionsY, &_velocitiesX, &_velocitiesY,
+                                                                   &_previousPositionsX, &_previousPositionsY}};
+    _threadPool.parallelFor(STATE_ARRAYS, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; ++i)
+            std::copy(arrays[i]->begin(), arrays[i]->end(), destination + i * getNbParticles());
+    });
+}
+
+void CPUSimulation::loadState(float const* source)
+{
+    std::array<std::vector<float>*, STATE_ARRAYS> arrays = {{&_positionsX, &_positionsY, &_velocitiesX, &_velocitiesY,
+                                                             &_previousPositionsX, &_previousPositionsY}};
+    _threadPool.parallelFor(STATE_ARRAYS, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; ++i)
+            std::copy(source + i * getNbParticles(), source + (i + 1) * getNbParticles(), arrays[i]->begin());
+    });
+}
+
+void CPUSimulation::copyPositions(glm::vec2* destination, float interpolation) const
+{
+    _threadPool.parallelFor(getNbParticles(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; ++i) {
+            glm::vec2 previous(_previousPositionsX[i], _previousPositionsY[i]);
+            glm::vec2 current(_positionsX[i], _positionsY[i]);
+            destination[i] = (1.f - interpolation) * previous + interpolation * current;
+        }
+    }, KERNEL_GRANULARITY);
+}
@@ -0,0 +1,148 @@
+#include "CheckpointFile.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Tracer.hpp"
+
+
+namespace
+{
+    const char MAGIC[8] = {'P', 'A', 'R', 'T', 'C', 'K', 'P', 'T'};
+
+    /* At the beginning of the file, little endian */
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t nbChunks;
+        std::uint64_t chunkOffsets[CheckpointFile::MAX_CHUNKS];
+        std::uint64_t chunkSizes[CheckpointFile::MAX_CHUNKS];
+    };
+
+    std::uint64_t alignChunk(std::uint64_t offset)
+    {
+        return (offset + CheckpointFile::CHUNK_ALIGNMENT - 1) / CheckpointFile::CHUNK_ALIGNMENT * CheckpointFile::CHUNK_ALIGNMENT;
+    }
+
+    /* Returns false if the whole buffer couldn't be written */
+    bool writeAll(int file, void const* data, std::size_t size)
+    {
+        char const* bytes = static_cast<char const*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(file, bytes, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            bytes += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+}
+
+
+void CheckpointFile::write(std::string const& path, std::vector<Chunk> const& chunks)
+{
+    TRACE_ZONE("write checkpoint");
+    if (chunks.size() > MAX_CHUNKS)
+        throw std::runtime_error("too many chunks in checkpoint " + path);
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.nbChunks = chunks.size();
+    std::uint64_t offset = sizeof(FileHeader);
+    for (std::size_t i = 0 ; i < chunks.size() ; ++i) {
+        header.chunkOffsets[i] = offset = alignChunk(offset);
+        header.chunkSizes[i] = chunks[i].size;
+        offset += chunks[i].size;
+    }
+
+    const std::string temporaryPath = path + ".tmp";
+    int file = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+        throw std::runtime_error("unable to open " + temporaryPath);
+
+    const std::vector<char> padding(CHUNK_ALIGNMENT, 0);
+    bool written = writeAll(file, &header, sizeof(header));
+    std::uint64_t end = sizeof(FileHeader);
+    for (std::size_t i = 0 ; written && i < chunks.size() ; ++i) {
+        written = writeAll(file, padding.data(), header.chunkOffsets[i] - end) &&
+                  writeAll(file, chunks[i].data, chunks[i].size);
+        end = header.chunkOffsets[i] + chunks[i].size;
+    }
+
+    /* On the disk before the rename, or a crash right after it could
+     * replace the previous checkpoint by an empty or partial file */
+    written = written && fsync(file) == 0;
+    written = (close(file) == 0) && written;
+    if (!written)
+        throw std::runtime_error("unable to write " + temporaryPath);
+
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("unable to replace " + path);
+}
+
+CheckpointFile::CheckpointFile(std::string const& path):
+            _mapping (nullptr),
+            _mappingSize (0)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        throw std::runtime_error("unable to open " + path);
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(FileHeader)) {
+        close(file);
+        throw std::runtime_error(path + " isn't a checkpoint");
+    }
+    _mappingSize = static_cast<std::size_t>(status.st_size);
+    _mapping = mmap(nullptr, _mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (_mapping == MAP_FAILED) {
+        _mapping = nullptr;
+        throw std::runtime_error("unable to map " + path);
+    }
+
+    FileHeader header;
+    std::memcpy(&header, _mapping, sizeof(header));
+    bool valid = (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.nbChunks <= MAX_CHUNKS);
+    for (std::uint32_t i = 0 ; valid && i < header.nbChunks ; ++i) {
+        valid = (header.chunkOffsets[i] <= _mappingSize && header.chunkSizes[i] <= _mappingSize - header.chunkOffsets[i]);
+        _chunks.push_back({static_cast<char const*>(_mapping) + header.chunkOffsets[i],
+                           static_cast<std::size_t>(header.chunkSizes[i])});
+    }
+
+    std::string error;
+    if (!valid)
+        error = path + " isn't a checkpoint, or is truncated";
+    else if (header.version != VERSION)
+        error = path + " is a checkpoint of version " + std::to_string(header.version)
+                + ", version " + std::to_string(VERSION) + " expected";
+    if (!error.empty()) {
+        munmap(_mapping, _mappingSize);
+        _mapping = nullptr;
+        throw std::runtime_error(error);
+    }
+}
+
+CheckpointFile::~CheckpointFile()
+{
+    if (_mapping != nullptr)
+        munmap(_mapping, _mappingSize);
+}
+
+std::vector<CheckpointFile::Chunk> const& CheckpointFile::getChunks() const
+{
+    return _chunks;
+}
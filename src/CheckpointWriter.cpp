@@ -0,0 +1,100 @@
+#include "CheckpointWriter.hpp"
+
+#include <exception>
+#include <stdexcept>
+
+#include "Tracer.hpp"
+
+
+CheckpointWriter::CheckpointWriter():
+            _stopping (false),
+            _thread (&CheckpointWriter::run, this)
+{
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _taskDone.wait(lock, [this]() { return _path.empty(); });
+        _stopping = true;
+    }
+    _taskAvailable.notify_all();
+    _thread.join();
+}
+
+bool CheckpointWriter::start(std::string const& path, std::vector<CheckpointFile::Chunk> const& chunks)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_path.empty())
+            return false;
+
+        _path = path;
+        _chunks = chunks;
+        _error.clear();
+    }
+    _taskAvailable.notify_one();
+    return true;
+}
+
+bool CheckpointWriter::poll()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_path.empty())
+        return false;
+
+    throwError();
+    return true;
+}
+
+void CheckpointWriter::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _taskDone.wait(lock, [this]() { return _path.empty(); });
+    throwError();
+}
+
+void CheckpointWriter::throwError()
+{
+    if (_error.empty())
+        return;
+
+    std::string error;
+    error.swap(_error);
+    throw std::runtime_error(error);
+}
+
+void CheckpointWriter::run()
+{
+    TRACE_THREAD_NAME("checkpoint writer");
+
+    while (true) {
+        std::string path;
+        std::vector<CheckpointFile::Chunk> chunks;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _taskAvailable.wait(lock, [this]() { return _stopping || !_path.empty(); });
+            if (_stopping)
+                return;
+            path = _path;
+            chunks = _chunks;
+        }
+
+        /* The chunks are only read by this thread until _path is cleared */
+        std::string error;
+        try {
+            CheckpointFile::write(path, chunks);
+        } catch (std::exception const& e) {
+            error = e.what();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _path.clear();
+            _chunks.clear();
+            _error = error;
+        }
+        _taskDone.notify_all();
+    }
+}
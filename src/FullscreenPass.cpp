@@ -0,0 +1,40 @@
+#include "FullscreenPass.hpp"
+
+#include "GLCheck.hpp"
+
+
+FullscreenPass::FullscreenPass():
+            _vertexArrayID (0)
+{
+}
+
+FullscreenPass::~FullscreenPass()
+{
+    if (_vertexArrayID != 0)
+        GLCHECK(glDeleteVertexArrays(1, &_vertexArrayID));
+}
+
+void FullscreenPass::create()
+{
+    if (_vertexArrayID == 0)
+        GLCHECK(glGenVertexArrays(1, &_vertexArrayID));
+}
+
+void FullscreenPass::run(GLFramebuffer const& target,
+                         std::initializer_list<GLTexture const*> inputs) const
+{
+    GLFramebuffer::bind(&target);
+
+    unsigned int unit = 0;
+    for (GLTexture const* input : inputs)
+        GLTexture::bind(input, unit++);
+
+    /* Blending disabled, all four components replaced */
+    GLCHECK(glDisable(GL_BLEND));
+
+    GLCHECK(glBindVertexArray(_vertexArrayID));
+    GLCHECK(glDrawArrays(GL_TRIANGLES, 0, 3));
+    GLCHECK(glBindVertexArray(0));
+
+    GLFramebuffer::bind(nullptr);
+}
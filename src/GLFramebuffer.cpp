@@ -0,0 +1,60 @@
+#include "GLFramebuffer.hpp"
+
+#include <vector>
+
+#include "GLCheck.hpp"
+
+
+GLFramebuffer::GLFramebuffer():
+            _framebufferID (0),
+            _size (0, 0)
+{
+}
+
+GLFramebuffer::~GLFramebuffer()
+{
+    if (_framebufferID != 0)
+        GLCHECK(glDeleteFramebuffers(1, &_framebufferID));
+}
+
+bool GLFramebuffer::create(std::initializer_list<GLTexture const*> colorAttachments)
+{
+    if (_framebufferID == 0)
+        GLCHECK(glGenFramebuffers(1, &_framebufferID));
+    GLCHECK(glBindFramebuffer(GL_FRAMEBUFFER, _framebufferID));
+
+    std::vector<GLenum> drawBuffers;
+    for (GLTexture const* texture : colorAttachments) {
+        GLenum attachment = GL_COLOR_ATTACHMENT0 + drawBuffers.size();
+        GLCHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture->getNativeHandle(), 0));
+        drawBuffers.push_back(attachment);
+        _size = texture->getSize();
+    }
+    GLCHECK(glDrawBuffers(drawBuffers.size(), drawBuffers.data()));
+
+    GLenum status = 0;
+    GLCHECK(status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
+    GLCHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+
+    return status == GL_FRAMEBUFFER_COMPLETE;
+}
+
+GLuint GLFramebuffer::getNativeHandle() const
+{
+    return _framebufferID;
+}
+
+sf::Vector2u const& GLFramebuffer::getSize() const
+{
+    return _size;
+}
+
+void GLFramebuffer::bind(GLFramebuffer const* framebuffer)
+{
+    if (framebuffer != nullptr) {
+        GLCHECK(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer->getNativeHandle()));
+        GLCHECK(glViewport(0, 0, framebuffer->getSize().x, framebuffer->getSize().y));
+    } else {
+        GLCHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+}
@@ -0,0 +1,157 @@
+#include "GLProgram.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "GLCheck.hpp"
+#include "ProgramCache.hpp"
+
+
+namespace
+{
+    std::string getShaderLog(GLuint shaderID)
+    {
+        GLint logLength = 0;
+        GLCHECK(glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &logLength));
+        std::string log(std::max(logLength, 1), '\0');
+        GLCHECK(glGetShaderInfoLog(shaderID, log.size(), nullptr, &log[0]));
+        return log;
+    }
+
+    std::string getProgramLog(GLuint programID)
+    {
+        GLint logLength = 0;
+        GLCHECK(glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &logLength));
+        std::string log(std::max(logLength, 1), '\0');
+        GLCHECK(glGetProgramInfoLog(programID, log.size(), nullptr, &log[0]));
+        return log;
+    }
+}
+
+
+ProgramCache* GLProgram::_cache = nullptr;
+
+void GLProgram::setCache(ProgramCache* cache)
+{
+    _cache = cache;
+}
+
+GLProgram::GLProgram():
+            _programID (0)
+{
+}
+
+GLProgram::~GLProgram()
+{
+    if (_programID != 0)
+        GLCHECK(glDeleteProgram(_programID));
+}
+
+bool GLProgram::loadFromMemory(std::vector<Source> const& sources,
+                               std::vector<std::string> const& feedbackVaryings)
+{
+    if (_programID != 0) {
+        GLCHECK(glDeleteProgram(_programID));
+        _programID = 0;
+    }
+
+    std::uint64_t key = 0;
+    if (_cache != nullptr && _cache->isAvailable()) {
+        key = _cache->computeKey(sources, feedbackVaryings);
+        _programID = _cache->load(key);
+        if (_programID != 0)
+            return true;
+    }
+
+    GLuint programID = 0;
+    GLCHECK(programID = glCreateProgram());
+
+    bool success = true;
+    std::vector<GLuint> shaderIDs;
+    for (Source const& source : sources) {
+        GLuint shaderID = 0;
+        GLCHECK(shaderID = glCreateShader(source.first));
+        shaderIDs.push_back(shaderID);
+
+        const char* code = source.second.c_str();
+        GLCHECK(glShaderSource(shaderID, 1, &code, nullptr));
+        GLCHECK(glCompileShader(shaderID));
+
+        GLint compiled = GL_FALSE;
+        GLCHECK(glGetShaderiv(shaderID, GL_COMPILE_STATUS, &compiled));
+        if (compiled == GL_FALSE) {
+            std::cerr << "Failed to compile shader:" << std::endl << getShaderLog(shaderID) << std::endl;
+            success = false;
+            break;
+        }
+
+        GLCHECK(glAttachShader(programID, shaderID));
+    }
+
+    if (success) {
+        if (!feedbackVaryings.empty()) {
+            std::vector<const char*> varyings;
+            for (std::string const& varying : feedbackVaryings)
+                varyings.push_back(varying.c_str());
+            GLCHECK(glTransformFeedbackVaryings(programID, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS));
+        }
+
+        if (_cache != nullptr && _cache->isAvailable())
+            GLCHECK(glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        GLCHECK(glLinkProgram(programID));
+
+        GLint linked = GL_FALSE;
+        GLCHECK(glGetProgramiv(programID, GL_LINK_STATUS, &linked));
+        if (linked == GL_FALSE) {
+            std::cerr << "Failed to link program:" << std::endl << getProgramLog(programID) << std::endl;
+            success = false;
+        }
+    }
+
+    /* Shaders are no longer needed once the program is linked */
+    for (GLuint shaderID : shaderIDs)
+        GLCHECK(glDeleteShader(shaderID));
+
+    if (!success) {
+        GLCHECK(glDeleteProgram(programID));
+        return false;
+    }
+
+    if (_cache != nullptr && _cache->isAvailable())
+        _cache->store(key, programID);
+
+    _programID = programID;
+    return true;
+}
+
+GLuint GLProgram::getNativeHandle() const
+{
+    return _programID;
+}
+
+GLint GLProgram::getUniformLocation(std::string const& name) const
+{
+    GLint location = -1;
+    GLCHECK(location = glGetUniformLocation(_programID, name.c_str()));
+    return location;
+}
+
+GLint GLProgram::getAttributeLocation(std::string const& name) const
+{
+    GLint location = -1;
+    GLCHECK(location = glGetAttribLocation(_programID, name.c_str()));
+    return location;
+}
+
+void GLProgram::setUniformBlockBinding(std::string const& name, GLuint binding) const
+{
+    GLuint blockIndex = GL_INVALID_INDEX;
+    GLCHECK(blockIndex = glGetUniformBlockIndex(_programID, name.c_str()));
+    if (blockIndex != GL_INVALID_INDEX)
+        GLCHECK(glUniformBlockBinding(_programID, blockIndex, binding));
+}
+
+void GLProgram::bind(GLProgram const* program)
+{
+    GLCHECK(glUseProgram((program != nullptr) ? program->getNativeHandle() : 0));
+}
@@ -0,0 +1,72 @@
+#include "GLTexture.hpp"
+
+#include "GLCheck.hpp"
+
+
+GLTexture::GLTexture():
+            _textureID (0),
+            _size (0, 0)
+{
+}
+
+GLTexture::~GLTexture()
+{
+    if (_textureID != 0)
+        GLCHECK(glDeleteTextures(1, &_textureID));
+}
+
+bool GLTexture::create(unsigned int width, unsigned int height, GLenum internalFormat,
+                       GLenum format, GLenum type, const void* pixels)
+{
+    if (_textureID == 0)
+        GLCHECK(glGenTextures(1, &_textureID));
+
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, _textureID));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GLCHECK(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, pixels));
+
+    /* The allocation fails silently for too large textures */
+    GLint allocatedWidth = 0;
+    GLCHECK(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &allocatedWidth));
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
+
+    _size = sf::Vector2u(width, height);
+    return allocatedWidth == static_cast<GLint>(width);
+}
+
+void GLTexture::update(GLenum format, GLenum type, const void* pixels)
+{
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, _textureID));
+    GLCHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _size.x, _size.y, format, type, pixels));
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void GLTexture::setBilinearRepeat()
+{
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, _textureID));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+    GLCHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+GLuint GLTexture::getNativeHandle() const
+{
+    return _textureID;
+}
+
+sf::Vector2u const& GLTexture::getSize() const
+{
+    return _size;
+}
+
+void GLTexture::bind(GLTexture const* texture, unsigned int unit)
+{
+    GLCHECK(glActiveTexture(GL_TEXTURE0 + unit));
+    GLCHECK(glBindTexture(GL_TEXTURE_2D, (texture != nullptr) ? texture->getNativeHandle() : 0));
+    GLCHECK(glActiveTexture(GL_TEXTURE0));
+}
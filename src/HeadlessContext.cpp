@@ -0,0 +1,123 @@
+#include "HeadlessContext.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <GL/glew.h>
+#include <EGL/eglext.h>
+
+
+namespace
+{
+    bool hasExtension(const char* extensions, const char* name)
+    {
+        return extensions != nullptr && std::strstr(extensions, name) != nullptr;
+    }
+
+    /* Mesa's surfaceless platform needs neither X11 nor a GPU device,
+     * the default display is the fallback for other EGL implementations */
+    EGLDisplay getDisplay()
+    {
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+            if (getPlatformDisplay != nullptr)
+                return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+}
+
+
+HeadlessContext::HeadlessContext(int majorVersion, int minorVersion):
+            _display (EGL_NO_DISPLAY),
+            _surface (EGL_NO_SURFACE),
+            _context (EGL_NO_CONTEXT),
+            _majorVersion (0),
+            _minorVersion (0)
+{
+    _display = getDisplay();
+    if (_display == EGL_NO_DISPLAY || eglInitialize(_display, nullptr, nullptr) == EGL_FALSE)
+        throw std::runtime_error("unable to initialize EGL");
+
+    if (eglBindAPI(EGL_OPENGL_API) == EGL_FALSE) {
+        eglTerminate(_display);
+        throw std::runtime_error("EGL doesn't support desktop OpenGL");
+    }
+
+    /* Without any surface, framebuffer 0 is incomplete and every draw call
+     * fails while it is bound, even with GL_RASTERIZER_DISCARD (transform
+     * feedback). A 1x1 pbuffer makes it a valid, if useless, target */
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint nbConfigs = 0;
+    if (eglChooseConfig(_display, configAttributes, &config, 1, &nbConfigs) == EGL_FALSE || nbConfigs == 0) {
+        eglTerminate(_display);
+        throw std::runtime_error("no EGL config for desktop OpenGL");
+    }
+
+    const EGLint surfaceAttributes[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE
+    };
+    _surface = eglCreatePbufferSurface(_display, config, surfaceAttributes);
+    if (_surface == EGL_NO_SURFACE) {
+        eglTerminate(_display);
+        throw std::runtime_error("unable to create EGL pbuffer");
+    }
+
+    /* The shaders use compatibility features (gl_FragColor, default vertex array) */
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, majorVersion,
+        EGL_CONTEXT_MINOR_VERSION, minorVersion,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (_context == EGL_NO_CONTEXT)
+        _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, nullptr);
+    if (_context == EGL_NO_CONTEXT) {
+        eglDestroySurface(_display, _surface);
+        eglTerminate(_display);
+        throw std::runtime_error("unable to create EGL context");
+    }
+
+    if (eglMakeCurrent(_display, _surface, _surface, _context) == EGL_FALSE) {
+        eglDestroyContext(_display, _context);
+        eglDestroySurface(_display, _surface);
+        eglTerminate(_display);
+        throw std::runtime_error("unable to activate EGL context");
+    }
+
+    /* GL_MAJOR_VERSION is only known by OpenGL 3.0+ */
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    if (version == nullptr || std::sscanf(version, "%d.%d", &_majorVersion, &_minorVersion) != 2) {
+        _majorVersion = 0;
+        _minorVersion = 0;
+    }
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(_display, _context);
+    eglDestroySurface(_display, _surface);
+    eglTerminate(_display);
+}
+
+int HeadlessContext::getMajorVersion() const
+{
+    return _majorVersion;
+}
+
+int HeadlessContext::getMinorVersion() const
+{
+    return _minorVersion;
+}
@@ -0,0 +1,154 @@
+#include "InputLog.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+
+namespace
+{
+    const char MAGIC[8] = {'P', 'A', 'R', 'T', 'I', 'N', 'P', 'T'};
+
+    /* At the beginning of the file, little endian */
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t screenWidth;
+        std::uint32_t screenHeight;
+    };
+
+    /* First byte of each frame, followed by its duration in microseconds
+     * (int32), then by the fields flagged, in this order */
+    enum FrameFlags : std::uint8_t
+    {
+        MAGNET_ACTIVE = 1 << 0,
+        MAGNET_MOVED = 1 << 1, //2 floats
+        CAMERA_MOVED = 1 << 2, //2 floats
+        CAMERA_ZOOMED = 1 << 3, //1 float
+        RESIZED = 1 << 4, //2 uint32
+        REINITIALIZED = 1 << 5,
+        FORCE_MODEL_SWITCHED = 1 << 6
+    };
+
+    template<typename T>
+    void writeValue(std::ostream& stream, T value)
+    {
+        stream.write(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    /* Returns false, leaving value unchanged, past the end of the data */
+    template<typename T>
+    bool readValue(std::vector<char> const& data, std::size_t& offset, T& value)
+    {
+        if (data.size() - offset < sizeof(T))
+            return false;
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+}
+
+
+void InputLog::writeHeader(std::ostream& stream, sf::Vector2u const& screenSize)
+{
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.screenWidth = screenSize.x;
+    header.screenHeight = screenSize.y;
+    stream.write(reinterpret_cast<char const*>(&header), sizeof(header));
+}
+
+void InputLog::writeFrame(std::ostream& stream, Frame const& frame, Frame const& previous)
+{
+    std::uint8_t flags = 0;
+    if (frame.magnetActive)
+        flags |= MAGNET_ACTIVE;
+    if (frame.magnetPosition != previous.magnetPosition)
+        flags |= MAGNET_MOVED;
+    if (frame.cameraMovement != glm::vec2(0.f))
+        flags |= CAMERA_MOVED;
+    if (frame.cameraZoom != 1.f)
+        flags |= CAMERA_ZOOMED;
+    if (frame.screenSize != sf::Vector2u())
+        flags |= RESIZED;
+    if (frame.reinitialized)
+        flags |= REINITIALIZED;
+    if (frame.forceModelSwitched)
+        flags |= FORCE_MODEL_SWITCHED;
+
+    writeValue(stream, flags);
+    writeValue(stream, static_cast<std::int32_t>(frame.frameTime.asMicroseconds()));
+    if (flags & MAGNET_MOVED) {
+        writeValue(stream, frame.magnetPosition.x);
+        writeValue(stream, frame.magnetPosition.y);
+    }
+    if (flags & CAMERA_MOVED) {
+        writeValue(stream, frame.cameraMovement.x);
+        writeValue(stream, frame.cameraMovement.y);
+    }
+    if (flags & CAMERA_ZOOMED)
+        writeValue(stream, frame.cameraZoom);
+    if (flags & RESIZED) {
+        writeValue(stream, static_cast<std::uint32_t>(frame.screenSize.x));
+        writeValue(stream, static_cast<std::uint32_t>(frame.screenSize.y));
+    }
+}
+
+InputLog::InputLog(std::string const& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("unable to open " + path);
+    const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::size_t offset = 0;
+    FileHeader header;
+    if (!readValue(data, offset, header) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error(path + " isn't an input log");
+    if (header.version != VERSION)
+        throw std::runtime_error(path + " is an input log of version " + std::to_string(header.version)
+                                 + ", version " + std::to_string(VERSION) + " expected");
+    _screenSize = sf::Vector2u(header.screenWidth, header.screenHeight);
+
+    Frame previous;
+    while (offset < data.size()) {
+        Frame frame;
+        frame.magnetPosition = previous.magnetPosition;
+
+        std::uint8_t flags = 0;
+        std::int32_t frameTime = 0;
+        std::uint32_t width = 0, height = 0;
+        bool complete = readValue(data, offset, flags) && readValue(data, offset, frameTime);
+        if (complete && (flags & MAGNET_MOVED))
+            complete = readValue(data, offset, frame.magnetPosition.x) && readValue(data, offset, frame.magnetPosition.y);
+        if (complete && (flags & CAMERA_MOVED))
+            complete = readValue(data, offset, frame.cameraMovement.x) && readValue(data, offset, frame.cameraMovement.y);
+        if (complete && (flags & CAMERA_ZOOMED))
+            complete = readValue(data, offset, frame.cameraZoom);
+        if (complete && (flags & RESIZED))
+            complete = readValue(data, offset, width) && readValue(data, offset, height);
+        if (!complete)
+            break;
+
+        frame.frameTime = sf::microseconds(frameTime);
+        frame.magnetActive = (flags & MAGNET_ACTIVE);
+        frame.screenSize = sf::Vector2u(width, height);
+        frame.reinitialized = (flags & REINITIALIZED);
+        frame.forceModelSwitched = (flags & FORCE_MODEL_SWITCHED);
+        _frames.push_back(frame);
+        previous = frame;
+    }
+}
+
+sf::Vector2u const& InputLog::getScreenSize() const
+{
+    return _screenSize;
+}
+
+std::vector<InputLog::Frame> const& InputLog::getFrames() const
+{
+    return _frames;
+}
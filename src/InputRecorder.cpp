@@ -0,0 +1,31 @@
+#include "InputRecorder.hpp"
+
+#include <stdexcept>
+
+
+InputRecorder::InputRecorder(std::string const& path, sf::Vector2u const& screenSize):
+            _path (path),
+            _file (path, std::ios::binary | std::ios::trunc),
+            _nbFrames (0)
+{
+    if (!_file.is_open())
+        throw std::runtime_error("unable to open " + path);
+    InputLog::writeHeader(_file, screenSize);
+}
+
+void InputRecorder::record(InputLog::Frame const& frame)
+{
+    InputLog::writeFrame(_file, frame, _previous);
+    _previous = frame;
+    ++_nbFrames;
+
+    if (_nbFrames % FLUSH_INTERVAL == 0)
+        _file.flush();
+    if (!_file)
+        throw std::runtime_error("unable to write " + _path);
+}
+
+unsigned int InputRecorder::getNbFrames() const
+{
+    return _nbFrames;
+}
@@ -0,0 +1,70 @@
+#include "Options.hpp"
+
+#include <cstdlib>
+
+
+bool parseSettingsOption (std::string const& option,
+                          Particles::Settings& settings)
+{
+    if (option == "--backend=gpu") {
+        settings.backend = Particles::Backend::FragmentShaders;
+    } else if (option == "--backend=cpu") {
+        settings.backend = Particles::Backend::CPU;
+    } else if (option == "--backend=compute") {
+        settings.backend = Particles::Backend::ComputeShader;
+    } else if (option == "--backend=feedback") {
+        settings.backend = Particles::Backend::TransformFeedback;
+    } else if (option == "--storage=packed") {
+        settings.storage = Particles::Storage::Packed;
+    } else if (option == "--storage=float16") {
+        settings.storage = Particles::Storage::Float16;
+    } else if (option == "--storage=float32") {
+        settings.storage = Particles::Storage::Float32;
+    } else if (option == "--fused") {
+        settings.fusedUpdate = true;
+    } else if (option == "--vertex-id") {
+        settings.vertexIDAddressing = true;
+    } else if (option == "--color-texture") {
+        settings.colorsFromTexture = true;
+    } else if (option == "--curl-noise") {
+        settings.vectorField = true;
+    } else if (option == "--flocking") {
+        settings.neighbourForces = true;
+    } else if (option == "--emitters") {
+        settings.emitters = true;
+    } else if (option == "--force=attractors") {
+        settings.forceModel = Particles::ForceModel::Attractors;
+    } else if (option == "--force=gravity") {
+        settings.forceModel = Particles::ForceModel::Gravity;
+    } else if (option == "--integrator=euler") {
+        settings.integrator = Particles::Integrator::SemiImplicitEuler;
+    } else if (option == "--integrator=verlet") {
+        settings.integrator = Particles::Integrator::Verlet;
+    } else if (option == "--integrator=rk2") {
+        settings.integrator = Particles::Integrator::RK2;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* getSettingsUsage()
+{
+    return "[--backend=gpu|cpu|compute|feedback] [--storage=packed|float16|float32] [--fused] [--vertex-id] [--color-texture] [--integrator=euler|verlet|rk2] [--curl-noise] [--flocking] [--force=attractors|gravity] [--emitters]";
+}
+
+bool parsePositiveOption (std::string const& option,
+                          std::string const& name,
+                          int& value)
+{
+    std::string prefix = name + "=";
+    if (option.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+    int parsedValue = std::atoi(option.c_str() + prefix.size());
+    if (parsedValue <= 0)
+        return false;
+
+    value = parsedValue;
+    return true;
+}
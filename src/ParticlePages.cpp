@@ -0,0 +1,183 @@
+#include "ParticlePages.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include <GL/glew.h>
+
+#include "GLCheck.hpp"
+#include "Tracer.hpp"
+#include "Utilities.hpp"
+
+
+namespace
+{
+    /* Side of the square of positions that Storage::Packed can hold,
+     * centered on the origin (MAX_POSITION of utils.glsl) */
+    const unsigned int PACKED_POSITIONS_RANGE = 4096;
+
+    /* Beyond 1024 from the origin, half floats are a unit apart or more,
+     * the distance between neighbouring particles at rest */
+    const unsigned int FLOAT16_POSITIONS_RANGE = 2048;
+}
+
+
+ParticlePages::ParticlePages(TiledImage const& image, Particles::Settings const& settings,
+                             unsigned int pageSize):
+            _nbParticles (0)
+{
+    const sf::Vector2u size = image.getSize();
+    if (size.x == 0 || size.y == 0)
+        throw std::runtime_error("the picture is empty");
+
+    if (pageSize == 0) {
+        GLint maxTextureSize = 0;
+        GLCHECK(glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize));
+        pageSize = std::min(DEFAULT_PAGE_SIZE, static_cast<unsigned int>(std::max(maxTextureSize, 1)));
+    }
+
+    Particles::Settings pageSettings = settings;
+    const unsigned int side = std::max(size.x, size.y);
+    if ((pageSettings.storage == Particles::Storage::Packed && side > PACKED_POSITIONS_RANGE) ||
+        (pageSettings.storage == Particles::Storage::Float16 && side > FLOAT16_POSITIONS_RANGE)) {
+        std::cerr << "The picture is too large for the " << Particles::getStorageName(pageSettings.storage)
+                  << " storage, storing 32-bit floats instead" << std::endl;
+        pageSettings.storage = Particles::Storage::Float32;
+    }
+
+    /* The pages are updated one after the other, each one by all the threads */
+    if (pageSettings.backend == Particles::Backend::CPU)
+        _threadPool.reset(new ThreadPool());
+
+    /* Centers of the pages, with the whole picture centered on the origin
+     * and the y axis inverted, as in computeInitialPositions.frag */
+    sf::Image tile;
+    for (unsigned int y = 0 ; y < size.y ; y += pageSize) {
+        for (unsigned int x = 0 ; x < size.x ; x += pageSize) {
+            TRACE_ZONE("page");
+            image.readTile(sf::Vector2u(x, y), sf::Vector2u(pageSize, pageSize), tile);
+
+            glm::vec2 center(static_cast<float>(x) + 0.5f * static_cast<float>(tile.getSize().x) - 0.5f * static_cast<float>(size.x),
+                             -(static_cast<float>(y) + 0.5f * static_cast<float>(tile.getSize().y) - 0.5f * static_cast<float>(size.y)));
+            _pages.emplace_back(new Particles(tile, pageSettings, center, _threadPool.get()));
+            _nbParticles += _pages.back()->getNbParticles();
+        }
+    }
+}
+
+unsigned int ParticlePages::getNbPages() const
+{
+    return _pages.size();
+}
+
+Particles& ParticlePages::getPage(unsigned int index)
+{
+    return *_pages[index];
+}
+
+Particles const& ParticlePages::getPage(unsigned int index) const
+{
+    return *_pages[index];
+}
+
+unsigned int ParticlePages::getNbParticles() const
+{
+    return _nbParticles;
+}
+
+void ParticlePages::initialize()
+{
+    for (std::unique_ptr<Particles> const& page : _pages)
+        page->initialize();
+}
+
+void ParticlePages::setMagnetState(bool activation)
+{
+    for (std::unique_ptr<Particles> const& page : _pages)
+        page->setMagnetState(activation);
+}
+
+void ParticlePages::setMagnetPosition(sf::Vector2f const& position)
+{
+    for (std::unique_ptr<Particles> const& page : _pages)
+        page->setMagnetPosition(position);
+}
+
+void ParticlePages::setTimeStep(sf::Time const& step, unsigned int maxSubsteps)
+{
+    for (std::unique_ptr<Particles> const& page : _pages)
+        page->setTimeStep(step, maxSubsteps);
+}
+
+unsigned int ParticlePages::update(sf::Time const& frameTime)
+{
+    /* Same time step and accumulated time on every page */
+    unsigned int nbSteps = 0;
+    for (std::unique_ptr<Particles> const& page : _pages)
+        nbSteps = page->update(frameTime);
+    return nbSteps;
+}
+
+void ParticlePages::draw(sf::RenderWindow &window, Camera const& camera) const
+{
+    for (std::size_t i = 0 ; i < _pages.size() ; ++i)
+        _pages[i]->draw(window, camera, i == 0);
+}
+
+void ParticlePages::draw(GLFramebuffer const& target, Camera const& camera) const
+{
+    for (std::size_t i = 0 ; i < _pages.size() ; ++i)
+        _pages[i]->draw(target, camera, i == 0);
+}
+
+std::uint64_t ParticlePages::computeStateHash() const
+{
+    std::uint64_t hash = FNV_OFFSET_BASIS;
+    for (std::unique_ptr<Particles> const& page : _pages) {
+        const std::uint64_t pageHash = page->computeStateHash();
+        hash = hashBytes(&pageHash, sizeof(pageHash), hash);
+    }
+    return hash;
+}
+
+bool ParticlePages::saveCheckpoint(std::string const& path)
+{
+    /* Every page is checked first, so that none starts saving when
+     * another one can't */
+    if (isSavingCheckpoint())
+        return false;
+    for (std::unique_ptr<Particles> const& page : _pages) {
+        if (page->hasEmitters())
+            throw std::runtime_error("checkpoints aren't supported with emitters");
+    }
+
+    for (unsigned int i = 0 ; i < _pages.size() ; ++i)
+        _pages[i]->saveCheckpoint(getCheckpointPath(path, i));
+    return true;
+}
+
+bool ParticlePages::isSavingCheckpoint()
+{
+    bool saving = false;
+    for (std::unique_ptr<Particles> const& page : _pages)
+        saving = page->isSavingCheckpoint() || saving;
+    return saving;
+}
+
+void ParticlePages::finishCheckpoint()
+{
+    for (std::unique_ptr<Particles> const& page : _pages)
+        page->finishCheckpoint();
+}
+
+void ParticlePages::loadCheckpoint(std::string const& path)
+{
+    for (unsigned int i = 0 ; i < _pages.size() ; ++i)
+        _pages[i]->loadCheckpoint(getCheckpointPath(path, i));
+}
+
+std::string ParticlePages::getCheckpointPath(std::string const& path, unsigned int page) const
+{
+    return (_pages.size() == 1) ? path : path + "." + std::to_string(page);
+}
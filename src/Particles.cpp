@@ -2,107 +2,769 @@
 
 #include <cmath>
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <functional>
+#include <limits>
 
 #include <iostream>
 
 #include <SFML/Graphics/VertexArray.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 #include <SFML/Graphics/Image.hpp>
-#include <SFML/Graphics/RectangleShape.hpp>
 
+#include "CheckpointFile.hpp"
 #include "GLCheck.hpp"
+#include "Tracer.hpp"
 #include "Utilities.hpp"
 
-Particles::Particles(std::string const& imagePath):
+#ifdef __SSE__
+    #include <xmmintrin.h>
+#endif
+
+namespace
+{
+    /* Binding point of the buffer read by the Parameters block (parameters.glsl) */
+    const GLuint PARAMETERS_BINDING = 0;
+
+    /* Texture unit of the vector field, after the inputs of the passes */
+    const GLuint VECTOR_FIELD_UNIT = 3;
+
+    /* Shader storage bindings of the spatial grid, after the old and new
+     * states (see binParticles.comp, prefixSum.comp and sortParticles.comp) */
+    const GLuint BUCKET_STARTS_BINDING = 2;
+    const GLuint PARTICLE_BUCKETS_BINDING = 3;
+    const GLuint BLOCK_SUMS_BINDING = 4;
+    const GLuint SORTED_STATE_BINDING = 5;
+    const GLuint SORTED_INDICES_BINDING = 6;
+
+    /* Values scanned by a work group of prefixSum.comp */
+    const GLuint PREFIX_SUM_BLOCK = 1024;
+
+    /* Shader storage bindings of the emitters, after the spatial grid's
+     * (see emitParticles.comp and updateState.comp) */
+    const GLuint LIFE_BINDING = 7;
+    const GLuint DEAD_INDICES_BINDING = 8;
+    const GLuint EMISSION_COUNTERS_BINDING = 9;
+    const GLuint LIVE_INDICES_BINDING = 10;
+    const GLuint EMITTERS_BINDING = 11;
+
+    /* Duration of a step in the units of the shaders' dt */
+    const float SIMULATION_TIME_SCALE = 30.f;
+
+    /* Raw texels of the state textures, as copied by the checkpoints */
+    void getStateTexelFormat(Particles::Storage storage, GLenum& format, GLenum& type, std::size_t& texelSize)
+    {
+        if (storage == Particles::Storage::Packed) {
+            format = GL_RGBA;
+            type = GL_UNSIGNED_BYTE;
+            texelSize = 4;
+        } else {
+            format = GL_RG;
+            type = (storage == Particles::Storage::Float16) ? GL_HALF_FLOAT : GL_FLOAT;
+            texelSize = (storage == Particles::Storage::Float16) ? 4 : 8;
+        }
+    }
+
+    /* Copy of the state read by the CPU, left bound to target */
+    GLuint createReadbackBuffer(GLenum target, GLsizeiptr size)
+    {
+        GLuint bufferID = 0;
+        GLCHECK(glGenBuffers(1, &bufferID));
+        GLCHECK(glBindBuffer(target, bufferID));
+        GLCHECK(glBufferData(target, size, nullptr, GL_STREAM_READ));
+        return bufferID;
+    }
+
+    /* Of each wait of finishCheckpoint() for the copy of the state, in nanoseconds */
+    const GLuint64 CHECKPOINT_WAIT_TIMEOUT = 100000000;
+
+    GLuint createStorageBuffer(GLsizeiptr size)
+    {
+        GLuint bufferID = 0;
+        GLCHECK(glGenBuffers(1, &bufferID));
+        GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID));
+        GLCHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY));
+        GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+        return bufferID;
+    }
+
+    /* Sampler uniforms never change: the i-th one reads texture unit i */
+    void setSamplerUnits(GLProgram const& program, std::initializer_list<const char*> samplers)
+    {
+        GLProgram::bind(&program);
+        GLint unit = 0;
+        for (const char* sampler : samplers)
+            GLCHECK(glUniform1i(program.getUniformLocation(sampler), unit++));
+        GLProgram::bind(nullptr);
+    }
+
+    void setVectorFieldUnit(GLProgram const& program)
+    {
+        GLProgram::bind(&program);
+        GLCHECK(glUniform1i(program.getUniformLocation("vectorField"), VECTOR_FIELD_UNIT));
+        GLProgram::bind(nullptr);
+    }
+
+    /* Allocates a static vertex buffer and fills it through a mapping, the
+     * rows of the image in parallel: fillRows(mapping, beginRow, endRow).
+     * No copy is kept in RAM, and the driver has nothing left to copy */
+    GLuint createVertexBuffer(GLsizeiptr size, unsigned int nbRows, ThreadPool& threadPool,
+                              std::function<void(void*, std::size_t, std::size_t)> const& fillRows)
+    {
+        GLuint bufferID = 0;
+        GLCHECK(glGenBuffers(1, &bufferID));
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, bufferID));
+        GLCHECK(glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW));
+
+        void* mapping = nullptr;
+        GLCHECK(mapping = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (mapping == nullptr)
+            throw std::runtime_error("unable to map a vertex buffer");
+        threadPool.parallelFor(nbRows, [&](std::size_t beginRow, std::size_t endRow) {
+            fillRows(mapping, beginRow, endRow);
+        });
+
+        /* The content is lost if the buffer was corrupted meanwhile (mode switch) */
+        GLboolean intact = GL_FALSE;
+        GLCHECK(intact = glUnmapBuffer(GL_ARRAY_BUFFER));
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        if (intact == GL_FALSE)
+            throw std::runtime_error("vertex buffer corrupted while being filled");
+        return bufferID;
+    }
+
+    /* Centers of the texels of a row, with a multiplication instead of a
+     * division: the rounding can't move a center to the next texel */
+    void computeTexCoordsRow(glm::vec2* row, unsigned int width, float v, float inverseWidth)
+    {
+        unsigned int x = 0;
+#ifdef __SSE__
+        /* Two particles per register, the abscissas being exact integers */
+        const __m128 scale = _mm_setr_ps(inverseWidth, 0.f, inverseWidth, 0.f);
+        const __m128 offset = _mm_setr_ps(0.5f * inverseWidth, v, 0.5f * inverseWidth, v);
+        const __m128 two = _mm_setr_ps(2.f, 0.f, 2.f, 0.f);
+        __m128 abscissas = _mm_setr_ps(0.f, 0.f, 1.f, 0.f);
+        for ( ; x + 2 <= width ; x += 2) {
+            _mm_storeu_ps(&row[x].x, _mm_add_ps(_mm_mul_ps(abscissas, scale), offset));
+            abscissas = _mm_add_ps(abscissas, two);
+        }
+#endif
+        for ( ; x < width ; ++x)
+            row[x] = glm::vec2(static_cast<float>(x) * inverseWidth + 0.5f * inverseWidth, v);
+    }
+
+    sf::Image loadImage(std::string const& imagePath)
+    {
+        sf::Image image;
+        if (!image.loadFromFile(imagePath))
+            throw std::runtime_error("unable to open " + imagePath);
+        return image;
+    }
+}
+
+Particles::Settings::Settings(Backend backend, Storage storage, bool fusedUpdate,
+                              bool vertexIDAddressing, bool colorsFromTexture,
+                              Integrator integrator, unsigned int maxAttractors,
+                              bool vectorField, bool neighbourForces,
+                              ForceModel forceModel, bool emitters):
+            backend (backend),
+            storage (storage),
+            fusedUpdate (fusedUpdate),
+            vertexIDAddressing (vertexIDAddressing),
+            colorsFromTexture (colorsFromTexture),
+            integrator (integrator),
+            maxAttractors (maxAttractors),
+            vectorField (vectorField),
+            neighbourForces (neighbourForces),
+            forceModel (forceModel),
+            emitters (emitters)
+{
+}
+
+Particles::Particles(std::string const& imagePath, Settings const& settings):
+            Particles(loadImage(imagePath), settings)
+{
+}
+
+Particles::Particles(sf::Image const& image, Settings const& settings, glm::vec2 const& layoutCenter,
+                     ThreadPool* sharedThreadPool):
+            _backend (settings.backend),
+            _storage (settings.storage),
+            _fusedUpdate (settings.fusedUpdate),
+            _vertexIDAddressing (settings.vertexIDAddressing),
+            _colorsFromTexture (settings.colorsFromTexture),
+            _integrator (settings.integrator),
             _maxSpeed(10.f),
             _attraction (0.f),
             _friction (0.99f),
             _magnetPosition(sf::Vector2f(0.f, 0.f)),
+            _maxAttractors (settings.maxAttractors),
+            _nbAttractorSlots (settings.maxAttractors + 1),
+            _vectorField (settings.vectorField),
+            _currentVectorFieldIndex (0),
+            _vectorFieldOrigin (0.f, 0.f),
+            _vectorFieldScale (1.f, 1.f),
+            _neighbourForces (settings.neighbourForces),
+            _forceModel (settings.forceModel),
+            _emitters (settings.emitters),
+            _emissionSeed (0),
+            _layoutCenter (layoutCenter),
             _currentBufferIndex (0),
+            _timeStep (sf::seconds(1.f / 60.f)),
+            _maxSubsteps (4),
+            _accumulatedTime (sf::Time::Zero),
+            _interpolation (1.f),
+            _checkpointFence (nullptr),
+            _checkpointCopying (false),
+            _checkpointWriting (false),
             _colorBufferID(0),
-            _texCoordBufferID(0)
+            _texCoordBufferID(0),
+            _viewMatrixLocation(-1),
+            _locationAttributeID(-1),
+            _colorAttributeID(-1),
+            _interpolationLocation(-1),
+            _previousPositionAttributeID(-1),
+            _parametersBufferID(0),
+            _threadPool(nullptr),
+            _positionBufferID(0),
+            _stateBufferIDs({{0, 0}}),
+            _nbBuckets(SpatialGrid::getNbBuckets(image.getSize().x * image.getSize().y)),
+            _bucketStartsBufferID(0),
+            _particleBucketsBufferID(0),
+            _blockSumsBufferID(0),
+            _scanTotalBufferID(0),
+            _sortedStateBufferID(0),
+            _sortedIndicesBufferID(0),
+            _nbEmittersLocation(-1),
+            _nbEmittedLocation(-1),
+            _emissionSeedLocation(-1),
+            _lifeBufferID(0),
+            _deadIndicesBufferID(0),
+            _liveIndicesBufferID(0),
+            _emissionCountersBufferID(0),
+            _emittersBufferID(0),
+            _transformFeedbackBufferIDs({{0, 0}}),
+            _transformFeedbackPositionAttributeID(-1),
+            _transformFeedbackVelocityAttributeID(-1),
+            _transformFeedbackVertexArrayID(0)
 {
-    /* Loading of the image */
-    sf::Image image;
-    if (!image.loadFromFile(imagePath))
-        throw std::runtime_error("unable to open " + imagePath);
     _buffersSize = image.getSize();
 
+    if (_maxAttractors > MAX_ATTRACTORS)
+        throw std::runtime_error("at most " + std::to_string(MAX_ATTRACTORS) + " attractors are supported");
+
+    if (_backend == Backend::ComputeShader && !GLEW_VERSION_4_3) {
+        std::cerr << "Compute shaders require OpenGL 4.3, falling back to fragment shaders" << std::endl;
+        _backend = Backend::FragmentShaders;
+    }
+    _fusedUpdate = _fusedUpdate && (_backend == Backend::FragmentShaders);
+    _vertexIDAddressing = _vertexIDAddressing && (_backend == Backend::FragmentShaders);
+    if (_neighbourForces && _backend != Backend::CPU && _backend != Backend::ComputeShader) {
+        std::cerr << "Neighbour forces require the CPU or compute shader backend, disabling them" << std::endl;
+        _neighbourForces = false;
+    }
+    if (_emitters && _backend != Backend::ComputeShader) {
+        std::cerr << "Emitters require the compute shader backend, disabling them" << std::endl;
+        _emitters = false;
+    }
+    if (_emitters && _neighbourForces) {
+        std::cerr << "Neighbour forces aren't supported with emitters, disabling them" << std::endl;
+        _neighbourForces = false;
+    }
+
+    /* Particles a few pixels apart, as in the image, slightly repel each other */
+    _neighbourParameters.radius = 3.f;
+    _neighbourParameters.separation = 1.f;
+    _neighbourParameters.cohesion = 0.02f;
+    _neighbourParameters.alignment = 0.05f;
+    _neighbourParameters.maxNeighbours = 32;
+
+    if (_forceModel == ForceModel::Gravity && _backend != Backend::CPU) {
+        std::cerr << "Gravity requires the CPU backend, disabling it" << std::endl;
+        _forceModel = ForceModel::Attractors;
+    }
+
+    /* A few pixels/s^2 at the edges of a 512x512 picture, which
+     * collapses in a few tens of seconds, the speed being limited */
+    _gravity.strength = 200000.f;
+    _gravity.openingAngle = 0.5f;
+    _gravity.softening = 2.f;
+
+    if (_backend != Backend::CPU && !GLEW_VERSION_3_1 && !GLEW_ARB_uniform_buffer_object)
+        throw std::runtime_error("the GPU backends require uniform buffer objects (OpenGL 3.1)");
+
     /* Allocation of buffers */
-    for (sf::RenderTexture &positionBuffer : _positions) {
-        if (!positionBuffer.create(getBuffersSize().x, getBuffersSize().y))
-            throw std::runtime_error("unable to create positions buffer");
+    if (_backend == Backend::FragmentShaders) {
+        /* Packed: each coordinate encoded in two RGBA8 channels */
+        GLenum internalFormat = GL_RGBA8, format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+        if (_storage != Storage::Packed) {
+            internalFormat = (_storage == Storage::Float16) ? GL_RG16F : GL_RG32F;
+            format = GL_RG;
+            type = GL_FLOAT;
+        }
+
+        for (unsigned int i = 0 ; i < 2 ; ++i) {
+            if (!_positions[i].create(getBuffersSize().x, getBuffersSize().y, internalFormat, format, type))
+                throw std::runtime_error("unable to create positions buffer");
+            if (!_velocities[i].create(getBuffersSize().x, getBuffersSize().y, internalFormat, format, type))
+                throw std::runtime_error("unable to create velocities buffer");
+
+            if (!_positionFramebuffers[i].create({&_positions[i]}) ||
+                !_velocityFramebuffers[i].create({&_velocities[i]}))
+                throw std::runtime_error("unable to create framebuffer");
+
+            /* Velocities on attachment 0, positions on attachment 1 */
+            if (_fusedUpdate && !_stateFramebuffers[i].create({&_velocities[i], &_positions[i]}))
+                throw std::runtime_error("unable to create fused update framebuffer");
+        }
+
+        _fullscreenPass.create();
+    } else if (_backend == Backend::CPU) {
+        if (sharedThreadPool == nullptr)
+            _ownThreadPool.reset(new ThreadPool());
+        _threadPool = sharedThreadPool ? sharedThreadPool : _ownThreadPool.get();
+        _cpuSimulation.reset(new CPUSimulation(getBuffersSize().x, getBuffersSize().y, *_threadPool,
+                                               _integrator, _layoutCenter));
+
+        GLCHECK(glGenBuffers(1, &_positionBufferID));
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _positionBufferID));
+        GLCHECK(glBufferData(GL_ARRAY_BUFFER, getNbParticles()*sizeof(glm::vec2), nullptr, GL_STREAM_DRAW));
+    } else if (_backend == Backend::ComputeShader) {
+        /* Position and velocity of each particle packed in a vec4 */
+        for (GLuint &bufferID : _stateBufferIDs) {
+            GLCHECK(glGenBuffers(1, &bufferID));
+            GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufferID));
+            GLCHECK(glBufferData(GL_SHADER_STORAGE_BUFFER, getNbParticles()*sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY));
+        }
+        GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+        /* The block sums are scanned as a whole block, zeros after the used ones */
+        if (_neighbourForces) {
+            _bucketStartsBufferID = createStorageBuffer(_nbBuckets*sizeof(GLuint));
+            _particleBucketsBufferID = createStorageBuffer(getNbParticles()*sizeof(glm::uvec2));
+            _blockSumsBufferID = createStorageBuffer(PREFIX_SUM_BLOCK*sizeof(GLuint));
+            _scanTotalBufferID = createStorageBuffer(sizeof(GLuint));
+            _sortedStateBufferID = createStorageBuffer(getNbParticles()*sizeof(glm::vec4));
+            _sortedIndicesBufferID = createStorageBuffer(getNbParticles()*sizeof(GLuint));
+
+            GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, _blockSumsBufferID));
+            GLCHECK(glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+            GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+        }
+
+        /* The slots are the whole memory budget of the emitters */
+        if (_emitters) {
+            _lifeBufferID = createStorageBuffer(getNbParticles()*sizeof(glm::vec2));
+            _deadIndicesBufferID = createStorageBuffer(getNbParticles()*sizeof(GLuint));
+            _liveIndicesBufferID = createStorageBuffer(getNbParticles()*sizeof(GLuint));
+            _emissionCountersBufferID = createStorageBuffer(sizeof(EmissionCounters));
+            _emittersBufferID = createStorageBuffer(MAX_EMITTERS*sizeof(EmitterBlock));
+        }
+    } else if (_backend == Backend::TransformFeedback) {
+        /* Position and velocity of each particle packed in a vec4 */
+        for (GLuint &bufferID : _transformFeedbackBufferIDs) {
+            GLCHECK(glGenBuffers(1, &bufferID));
+            GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, bufferID));
+            GLCHECK(glBufferData(GL_ARRAY_BUFFER, getNbParticles()*sizeof(glm::vec4), nullptr, GL_DYNAMIC_COPY));
+        }
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        GLCHECK(glGenVertexArrays(1, &_transformFeedbackVertexArrayID));
     }
-    for (sf::RenderTexture &velocityBuffer : _velocities) {
-        if (!velocityBuffer.create(getBuffersSize().x, getBuffersSize().y))
-            throw std::runtime_error("unable to create velocities buffer");
+
+    /* Per-step parameters of the GPU backends, rewritten at once every step */
+    if (_backend != Backend::CPU) {
+        GLCHECK(glGenBuffers(1, &_parametersBufferID));
+        GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, _parametersBufferID));
+        GLCHECK(glBufferData(GL_UNIFORM_BUFFER, sizeof(ParametersBlock), nullptr, GL_DYNAMIC_DRAW));
+        GLCHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+    }
+
+    /* Zero until setVectorField() is called */
+    if (_vectorField && _backend != Backend::CPU) {
+        const glm::vec2 zero(0.f, 0.f);
+        for (GLTexture &texture : _vectorFieldTextures) {
+            if (!texture.create(1, 1, GL_RG32F, GL_RG, GL_FLOAT, &zero))
+                throw std::runtime_error("unable to create vector field texture");
+            texture.setBilinearRepeat();
+        }
     }
 
     /* Loading of the shaders */
-    std::string fragmentShader, vertexShader, utils;
+    std::string fragmentShader, vertexShader, computeShader, utils, physics, parameters, spatialGrid;
     loadFile("shaders/utils.glsl", utils);
+    loadFile("shaders/physics.glsl", physics);
+    loadFile("shaders/parameters.glsl", parameters);
+    loadFile("shaders/spatialGrid.glsl", spatialGrid);
+    if (_backend == Backend::FragmentShaders && _storage != Storage::Packed)
+        utils = "#define FLOAT_STORAGE\n" + utils;
+    parameters = "#define ATTRACTOR_SLOTS " + std::to_string(_nbAttractorSlots) + "\n" + parameters;
+    if (_nbAttractorSlots <= MAX_UNROLLED_SLOTS)
+        parameters = "#define UNROLL_ATTRACTORS\n" + parameters;
+    if (_vectorField)
+        physics = "#define VECTOR_FIELD\n" + physics;
+    if (_integrator == Integrator::Verlet)
+        physics = "#define INTEGRATOR_VERLET\n" + physics;
+    else if (_integrator == Integrator::RK2)
+        physics = "#define INTEGRATOR_RK2\n" + physics;
 
-    loadFile("shaders/computeInitialPositions.frag", fragmentShader);
-    searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
-    if (!_computeInitialPositionsShader.loadFromMemory(fragmentShader, sf::Shader::Fragment))
-        throw std::runtime_error("unable to load shader shaders/computeInitialPositions.frag");
+    if (_backend == Backend::FragmentShaders) {
+        /* Every pass draws the same triangle covering the whole buffer */
+        std::string fullscreenVertexShader;
+        loadFile("shaders/fullscreen.vert", fullscreenVertexShader);
 
-    loadFile("shaders/computeInitialVelocities.frag", fragmentShader);
-    searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
-    if (!_computeInitialVelocitiesShader.loadFromMemory(fragmentShader, sf::Shader::Fragment))
-        throw std::runtime_error("unable to load shader shaders/computeInitialVelocities.frag");
+        loadFile("shaders/computeInitialPositions.frag", fragmentShader);
+        searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
+        if (!_computeInitialPositionsProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, fullscreenVertexShader),
+                                                             GLProgram::Source(GL_FRAGMENT_SHADER, fragmentShader)}))
+            throw std::runtime_error("unable to load shader shaders/computeInitialPositions.frag");
+        GLProgram::bind(&_computeInitialPositionsProgram);
+        GLCHECK(glUniform2f(_computeInitialPositionsProgram.getUniformLocation("bufferSize"), _buffersSize.x, _buffersSize.y));
+        GLCHECK(glUniform2f(_computeInitialPositionsProgram.getUniformLocation("layoutCenter"), _layoutCenter.x, _layoutCenter.y));
 
-    loadFile("shaders/updateVelocity.frag", fragmentShader);
-    searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
-    if (!_updateVelocityShader.loadFromMemory(fragmentShader, sf::Shader::Fragment))
-        throw std::runtime_error("unable to load shader shaders/updateVelocity.frag");
+        loadFile("shaders/computeInitialVelocities.frag", fragmentShader);
+        searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
+        if (!_computeInitialVelocitiesProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, fullscreenVertexShader),
+                                                              GLProgram::Source(GL_FRAGMENT_SHADER, fragmentShader)}))
+            throw std::runtime_error("unable to load shader shaders/computeInitialVelocities.frag");
 
-    loadFile("shaders/updatePosition.frag", fragmentShader);
-    searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
-    if (!_updatePositionShader.loadFromMemory(fragmentShader, sf::Shader::Fragment))
-        throw std::runtime_error("unable to load shader shaders/updatePosition.frag");
+        if (_fusedUpdate) {
+            loadFile("shaders/updateState.frag", fragmentShader);
+            searchAndReplace("__PARAMETERS.GLSL__", parameters, fragmentShader);
+            searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
+            searchAndReplace("__PHYSICS.GLSL__", physics, fragmentShader);
+            if (!_fusedUpdateProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, fullscreenVertexShader),
+                                                     GLProgram::Source(GL_FRAGMENT_SHADER, fragmentShader)}))
+                throw std::runtime_error("unable to load shader shaders/updateState.frag");
+            setSamplerUnits(_fusedUpdateProgram, {"oldPositions", "oldVelocities"});
+            _fusedUpdateProgram.setUniformBlockBinding("Parameters", PARAMETERS_BINDING);
+            if (_vectorField)
+                setVectorFieldUnit(_fusedUpdateProgram);
+        } else {
+            loadFile("shaders/updateVelocity.frag", fragmentShader);
+            searchAndReplace("__PARAMETERS.GLSL__", parameters, fragmentShader);
+            searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
+            searchAndReplace("__PHYSICS.GLSL__", physics, fragmentShader);
+            if (!_updateVelocityProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, fullscreenVertexShader),
+                                                        GLProgram::Source(GL_FRAGMENT_SHADER, fragmentShader)}))
+                throw std::runtime_error("unable to load shader shaders/updateVelocity.frag");
+            setSamplerUnits(_updateVelocityProgram, {"positions", "oldVelocities"});
+            _updateVelocityProgram.setUniformBlockBinding("Parameters", PARAMETERS_BINDING);
+            if (_vectorField)
+                setVectorFieldUnit(_updateVelocityProgram);
+
+            loadFile("shaders/updatePosition.frag", fragmentShader);
+            searchAndReplace("__PARAMETERS.GLSL__", parameters, fragmentShader);
+            searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
+            searchAndReplace("__PHYSICS.GLSL__", physics, fragmentShader);
+            if (!_updatePositionProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, fullscreenVertexShader),
+                                                        GLProgram::Source(GL_FRAGMENT_SHADER, fragmentShader)}))
+                throw std::runtime_error("unable to load shader shaders/updatePosition.frag");
+            setSamplerUnits(_updatePositionProgram, {"oldPositions", "velocities", "oldVelocities"});
+            _updatePositionProgram.setUniformBlockBinding("Parameters", PARAMETERS_BINDING);
+            if (_vectorField)
+                setVectorFieldUnit(_updatePositionProgram);
+        }
+    } else if (_backend == Backend::ComputeShader) {
+        loadFile("shaders/computeInitialState.comp", computeShader);
+        if (_emitters)
+            insertDefine("EMITTERS", computeShader);
+        if (!_computeInitialStateProgram.loadFromMemory({GLProgram::Source(GL_COMPUTE_SHADER, computeShader)}))
+            throw std::runtime_error("unable to load shader shaders/computeInitialState.comp");
+        GLProgram::bind(&_computeInitialStateProgram);
+        GLCHECK(glUniform2ui(_computeInitialStateProgram.getUniformLocation("bufferSize"), _buffersSize.x, _buffersSize.y));
+        GLCHECK(glUniform2f(_computeInitialStateProgram.getUniformLocation("layoutCenter"), _layoutCenter.x, _layoutCenter.y));
+
+        loadFile("shaders/updateState.comp", computeShader);
+        searchAndReplace("__PARAMETERS.GLSL__", parameters, computeShader);
+        searchAndReplace("__PHYSICS.GLSL__", physics, computeShader);
+        searchAndReplace("__SPATIALGRID.GLSL__", spatialGrid, computeShader);
+        if (_neighbourForces)
+            insertDefine("NEIGHBOUR_FORCES", computeShader);
+        if (_emitters)
+            insertDefine("EMITTERS", computeShader);
+        if (!_updateStateProgram.loadFromMemory({GLProgram::Source(GL_COMPUTE_SHADER, computeShader)}))
+            throw std::runtime_error("unable to load shader shaders/updateState.comp");
+        GLProgram::bind(&_updateStateProgram);
+        GLCHECK(glUniform1ui(_updateStateProgram.getUniformLocation("nbParticles"), getNbParticles()));
+        _updateStateProgram.setUniformBlockBinding("Parameters", PARAMETERS_BINDING);
+        if (_vectorField)
+            setVectorFieldUnit(_updateStateProgram);
+
+        if (_neighbourForces) {
+            loadFile("shaders/binParticles.comp", computeShader);
+            searchAndReplace("__PARAMETERS.GLSL__", parameters, computeShader);
+            searchAndReplace("__SPATIALGRID.GLSL__", spatialGrid, computeShader);
+            if (!_binParticlesProgram.loadFromMemory({GLProgram::Source(GL_COMPUTE_SHADER, computeShader)}))
+                throw std::runtime_error("unable to load shader shaders/binParticles.comp");
+            GLProgram::bind(&_binParticlesProgram);
+            GLCHECK(glUniform1ui(_binParticlesProgram.getUniformLocation("nbParticles"), getNbParticles()));
+            _binParticlesProgram.setUniformBlockBinding("Parameters", PARAMETERS_BINDING);
+
+            loadFile("shaders/prefixSum.comp", computeShader);
+            if (!_prefixSumProgram.loadFromMemory({GLProgram::Source(GL_COMPUTE_SHADER, computeShader)}))
+                throw std::runtime_error("unable to load shader shaders/prefixSum.comp");
+            insertDefine("ADD_BLOCK_OFFSETS", computeShader);
+            if (!_addBlockOffsetsProgram.loadFromMemory({GLProgram::Source(GL_COMPUTE_SHADER, computeShader)}))
+                throw std::runtime_error("unable to load shader shaders/prefixSum.comp");
+
+            loadFile("shaders/sortParticles.comp", computeShader);
+            if (!_sortParticlesProgram.loadFromMemory({GLProgram::Source(GL_COMPUTE_SHADER, computeShader)}))
+                throw std::runtime_error("unable to load shader shaders/sortParticles.comp");
+            GLProgram::bind(&_sortParticlesProgram);
+            GLCHECK(glUniform1ui(_sortParticlesProgram.getUniformLocation("nbParticles"), getNbParticles()));
+        }
 
-    loadFile("shaders/displayParticles.vert", vertexShader);
+        if (_emitters) {
+            loadFile("shaders/emitParticles.comp", computeShader);
+            if (!_emitParticlesProgram.loadFromMemory({GLProgram::Source(GL_COMPUTE_SHADER, computeShader)}))
+                throw std::runtime_error("unable to load shader shaders/emitParticles.comp");
+            _nbEmittersLocation = _emitParticlesProgram.getUniformLocation("nbEmitters");
+            _nbEmittedLocation = _emitParticlesProgram.getUniformLocation("nbEmitted");
+            _emissionSeedLocation = _emitParticlesProgram.getUniformLocation("seed");
+        }
+        GLProgram::bind(nullptr);
+    } else if (_backend == Backend::TransformFeedback) {
+        const std::vector<std::string> stateVaryings = {"newPosition", "newVelocity"};
+
+        loadFile("shaders/computeInitialState.vert", vertexShader);
+        if (!_transformFeedbackInitialStateProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, vertexShader)}, stateVaryings))
+            throw std::runtime_error("unable to load shader shaders/computeInitialState.vert");
+        GLProgram::bind(&_transformFeedbackInitialStateProgram);
+        GLCHECK(glUniform2i(_transformFeedbackInitialStateProgram.getUniformLocation("bufferSize"), _buffersSize.x, _buffersSize.y));
+        GLCHECK(glUniform2f(_transformFeedbackInitialStateProgram.getUniformLocation("layoutCenter"), _layoutCenter.x, _layoutCenter.y));
+
+        loadFile("shaders/update.vert", vertexShader);
+        searchAndReplace("__PARAMETERS.GLSL__", parameters, vertexShader);
+        searchAndReplace("__PHYSICS.GLSL__", physics, vertexShader);
+        if (!_transformFeedbackUpdateProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, vertexShader)}, stateVaryings))
+            throw std::runtime_error("unable to load shader shaders/update.vert");
+        _transformFeedbackUpdateProgram.setUniformBlockBinding("Parameters", PARAMETERS_BINDING);
+        if (_vectorField)
+            setVectorFieldUnit(_transformFeedbackUpdateProgram);
+        _transformFeedbackPositionAttributeID = _transformFeedbackUpdateProgram.getAttributeLocation("position");
+        _transformFeedbackVelocityAttributeID = _transformFeedbackUpdateProgram.getAttributeLocation("velocity");
+    }
+
+    /* Display: particles located by the positions texture (unit 0),
+     * or by a positions buffer for the other backends */
+    std::string displayVertexShaderPath = (_backend == Backend::FragmentShaders) ? "shaders/displayParticles.vert"
+                                                                                  : "shaders/displayParticlesFromBuffer.vert";
+    loadFile(displayVertexShaderPath, vertexShader);
     searchAndReplace("__UTILS.GLSL__", utils, vertexShader);
+    if (_vertexIDAddressing)
+        insertDefine("VERTEX_ID_ADDRESSING", vertexShader);
+    if (_colorsFromTexture)
+        insertDefine("COLOR_TEXTURE", vertexShader);
+    /* The CPU backend uploads positions already interpolated */
+    if (_backend != Backend::CPU)
+        insertDefine("INTERPOLATION", vertexShader);
     loadFile("shaders/displayParticles.frag", fragmentShader);
     searchAndReplace("__UTILS.GLSL__", utils, fragmentShader);
 
-    if (!_displayVerticesShader.loadFromMemory(vertexShader, fragmentShader))
-        throw std::runtime_error("unable to load shader shaders/displayParticles.frag or shaders/displayParticles.vert");
+    if (!_displayVerticesProgram.loadFromMemory({GLProgram::Source(GL_VERTEX_SHADER, vertexShader),
+                                                 GLProgram::Source(GL_FRAGMENT_SHADER, fragmentShader)}))
+        throw std::runtime_error("unable to load shader shaders/displayParticles.frag or " + displayVertexShaderPath);
+    setSamplerUnits(_displayVerticesProgram, {"positions", "colors", "previousPositions"});
 
+    /* Locations used by draw(), -1 for the attributes the shader doesn't declare */
+    _viewMatrixLocation = _displayVerticesProgram.getUniformLocation("viewMatrix");
+    if (_vertexIDAddressing)
+        _locationAttributeID = -1;
+    else if (_backend == Backend::FragmentShaders)
+        _locationAttributeID = _displayVerticesProgram.getAttributeLocation("coordsOnBuffer");
+    else
+        _locationAttributeID = _displayVerticesProgram.getAttributeLocation("position");
+    _colorAttributeID = _colorsFromTexture ? -1 : _displayVerticesProgram.getAttributeLocation("color");
+    _interpolationLocation = _displayVerticesProgram.getUniformLocation("interpolation");
+    if (_backend == Backend::ComputeShader || _backend == Backend::TransformFeedback)
+        _previousPositionAttributeID = _displayVerticesProgram.getAttributeLocation("previousPosition");
 
-    /* Create VBO */
-    std::vector< glm::vec4 > colors (getNbParticles());
-    std::vector< glm::vec2 > texCoords (getNbParticles());
+    GLProgram::bind(&_displayVerticesProgram);
+    GLCHECK(glUniform1i(_displayVerticesProgram.getUniformLocation("bufferWidth"), _buffersSize.x));
+    GLProgram::bind(nullptr);
 
-    for (unsigned int i = 0 ; i < getNbParticles() ; ++i) {
-        sf::Vector2i pos (i % getBuffersSize().x, i / getBuffersSize().x);
-        sf::Color col (image.getPixel(pos.x, pos.y));
 
-        colors[i] = glm::vec4(col.r, col.g, col.b, col.a) / 255.f;
-        texCoords[i] = glm::vec2(static_cast<float>(pos.x) / static_cast<float>(getBuffersSize().x),
-                              static_cast<float>(pos.y) / static_cast<float>(getBuffersSize().y));
-    }
+    /* The per-particle buffers are written by rows in parallel, with the
+     * threads of the CPU backend or with threads of their own */
+    std::unique_ptr<ThreadPool> constructionThreadPool;
+    if (!_threadPool)
+        constructionThreadPool.reset(new ThreadPool());
+    ThreadPool& threadPool = _threadPool ? *_threadPool : *constructionThreadPool;
+    const unsigned int width = getBuffersSize().x, height = getBuffersSize().y;
 
-    /* Activate buffer and send data to the graphics card */
-    GLCHECK(glGenBuffers(1, &_colorBufferID)); //colors
-    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER,_colorBufferID));
-    GLCHECK(glBufferData(GL_ARRAY_BUFFER, colors.size()*sizeof(glm::vec4), colors.data(), GL_STATIC_DRAW));
+    /* Colors, uploaded as is from the image's RGBA8 pixels */
+    if (_colorsFromTexture) {
+        if (!_colorTexture.create(width, height, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, image.getPixelsPtr()))
+            throw std::runtime_error("unable to create colors texture");
+    } else {
+        /* 4 bytes per particle, normalized to [0,1] by the vertex fetch */
+        const std::uint8_t* pixels = image.getPixelsPtr();
+        _colorBufferID = createVertexBuffer(getNbParticles()*4, height, threadPool,
+                                            [&](void* mapping, std::size_t beginRow, std::size_t endRow) {
+            std::memcpy(static_cast<std::uint8_t*>(mapping) + 4*width*beginRow, pixels + 4*width*beginRow,
+                        4*width*(endRow - beginRow));
+        });
+    }
 
-    GLCHECK(glGenBuffers(1, &_texCoordBufferID)); //corresponding texture pixel coordinates
-    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _texCoordBufferID));
-    GLCHECK(glBufferData(GL_ARRAY_BUFFER, texCoords.size()*sizeof(glm::vec2), texCoords.data(), GL_STATIC_DRAW));
+    /* Coordinates of the texel of each particle on the state textures */
+    if (_backend == Backend::FragmentShaders && !_vertexIDAddressing) {
+        const float inverseWidth = 1.f / static_cast<float>(width);
+        const float inverseHeight = 1.f / static_cast<float>(height);
+        _texCoordBufferID = createVertexBuffer(getNbParticles()*sizeof(glm::vec2), height, threadPool,
+                                               [&](void* mapping, std::size_t beginRow, std::size_t endRow) {
+            glm::vec2* texCoords = static_cast<glm::vec2*>(mapping);
+            for (std::size_t y = beginRow ; y < endRow ; ++y) {
+                float v = (static_cast<float>(y) + 0.5f) * inverseHeight;
+                computeTexCoordsRow(texCoords + y * width, width, v, inverseWidth);
+            }
+        });
+    }
 
     initialize();
 }
 
 Particles::~Particles()
 {
+    /* The writer reads the mappings of the copy */
+    if (_checkpointWriting) {
+        try {
+            _checkpointWriter.wait();
+        } catch (std::exception const& e) {
+            std::cerr << "Checkpoint not saved: " << e.what() << std::endl;
+        }
+    }
+    releaseCheckpointCopy();
+
     if (_colorBufferID != 0)
         GLCHECK(glDeleteBuffers(1, &_colorBufferID));
     if (_texCoordBufferID != 0)
         GLCHECK(glDeleteBuffers(1, &_texCoordBufferID));
+    if (_parametersBufferID != 0)
+        GLCHECK(glDeleteBuffers(1, &_parametersBufferID));
+    if (_positionBufferID != 0)
+        GLCHECK(glDeleteBuffers(1, &_positionBufferID));
+    for (GLuint bufferID : _stateBufferIDs) {
+        if (bufferID != 0)
+            GLCHECK(glDeleteBuffers(1, &bufferID));
+    }
+    for (GLuint bufferID : {_bucketStartsBufferID, _particleBucketsBufferID, _blockSumsBufferID,
+                            _scanTotalBufferID, _sortedStateBufferID, _sortedIndicesBufferID,
+                            _lifeBufferID, _deadIndicesBufferID, _liveIndicesBufferID,
+                            _emissionCountersBufferID, _emittersBufferID}) {
+        if (bufferID != 0)
+            GLCHECK(glDeleteBuffers(1, &bufferID));
+    }
+    for (GLuint bufferID : _transformFeedbackBufferIDs) {
+        if (bufferID != 0)
+            GLCHECK(glDeleteBuffers(1, &bufferID));
+    }
+    if (_transformFeedbackVertexArrayID != 0)
+        GLCHECK(glDeleteVertexArrays(1, &_transformFeedbackVertexArrayID));
+}
+
+Particles::Backend Particles::getBackend() const
+{
+    return _backend;
+}
+
+unsigned int Particles::getNbThreads() const
+{
+    return _threadPool ? _threadPool->getNbThreads() : 0;
+}
+
+const char* Particles::getBackendName(Backend backend)
+{
+    switch (backend) {
+        case Backend::FragmentShaders:
+            return "fragment shaders";
+        case Backend::CPU:
+            return "CPU";
+        case Backend::ComputeShader:
+            return "compute shader";
+        case Backend::TransformFeedback:
+            return "transform feedback";
+    }
+    return "unknown";
+}
+
+Particles::Storage Particles::getStorage() const
+{
+    return _storage;
+}
+
+const char* Particles::getStorageName(Storage storage)
+{
+    switch (storage) {
+        case Storage::Packed:
+            return "packed RGBA8";
+        case Storage::Float16:
+            return "RG16F";
+        case Storage::Float32:
+            return "RG32F";
+    }
+    return "unknown";
+}
+
+Particles::Integrator Particles::getIntegrator() const
+{
+    return _integrator;
+}
+
+const char* Particles::getIntegratorName(Integrator integrator)
+{
+    switch (integrator) {
+        case Integrator::SemiImplicitEuler:
+            return "semi-implicit Euler";
+        case Integrator::Verlet:
+            return "velocity Verlet";
+        case Integrator::RK2:
+            return "RK2 (midpoint)";
+    }
+    return "unknown";
+}
+
+bool Particles::isUpdateFused() const
+{
+    return _fusedUpdate;
+}
+
+bool Particles::isAddressedByVertexID() const
+{
+    return _vertexIDAddressing;
+}
+
+bool Particles::areColorsFromTexture() const
+{
+    return _colorsFromTexture;
+}
+
+void Particles::enablePassTimer(PassTimer::Source source)
+{
+    _passTimer.enable(source);
+}
+
+PassTimer const& Particles::getPassTimer() const
+{
+    return _passTimer;
+}
+
+void Particles::setTimeStep(sf::Time const& step, unsigned int maxSubsteps)
+{
+    _timeStep = step;
+    _maxSubsteps = std::max(1u, maxSubsteps);
+}
+
+sf::Time const& Particles::getTimeStep() const
+{
+    return _timeStep;
+}
+
+unsigned int Particles::getMaxSubsteps() const
+{
+    return _maxSubsteps;
 }
 
 unsigned int Particles::getNbParticles() const
@@ -115,23 +777,48 @@ sf::Vector2u const& Particles::getBuffersSize() const
     return _buffersSize;
 }
 
+glm::vec2 const& Particles::getLayoutCenter() const
+{
+    return _layoutCenter;
+}
+
 void Particles::initialize()
 {
-    /* Blending disabled, all four components replaced */
-    sf::RenderStates noBlending(sf::BlendMode(sf::BlendMode::One, sf::BlendMode::Zero));
-    sf::Vector2f bufferSize = sf::Vector2f(_buffersSize.x, _buffersSize.y);
-    sf::RectangleShape square(sf::Vector2f(getBuffersSize().x, getBuffersSize().y));
+    /* Both states of each pair are initialized, so that the
+     * interpolation between them shows still particles */
+    if (_backend == Backend::CPU) {
+        _cpuSimulation->initialize();
+        uploadCPUPositions();
+        return;
+    } else if (_backend == Backend::ComputeShader) {
+        if (_emitters) {
+            /* Every slot dead, none to draw */
+            const EmissionCounters counters = {0, 1, 0, 0, 0, getNbParticles()};
+            GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, _emissionCountersBufferID));
+            GLCHECK(glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), &counters));
+            GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+            GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIFE_BINDING, _lifeBufferID));
+            GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEAD_INDICES_BINDING, _deadIndicesBufferID));
+            _emissionCredits.assign(_emitterList.size(), 0.f);
+        }
+        for (GLuint bufferID : _stateBufferIDs)
+            dispatchCompute(_computeInitialStateProgram, 0, bufferID);
+        return;
+    } else if (_backend == Backend::TransformFeedback) {
+        for (GLuint bufferID : _transformFeedbackBufferIDs)
+            runTransformFeedback(_transformFeedbackInitialStateProgram, 0, bufferID);
+        return;
+    }
+
+    GLProgram::bind(&_computeInitialPositionsProgram);
+    for (GLFramebuffer const& framebuffer : _positionFramebuffers)
+        _fullscreenPass.run(framebuffer, {});
 
-    /* Positions */
-    _computeInitialPositionsShader.setParameter("bufferSize", bufferSize);
-    noBlending.shader = &_computeInitialPositionsShader;
-    for (sf::RenderTexture &texture : _positions)
-        texture.draw (square, noBlending);
+    GLProgram::bind(&_computeInitialVelocitiesProgram);
+    for (GLFramebuffer const& framebuffer : _velocityFramebuffers)
+        _fullscreenPass.run(framebuffer, {});
 
-    /* Velocities */
-    noBlending.shader = &_computeInitialVelocitiesShader;
-    for (sf::RenderTexture &texture : _velocities)
-        texture.draw (square, noBlending);
+    GLProgram::bind(nullptr);
 }
 
 void Particles::setMagnetState (bool activation)
@@ -144,79 +831,975 @@ void Particles::setMagnetPosition(sf::Vector2f const& position)
     _magnetPosition = position;
 }
 
+void Particles::setAttractors(std::vector<Attractor> const& attractors)
+{
+    if (attractors.size() > _maxAttractors)
+        throw std::runtime_error("too many attractors: " + std::to_string(attractors.size())
+                                 + " for a maximum of " + std::to_string(_maxAttractors));
+    for (Attractor const& attractor : attractors) {
+        if (attractor.falloff > 2)
+            throw std::runtime_error("the falloff of an attractor must be 0, 1 or 2");
+    }
+
+    _attractors = attractors;
+}
+
+std::vector<Particles::Attractor> const& Particles::getAttractors() const
+{
+    return _attractors;
+}
+
+unsigned int Particles::getMaxAttractors() const
+{
+    return _maxAttractors;
+}
+
+bool Particles::hasVectorField() const
+{
+    return _vectorField;
+}
+
+void Particles::setVectorField(VectorField const& field)
+{
+    TRACE_ZONE("setVectorField");
+    if (!_vectorField)
+        throw std::runtime_error("the vector field isn't enabled in the settings");
+    if (field.isEmpty())
+        throw std::runtime_error("empty vector field");
+
+    _vectorFieldOrigin = field.getOrigin();
+    _vectorFieldScale = glm::vec2(1.f) / field.getSize();
+
+    if (_backend == Backend::CPU) {
+        _cpuVectorField = field;
+        return;
+    }
+
+    /* The other texture isn't read by the steps submitted so far,
+     * so the driver has no reason to wait for them */
+    int nextIndex = (_currentVectorFieldIndex + 1) % 2;
+    GLTexture &texture = _vectorFieldTextures[nextIndex];
+    if (texture.getSize() == sf::Vector2u(field.getWidth(), field.getHeight())) {
+        texture.update(GL_RG, GL_FLOAT, field.getValues().data());
+    } else {
+        if (!texture.create(field.getWidth(), field.getHeight(), GL_RG32F, GL_RG, GL_FLOAT, field.getValues().data()))
+            throw std::runtime_error("unable to create vector field texture");
+        texture.setBilinearRepeat();
+    }
+    _currentVectorFieldIndex = nextIndex;
+}
+
+bool Particles::hasNeighbourForces() const
+{
+    return _neighbourForces;
+}
+
+void Particles::setNeighbourForces(NeighbourForces const& forces)
+{
+    if (!(forces.radius > 0.f))
+        throw std::runtime_error("the radius of the neighbour forces must be positive");
+
+    _neighbourParameters = forces;
+}
+
+Particles::NeighbourForces const& Particles::getNeighbourForces() const
+{
+    return _neighbourParameters;
+}
+
+void Particles::setForceModel(ForceModel model)
+{
+    if (model == ForceModel::Gravity && _backend != Backend::CPU)
+        throw std::runtime_error("gravity requires the CPU backend");
+
+    _forceModel = model;
+}
+
+Particles::ForceModel Particles::getForceModel() const
+{
+    return _forceModel;
+}
+
+const char* Particles::getForceModelName(ForceModel model)
+{
+    switch (model) {
+        case ForceModel::Attractors:
+            return "attractors";
+        case ForceModel::Gravity:
+            return "gravity (Barnes-Hut)";
+    }
+    return "unknown";
+}
+
+void Particles::setGravity(Gravity const& gravity)
+{
+    if (!(gravity.openingAngle >= 0.f))
+        throw std::runtime_error("the opening angle of the gravity must not be negative");
+    if (!(gravity.softening > 0.f))
+        throw std::runtime_error("the softening of the gravity must be positive");
+
+    _gravity = gravity;
+}
+
+Particles::Gravity const& Particles::getGravity() const
+{
+    return _gravity;
+}
+
+bool Particles::hasEmitters() const
+{
+    return _emitters;
+}
+
+void Particles::setEmitters(std::vector<Emitter> const& emitters)
+{
+    if (!_emitters)
+        throw std::runtime_error("the emitters aren't enabled in the settings");
+    if (emitters.size() > MAX_EMITTERS)
+        throw std::runtime_error("at most " + std::to_string(MAX_EMITTERS) + " emitters are supported");
+
+    std::vector<Emitter> normalized(emitters);
+    for (Emitter& emitter : normalized) {
+        if (!(emitter.rate >= 0.f))
+            throw std::runtime_error("the rate of an emitter must not be negative");
+        if (!(emitter.lifetime > 0.f))
+            throw std::runtime_error("the lifetime of the particles of an emitter must be positive");
+        float length = glm::length(emitter.direction);
+        emitter.direction = (length > 0.f) ? emitter.direction / length : glm::vec2(1.f, 0.f);
+    }
+
+    _emitterList = normalized;
+    _emissionCredits.assign(_emitterList.size(), 0.f);
+}
+
+std::vector<Particles::Emitter> const& Particles::getEmitters() const
+{
+    return _emitterList;
+}
+
+float Particles::computeEmitterRate(unsigned int nbParticles, std::size_t nbEmitters,
+                                    float lifetime, float liveFraction)
+{
+    return liveFraction * static_cast<float>(nbParticles) / (static_cast<float>(nbEmitters) * lifetime);
+}
+
+unsigned int Particles::countLiveParticles() const
+{
+    if (!_emitters)
+        return getNbParticles();
+
+    EmissionCounters counters;
+    GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, _emissionCountersBufferID));
+    GLCHECK(glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), &counters));
+    GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+    return counters.nbLiveParticles;
+}
+
+void Particles::getActiveAttractors(std::vector<Attractor>& attractors) const
+{
+    attractors.clear();
+    if (_attraction != 0.f) {
+        Attractor magnet;
+        magnet.position = glm::vec2(_magnetPosition.x, _magnetPosition.y);
+        magnet.strength = _attraction;
+        magnet.falloff = 1;
+        magnet.radius = 0.f;
+        attractors.push_back(magnet);
+    }
+    attractors.insert(attractors.end(), _attractors.begin(), _attractors.end());
+}
+
+unsigned int Particles::update(sf::Time const& frameTime)
+{
+    _accumulatedTime += frameTime;
+
+    unsigned int nbSteps = 0;
+    while (_accumulatedTime >= _timeStep && nbSteps < _maxSubsteps) {
+        _accumulatedTime -= _timeStep;
+        ++nbSteps;
+    }
+
+    /* Hitch: the time that couldn't be simulated is dropped, instead of
+     * slowing down the next frames too */
+    if (_accumulatedTime >= _timeStep)
+        _accumulatedTime = sf::microseconds(_accumulatedTime.asMicroseconds() % _timeStep.asMicroseconds());
+
+    simulate(SIMULATION_TIME_SCALE * _timeStep.asSeconds(), nbSteps, _accumulatedTime / _timeStep);
+    return nbSteps;
+}
+
 void Particles::computeNewPositions(sf::Time const& dtime)
 {
-    /* Blending disabled, all four components replaced */
-    sf::RenderStates renderStates(sf::BlendMode(sf::BlendMode::One, sf::BlendMode::Zero));
+    simulate(SIMULATION_TIME_SCALE * dtime.asSeconds(), 1, 1.f);
+}
+
+void Particles::simulate(float dt, unsigned int nbSteps, float interpolation)
+{
+    _passTimer.collect();
+    pollCheckpoint(false);
+    _interpolation = interpolation;
+
+    if (_backend == Backend::CPU) {
+        computeNewPositionsOnCPU(dt, nbSteps);
+        return;
+    }
+
+    /* Every step reads the same parameters, written once. No step waits
+     * for the previous one on the CPU side */
+    if (nbSteps > 0)
+        updateParameters(dt);
+    if (_vectorField)
+        GLTexture::bind(&_vectorFieldTextures[_currentVectorFieldIndex], VECTOR_FIELD_UNIT);
+
+    for (unsigned int step = 0 ; step < nbSteps ; ++step) {
+        if (_emitters)
+            emitParticles(dt);
+        if (_backend == Backend::ComputeShader)
+            computeNewPositionsWithComputeShader();
+        else if (_backend == Backend::TransformFeedback)
+            computeNewPositionsWithTransformFeedback();
+        else if (_fusedUpdate)
+            computeNewPositionsFused();
+        else
+            computeNewPositionsInTwoPasses();
+    }
+}
+
+void Particles::computeNewPositionsInTwoPasses()
+{
+    int nextBufferIndex = (_currentBufferIndex + 1) % 2;
+
+    GLProgram::bind(&_updateVelocityProgram);
+    _passTimer.begin(PassTimer::VelocityPass);
+    _fullscreenPass.run(_velocityFramebuffers[nextBufferIndex],
+                        {&_positions[_currentBufferIndex], &_velocities[_currentBufferIndex]});
+    _passTimer.end(PassTimer::VelocityPass);
+
+    GLProgram::bind(&_updatePositionProgram);
+    _passTimer.begin(PassTimer::PositionPass);
+    _fullscreenPass.run(_positionFramebuffers[nextBufferIndex],
+                        {&_positions[_currentBufferIndex], &_velocities[nextBufferIndex],
+                         &_velocities[_currentBufferIndex]});
+    _passTimer.end(PassTimer::PositionPass);
+
+    GLProgram::bind(nullptr);
+
+    _currentBufferIndex = nextBufferIndex;
+}
+
+void Particles::computeNewPositionsFused()
+{
+    int nextBufferIndex = (_currentBufferIndex + 1) % 2;
+
+    GLProgram::bind(&_fusedUpdateProgram);
+    _passTimer.begin(PassTimer::StatePass);
+    _fullscreenPass.run(_stateFramebuffers[nextBufferIndex],
+                        {&_positions[_currentBufferIndex], &_velocities[_currentBufferIndex]});
+    _passTimer.end(PassTimer::StatePass);
+
+    GLProgram::bind(nullptr);
+
+    _currentBufferIndex = nextBufferIndex;
+}
+
+void Particles::updateParameters(float dt)
+{
+    std::vector<Attractor> attractors;
+    getActiveAttractors(attractors);
+
+    ParametersBlock parameters;
+    parameters.bufferSize = glm::vec2(_buffersSize.x, _buffersSize.y);
+    parameters.dt = dt;
+    parameters.maxSpeed = _maxSpeed;
+    parameters.friction = std::pow(_friction, dt);
+    parameters.nbAttractors = attractors.size();
+    parameters.vectorFieldOrigin = _vectorFieldOrigin;
+    parameters.vectorFieldScale = _vectorFieldScale;
+    parameters.neighbourRadius = _neighbourParameters.radius;
+    parameters.separation = _neighbourParameters.separation;
+    parameters.cohesion = _neighbourParameters.cohesion;
+    parameters.alignment = _neighbourParameters.alignment;
+    parameters.maxNeighbours = _neighbourParameters.maxNeighbours;
+    parameters.nbBuckets = _nbBuckets;
+
+    /* Unused slots are out of range of every particle */
+    for (unsigned int i = 0 ; i < _nbAttractorSlots ; ++i) {
+        AttractorBlock &slot = parameters.attractors[i];
+        slot = AttractorBlock();
+        slot.falloff = 1;
+        if (i < attractors.size()) {
+            slot.position = attractors[i].position;
+            slot.strength = attractors[i].strength;
+            slot.falloff = attractors[i].falloff;
+            slot.squaredRadius = (attractors[i].radius > 0.f) ? attractors[i].radius * attractors[i].radius
+                                                              : std::numeric_limits<float>::max();
+        }
+    }
+
+    GLCHECK(glBindBufferBase(GL_UNIFORM_BUFFER, PARAMETERS_BINDING, _parametersBufferID));
+    GLCHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, offsetof(ParametersBlock, attractors) + _nbAttractorSlots*sizeof(AttractorBlock),
+                            &parameters));
+}
+
+void Particles::computeNewPositionsOnCPU(float dt, unsigned int nbSteps)
+{
+    CPUSimulation::Parameters parameters;
+    parameters.dt = dt;
+    parameters.maxSpeed = _maxSpeed;
+    parameters.friction = std::pow(_friction, dt);
+    getActiveAttractors(parameters.attractors);
+    parameters.vectorField = (_vectorField && !_cpuVectorField.isEmpty()) ? &_cpuVectorField : nullptr;
+    parameters.neighbourForces = _neighbourForces ? &_neighbourParameters : nullptr;
+    parameters.gravity = (_forceModel == ForceModel::Gravity) ? &_gravity : nullptr;
+    if (nbSteps > 0) {
+        TRACE_ZONE("CPU kernels");
+        _passTimer.begin(PassTimer::StatePass, true);
+        _cpuSimulation->update(parameters, nbSteps);
+        _passTimer.end(PassTimer::StatePass);
+    }
+
+    /* Even without new step, the interpolated positions change */
+    TRACE_ZONE("upload");
+    _passTimer.begin(PassTimer::UploadPass, true);
+    uploadCPUPositions();
+    _passTimer.end(PassTimer::UploadPass);
+}
+
+void Particles::uploadCPUPositions()
+{
+    /* The previous content is discarded, so that the driver doesn't
+     * have to wait for the last draw call to be over */
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _positionBufferID));
+    void* mappedPositions = nullptr;
+    GLCHECK(mappedPositions = glMapBufferRange(GL_ARRAY_BUFFER, 0, getNbParticles()*sizeof(glm::vec2),
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (mappedPositions != nullptr) {
+        _cpuSimulation->copyPositions(static_cast<glm::vec2*>(mappedPositions), _interpolation);
+        GLCHECK(glUnmapBuffer(GL_ARRAY_BUFFER));
+    }
+    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void Particles::computeNewPositionsWithComputeShader()
+{
+    int nextBufferIndex = (_currentBufferIndex + 1) % 2;
+
+    if (_neighbourForces)
+        binParticles();
+
+    /* The step lists the live and dead particles again */
+    if (_emitters) {
+        const GLuint zero = 0;
+        GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, _emissionCountersBufferID));
+        GLCHECK(glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(EmissionCounters, nbLiveParticles), sizeof(zero), &zero));
+        GLCHECK(glBufferSubData(GL_SHADER_STORAGE_BUFFER, offsetof(EmissionCounters, nbDeadParticles), sizeof(zero), &zero));
+        GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+        GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIFE_BINDING, _lifeBufferID));
+        GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEAD_INDICES_BINDING, _deadIndicesBufferID));
+        GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMISSION_COUNTERS_BINDING, _emissionCountersBufferID));
+        GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIVE_INDICES_BINDING, _liveIndicesBufferID));
+    }
+
+    _passTimer.begin(PassTimer::StatePass);
+    dispatchCompute(_updateStateProgram,
+                    _stateBufferIDs[_currentBufferIndex],
+                    _stateBufferIDs[nextBufferIndex]);
+    _passTimer.end(PassTimer::StatePass);
+
+    /* The counters and live indices are read by the indirect draw, and
+     * the counters reset by the next step or read by countLiveParticles() */
+    if (_emitters)
+        GLCHECK(glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT));
+
+    _currentBufferIndex = nextBufferIndex;
+}
+
+void Particles::emitParticles(float dt)
+{
+    /* Whole particles due from each emitter, the fractions being carried
+     * over to the next steps. The invocations of an emitter are contiguous */
+    std::vector<EmitterBlock> blocks(_emitterList.size());
+    GLuint nbEmitted = 0;
+    for (std::size_t i = 0 ; i < _emitterList.size() ; ++i) {
+        Emitter const& emitter = _emitterList[i];
+        _emissionCredits[i] += emitter.rate * dt / SIMULATION_TIME_SCALE;
+        GLuint count = static_cast<GLuint>(_emissionCredits[i]);
+        _emissionCredits[i] -= static_cast<float>(count);
+
+        blocks[i].position = emitter.position;
+        blocks[i].direction = emitter.direction;
+        blocks[i].spread = emitter.spread;
+        blocks[i].speed = emitter.speed;
+        blocks[i].lifetime = SIMULATION_TIME_SCALE * emitter.lifetime;
+        blocks[i].firstParticle = nbEmitted;
+        nbEmitted += count;
+    }
+    ++_emissionSeed;
+    if (nbEmitted == 0)
+        return;
+
+    _passTimer.begin(PassTimer::EmissionPass);
+    GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, _emittersBufferID));
+    GLCHECK(glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, blocks.size()*sizeof(EmitterBlock), blocks.data()));
+    GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+    GLProgram::bind(&_emitParticlesProgram);
+    GLCHECK(glUniform1ui(_nbEmittersLocation, blocks.size()));
+    GLCHECK(glUniform1ui(_nbEmittedLocation, nbEmitted));
+    GLCHECK(glUniform1ui(_emissionSeedLocation, _emissionSeed));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIFE_BINDING, _lifeBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEAD_INDICES_BINDING, _deadIndicesBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMISSION_COUNTERS_BINDING, _emissionCountersBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTERS_BINDING, _emittersBufferID));
+
+    /* Written into the current state, read next by the update */
+    dispatchCompute(_emitParticlesProgram, 0, _stateBufferIDs[_currentBufferIndex], nbEmitted);
+    _passTimer.end(PassTimer::EmissionPass);
+}
+
+void Particles::dispatchCompute(GLProgram const& program, GLuint sourceBufferID, GLuint destinationBufferID,
+                                GLuint nbInvocations) const
+{
+    if (nbInvocations == 0)
+        nbInvocations = getNbParticles();
+
+    /* Work groups of 256 invocations (see the .comp files), spread over
+     * two dimensions because each one is limited to 65535 groups */
+    const GLuint groupSize = 256;
+    GLuint nbGroups = (nbInvocations + groupSize - 1) / groupSize;
+    GLuint nbGroupsX = std::min(nbGroups, 65535u);
+    GLuint nbGroupsY = (nbGroups + nbGroupsX - 1) / nbGroupsX;
+
+    /* No source buffer for the initialization, no destination buffer
+     * for the passes of binParticles() */
+    GLProgram::bind(&program);
+    if (sourceBufferID != 0)
+        GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sourceBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, destinationBufferID));
+    GLCHECK(glDispatchCompute(nbGroupsX, nbGroupsY, 1));
+
+    /* The buffer is read next by the following dispatch, or as a vertex buffer */
+    GLCHECK(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT));
+    GLProgram::bind(nullptr);
+}
+
+void Particles::binParticles()
+{
+    _passTimer.begin(PassTimer::BinningPass);
+
+    /* Counts accumulated by binParticles.comp */
+    GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, _bucketStartsBufferID));
+    GLCHECK(glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+    GLCHECK(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUCKET_STARTS_BINDING, _bucketStartsBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BUCKETS_BINDING, _particleBucketsBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SORTED_STATE_BINDING, _sortedStateBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SORTED_INDICES_BINDING, _sortedIndicesBufferID));
+    dispatchCompute(_binParticlesProgram, _stateBufferIDs[_currentBufferIndex], 0);
+
+    /* The counts become the starts of the buckets: prefix sum of each block,
+     * then of the sums of the blocks (a single block, as _nbBuckets is at
+     * most PREFIX_SUM_BLOCK^2), added back to their block */
+    dispatchPrefixSum(_prefixSumProgram, _bucketStartsBufferID, _blockSumsBufferID, _nbBuckets);
+    dispatchPrefixSum(_prefixSumProgram, _blockSumsBufferID, _scanTotalBufferID, PREFIX_SUM_BLOCK);
+    dispatchPrefixSum(_addBlockOffsetsProgram, _bucketStartsBufferID, _blockSumsBufferID, _nbBuckets);
+
+    /* The grid stays bound for updateState.comp */
+    dispatchCompute(_sortParticlesProgram, _stateBufferIDs[_currentBufferIndex], 0);
+
+    _passTimer.end(PassTimer::BinningPass);
+}
+
+void Particles::dispatchPrefixSum(GLProgram const& program, GLuint valuesBufferID, GLuint blockSumsBufferID,
+                                  GLuint nbValues) const
+{
+    GLProgram::bind(&program);
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUCKET_STARTS_BINDING, valuesBufferID));
+    GLCHECK(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BLOCK_SUMS_BINDING, blockSumsBufferID));
+    GLCHECK(glDispatchCompute(nbValues / PREFIX_SUM_BLOCK, 1, 1));
+    GLCHECK(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
+    GLProgram::bind(nullptr);
+}
 
+void Particles::computeNewPositionsWithTransformFeedback()
+{
     int nextBufferIndex = (_currentBufferIndex + 1) % 2;
 
-    sf::RectangleShape square(sf::Vector2f(getBuffersSize().x, getBuffersSize().y));
-    sf::Vector2f bufferSize = sf::Vector2f(_buffersSize.x, _buffersSize.y);
-    float dt = 30.f * dtime.asSeconds();
-
-    _updateVelocityShader.setParameter("positions", _positions[_currentBufferIndex].getTexture());
-    _updateVelocityShader.setParameter("oldVelocities", _velocities[_currentBufferIndex].getTexture());
-    _updateVelocityShader.setParameter("bufferSize", bufferSize);
-    _updateVelocityShader.setParameter("dt", dt);
-    _updateVelocityShader.setParameter("mouse", _magnetPosition);
-    _updateVelocityShader.setParameter("maxSpeed", _maxSpeed);
-    _updateVelocityShader.setParameter("friction", std::pow(_friction, dt));
-    _updateVelocityShader.setParameter("attraction", _attraction);
-    renderStates.shader = &_updateVelocityShader;
-    _velocities[nextBufferIndex].draw (square, renderStates);
-
-    _updatePositionShader.setParameter("oldPositions", _positions[_currentBufferIndex].getTexture());
-    _updatePositionShader.setParameter("velocities", _velocities[nextBufferIndex].getTexture());
-    _updatePositionShader.setParameter("bufferSize", bufferSize);
-    _updatePositionShader.setParameter("dt", dt);
-    renderStates.shader = &_updatePositionShader;
-    _positions[nextBufferIndex].draw (square, renderStates);
+    _passTimer.begin(PassTimer::StatePass);
+    runTransformFeedback(_transformFeedbackUpdateProgram,
+                         _transformFeedbackBufferIDs[_currentBufferIndex],
+                         _transformFeedbackBufferIDs[nextBufferIndex]);
+    _passTimer.end(PassTimer::StatePass);
 
     _currentBufferIndex = nextBufferIndex;
 }
 
-void Particles::draw(sf::RenderWindow &window, Camera const& camera) const
+void Particles::runTransformFeedback(GLProgram const& program, GLuint sourceBufferID, GLuint destinationBufferID) const
+{
+    GLProgram::bind(&program);
+
+    /* No source buffer for the initialization, which only uses gl_VertexID:
+     * like FullscreenPass, it draws with an empty vertex array object */
+    GLint positionAttributeID = _transformFeedbackPositionAttributeID;
+    GLint velocityAttributeID = _transformFeedbackVelocityAttributeID;
+    if (sourceBufferID == 0) {
+        GLCHECK(glBindVertexArray(_transformFeedbackVertexArrayID));
+    } else {
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, sourceBufferID));
+        GLCHECK(glEnableVertexAttribArray(positionAttributeID));
+        GLCHECK(glVertexAttribPointer(positionAttributeID, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0));
+        GLCHECK(glEnableVertexAttribArray(velocityAttributeID));
+        GLCHECK(glVertexAttribPointer(velocityAttributeID, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)sizeof(glm::vec2)));
+    }
+
+    GLCHECK(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, destinationBufferID));
+    GLCHECK(glEnable(GL_RASTERIZER_DISCARD));
+    GLCHECK(glBeginTransformFeedback(GL_POINTS));
+    GLCHECK(glDrawArrays(GL_POINTS, 0, getNbParticles()));
+    GLCHECK(glEndTransformFeedback());
+    GLCHECK(glDisable(GL_RASTERIZER_DISCARD));
+    GLCHECK(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0));
+
+    if (sourceBufferID == 0) {
+        GLCHECK(glBindVertexArray(0));
+    } else {
+        GLCHECK(glDisableVertexAttribArray(positionAttributeID));
+        GLCHECK(glDisableVertexAttribArray(velocityAttributeID));
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+    GLProgram::bind(nullptr);
+}
+
+void Particles::readPositions(std::vector<glm::vec2>& positions) const
+{
+    positions.resize(getNbParticles());
+
+    if (_backend == Backend::CPU) {
+        _cpuSimulation->copyPositions(positions.data());
+    } else if (_backend == Backend::ComputeShader || _backend == Backend::TransformFeedback) {
+        /* xy of the vec4 of each particle */
+        GLuint bufferID = (_backend == Backend::ComputeShader) ? _stateBufferIDs[_currentBufferIndex]
+                                                               : _transformFeedbackBufferIDs[_currentBufferIndex];
+        std::vector<glm::vec4> states(getNbParticles());
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, bufferID));
+        GLCHECK(glGetBufferSubData(GL_ARRAY_BUFFER, 0, states.size()*sizeof(glm::vec4), states.data()));
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        for (std::size_t i = 0 ; i < states.size() ; ++i)
+            positions[i] = glm::vec2(states[i].x, states[i].y);
+    } else {
+        GLCHECK(glBindTexture(GL_TEXTURE_2D, _positions[_currentBufferIndex].getNativeHandle()));
+        GLCHECK(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+        if (_storage != Storage::Packed) {
+            GLCHECK(glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, positions.data()));
+        } else {
+            /* Same decoding as colorToCoords() of utils.glsl */
+            const float MAX_POSITION = 4096.f;
+            std::vector<unsigned char> texels(4 * getNbParticles());
+            GLCHECK(glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data()));
+            for (std::size_t i = 0 ; i < positions.size() ; ++i) {
+                unsigned char const* texel = &texels[4 * i];
+                glm::vec2 scaledCoords(256.f * texel[0] + texel[1], 256.f * texel[2] + texel[3]);
+                positions[i] = (scaledCoords / 65535.f - glm::vec2(0.5f)) * MAX_POSITION;
+            }
+        }
+        GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+}
+
+std::uint64_t Particles::computeStateHash() const
+{
+    TRACE_ZONE("hash state");
+    const std::int64_t accumulatedTime = _accumulatedTime.asMicroseconds();
+    const GLuint currentBufferIndex = _currentBufferIndex;
+    std::uint64_t hash = hashBytes(&accumulatedTime, sizeof(accumulatedTime));
+    hash = hashBytes(&currentBufferIndex, sizeof(currentBufferIndex), hash);
+
+    /* The same chunks as saveCheckpoint(), read synchronously */
+    const std::size_t chunkSize = getCheckpointChunkSize();
+    if (_backend == Backend::CPU) {
+        std::vector<float> state(chunkSize / sizeof(float));
+        _cpuSimulation->saveState(state.data());
+        hash = hashBytes(state.data(), chunkSize, hash);
+    } else if (_backend == Backend::FragmentShaders) {
+        GLenum format, type;
+        std::size_t texelSize;
+        getStateTexelFormat(_storage, format, type, texelSize);
+        std::vector<unsigned char> chunk(chunkSize);
+        GLCHECK(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+        for (GLTexture const* texture : {&_positions[0], &_positions[1], &_velocities[0], &_velocities[1]}) {
+            GLCHECK(glBindTexture(GL_TEXTURE_2D, texture->getNativeHandle()));
+            GLCHECK(glGetTexImage(GL_TEXTURE_2D, 0, format, type, chunk.data()));
+            hash = hashBytes(chunk.data(), chunkSize, hash);
+        }
+        GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
+    } else {
+        std::array<GLuint, 2> const& stateBufferIDs = (_backend == Backend::ComputeShader) ? _stateBufferIDs : _transformFeedbackBufferIDs;
+        std::vector<unsigned char> chunk(chunkSize);
+        for (GLuint stateBufferID : stateBufferIDs) {
+            GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, stateBufferID));
+            GLCHECK(glGetBufferSubData(GL_ARRAY_BUFFER, 0, chunkSize, chunk.data()));
+            hash = hashBytes(chunk.data(), chunkSize, hash);
+        }
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+    return hash;
+}
+
+bool Particles::saveCheckpoint(std::string const& path)
+{
+    if (_emitters)
+        throw std::runtime_error("checkpoints aren't supported with emitters");
+
+    pollCheckpoint(false);
+    if (_checkpointCopying || _checkpointWriting)
+        return false;
+    _checkpointPath = path;
+    _checkpointError.clear();
+
+    /* Zeroed, so that the unused attractors don't write garbage */
+    CheckpointParameters& parameters = _checkpointParameters;
+    parameters = CheckpointParameters();
+    parameters.timeStep = _timeStep.asMicroseconds();
+    parameters.accumulatedTime = _accumulatedTime.asMicroseconds();
+    parameters.backend = static_cast<GLuint>(_backend);
+    parameters.storage = static_cast<GLuint>(_storage);
+    parameters.width = _buffersSize.x;
+    parameters.height = _buffersSize.y;
+    parameters.currentBufferIndex = _currentBufferIndex;
+    parameters.maxSubsteps = _maxSubsteps;
+    parameters.interpolation = _interpolation;
+    parameters.maxSpeed = _maxSpeed;
+    parameters.attraction = _attraction;
+    parameters.friction = _friction;
+    parameters.magnetPosition = glm::vec2(_magnetPosition.x, _magnetPosition.y);
+    parameters.forceModel = static_cast<GLuint>(_forceModel);
+    parameters.gravity = _gravity;
+    parameters.neighbourForces = _neighbourParameters;
+    parameters.nbAttractors = _attractors.size();
+    std::copy(_attractors.begin(), _attractors.end(), parameters.attractors);
+
+    /* The copies are queued after the last steps, and read once done */
+    const std::size_t chunkSize = getCheckpointChunkSize();
+    if (_backend == Backend::CPU) {
+        _checkpointState.resize(chunkSize / sizeof(float));
+        _cpuSimulation->saveState(_checkpointState.data());
+    } else if (_backend == Backend::FragmentShaders) {
+        GLenum format, type;
+        std::size_t texelSize;
+        getStateTexelFormat(_storage, format, type, texelSize);
+        GLCHECK(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+        for (GLTexture const* texture : {&_positions[0], &_positions[1], &_velocities[0], &_velocities[1]}) {
+            _checkpointBufferIDs.push_back(createReadbackBuffer(GL_PIXEL_PACK_BUFFER, chunkSize));
+            GLCHECK(glBindTexture(GL_TEXTURE_2D, texture->getNativeHandle()));
+            GLCHECK(glGetTexImage(GL_TEXTURE_2D, 0, format, type, nullptr));
+        }
+        GLCHECK(glBindTexture(GL_TEXTURE_2D, 0));
+        GLCHECK(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    } else {
+        std::array<GLuint, 2> const& stateBufferIDs = (_backend == Backend::ComputeShader) ? _stateBufferIDs : _transformFeedbackBufferIDs;
+        for (GLuint stateBufferID : stateBufferIDs) {
+            _checkpointBufferIDs.push_back(createReadbackBuffer(GL_COPY_WRITE_BUFFER, chunkSize));
+            GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, stateBufferID));
+            GLCHECK(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, chunkSize));
+        }
+        GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+        GLCHECK(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    }
+    _checkpointCopying = true;
+
+    /* Without a fence, the buffers are mapped at the next step, which waits for the copies */
+    if (_backend == Backend::CPU) {
+        startWritingCheckpoint();
+    } else if (GLEW_ARB_sync) {
+        GLCHECK(_checkpointFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        GLCHECK(glFlush());
+    }
+    return true;
+}
+
+bool Particles::isSavingCheckpoint()
+{
+    pollCheckpoint(false);
+    if (!_checkpointError.empty()) {
+        std::string error;
+        error.swap(_checkpointError);
+        throw std::runtime_error(error);
+    }
+    return _checkpointCopying || _checkpointWriting;
+}
+
+void Particles::finishCheckpoint()
+{
+    pollCheckpoint(true);
+    isSavingCheckpoint();
+}
+
+void Particles::loadCheckpoint(std::string const& path)
+{
+    TRACE_ZONE("load checkpoint");
+    if (_emitters)
+        throw std::runtime_error("checkpoints aren't supported with emitters");
+
+    CheckpointFile file(path);
+    std::vector<CheckpointFile::Chunk> const& chunks = file.getChunks();
+    CheckpointParameters parameters;
+    if (chunks.empty() || chunks[0].size != sizeof(parameters))
+        throw std::runtime_error(path + " isn't a checkpoint of particles");
+    std::memcpy(&parameters, chunks[0].data, sizeof(parameters));
+
+    bool matching = (parameters.backend == static_cast<GLuint>(_backend) &&
+                     parameters.width == _buffersSize.x && parameters.height == _buffersSize.y &&
+                     (_backend != Backend::FragmentShaders || parameters.storage == static_cast<GLuint>(_storage)) &&
+                     chunks.size() == 1 + getNbCheckpointChunks());
+    for (std::size_t i = 1 ; matching && i < chunks.size() ; ++i)
+        matching = (chunks[i].size == getCheckpointChunkSize());
+    if (!matching)
+        throw std::runtime_error(path + " is a checkpoint of particles of another size, backend or storage");
+    if (parameters.nbAttractors > _maxAttractors)
+        throw std::runtime_error(path + " has more attractors than the particles support");
+
+    /* Straight from the mapping to the driver */
+    if (_backend == Backend::CPU) {
+        _cpuSimulation->loadState(static_cast<float const*>(chunks[1].data));
+    } else if (_backend == Backend::FragmentShaders) {
+        GLenum format, type;
+        std::size_t texelSize;
+        getStateTexelFormat(_storage, format, type, texelSize);
+
+        GLuint unpackBufferID = 0;
+        GLCHECK(glGenBuffers(1, &unpackBufferID));
+        GLCHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBufferID));
+        GLCHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        std::array<GLTexture*, 4> textures = {{&_positions[0], &_positions[1], &_velocities[0], &_velocities[1]}};
+        for (std::size_t i = 0 ; i < textures.size() ; ++i) {
+            GLCHECK(glBufferData(GL_PIXEL_UNPACK_BUFFER, chunks[1 + i].size, chunks[1 + i].data, GL_STREAM_DRAW));
+            textures[i]->update(format, type, nullptr);
+        }
+        GLCHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        GLCHECK(glDeleteBuffers(1, &unpackBufferID));
+    } else {
+        std::array<GLuint, 2> const& stateBufferIDs = (_backend == Backend::ComputeShader) ? _stateBufferIDs : _transformFeedbackBufferIDs;
+        for (std::size_t i = 0 ; i < stateBufferIDs.size() ; ++i) {
+            GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, stateBufferIDs[i]));
+            GLCHECK(glBufferSubData(GL_ARRAY_BUFFER, 0, chunks[1 + i].size, chunks[1 + i].data));
+        }
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+
+    _timeStep = sf::microseconds(parameters.timeStep);
+    _accumulatedTime = sf::microseconds(parameters.accumulatedTime);
+    _currentBufferIndex = parameters.currentBufferIndex % 2;
+    _maxSubsteps = parameters.maxSubsteps;
+    _interpolation = parameters.interpolation;
+    _maxSpeed = parameters.maxSpeed;
+    _attraction = parameters.attraction;
+    _friction = parameters.friction;
+    _magnetPosition = sf::Vector2f(parameters.magnetPosition.x, parameters.magnetPosition.y);
+    _forceModel = static_cast<ForceModel>(parameters.forceModel);
+    _gravity = parameters.gravity;
+    _neighbourParameters = parameters.neighbourForces;
+    _attractors.assign(parameters.attractors, parameters.attractors + parameters.nbAttractors);
+
+    if (_backend == Backend::CPU)
+        uploadCPUPositions();
+}
+
+unsigned int Particles::getNbCheckpointChunks() const
+{
+    /* Both textures of each pair, both buffers, or the arrays of the CPU backend at once */
+    if (_backend == Backend::FragmentShaders)
+        return 4;
+    return (_backend == Backend::CPU) ? 1 : 2;
+}
+
+std::size_t Particles::getCheckpointChunkSize() const
+{
+    if (_backend == Backend::CPU)
+        return CPUSimulation::STATE_ARRAYS * getNbParticles() * sizeof(float);
+    if (_backend != Backend::FragmentShaders)
+        return getNbParticles() * sizeof(glm::vec4);
+
+    GLenum format, type;
+    std::size_t texelSize;
+    getStateTexelFormat(_storage, format, type, texelSize);
+    return getNbParticles() * texelSize;
+}
+
+void Particles::pollCheckpoint(bool wait)
+{
+    if (_checkpointCopying) {
+        if (_checkpointFence != nullptr) {
+            GLenum status = GL_TIMEOUT_EXPIRED;
+            do {
+                GLCHECK(status = glClientWaitSync(_checkpointFence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                                  wait ? CHECKPOINT_WAIT_TIMEOUT : 0));
+            } while (wait && status == GL_TIMEOUT_EXPIRED);
+            if (status == GL_TIMEOUT_EXPIRED)
+                return;
+        }
+        startWritingCheckpoint();
+    }
+
+    if (_checkpointWriting) {
+        try {
+            if (wait)
+                _checkpointWriter.wait();
+            else if (!_checkpointWriter.poll())
+                return;
+        } catch (std::exception const& e) {
+            _checkpointError = e.what();
+        }
+        releaseCheckpointCopy();
+    }
+}
+
+void Particles::startWritingCheckpoint()
+{
+    _checkpointCopying = false;
+    _checkpointWriting = true;
+
+    std::vector<CheckpointFile::Chunk> chunks = {{&_checkpointParameters, sizeof(CheckpointParameters)}};
+    if (_backend == Backend::CPU)
+        chunks.push_back({_checkpointState.data(), _checkpointState.size() * sizeof(float)});
+
+    /* Mapped until written */
+    for (GLuint bufferID : _checkpointBufferIDs) {
+        void* mapping = nullptr;
+        GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, bufferID));
+        GLCHECK(mapping = glMapBufferRange(GL_COPY_READ_BUFFER, 0, getCheckpointChunkSize(), GL_MAP_READ_BIT));
+        if (mapping == nullptr) {
+            _checkpointError = "unable to map the copy of the state";
+            releaseCheckpointCopy();
+            return;
+        }
+        chunks.push_back({mapping, getCheckpointChunkSize()});
+    }
+    if (!_checkpointBufferIDs.empty())
+        GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+
+    _checkpointWriter.start(_checkpointPath, chunks);
+}
+
+void Particles::releaseCheckpointCopy()
+{
+    for (GLuint bufferID : _checkpointBufferIDs) {
+        GLint mapped = GL_FALSE;
+        GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, bufferID));
+        GLCHECK(glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_MAPPED, &mapped));
+        if (mapped)
+            GLCHECK(glUnmapBuffer(GL_COPY_READ_BUFFER));
+        GLCHECK(glDeleteBuffers(1, &bufferID));
+    }
+    if (!_checkpointBufferIDs.empty())
+        GLCHECK(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+    _checkpointBufferIDs.clear();
+    std::vector<float>().swap(_checkpointState);
+
+    if (_checkpointFence != nullptr)
+        GLCHECK(glDeleteSync(_checkpointFence));
+    _checkpointFence = nullptr;
+    _checkpointCopying = false;
+    _checkpointWriting = false;
+}
+
+void Particles::draw(sf::RenderWindow &window, Camera const& camera, bool clear) const
 {
     window.setActive(true);
 
-    GLCHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    /* The simulation passes set the viewport to the buffers' size */
+    GLFramebuffer::bind(nullptr);
+    GLCHECK(glViewport(0, 0, window.getSize().x, window.getSize().y));
 
-    _displayVerticesShader.setParameter("positions", _positions[_currentBufferIndex].getTexture());
-    sf::Shader::bind(&_displayVerticesShader);
+    if (clear)
+        GLCHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    drawParticles(camera);
+}
 
-    /* First we retrieve the shader program's, Attributes' and Uniforms' ID */
-    GLuint displayShaderID = 0;
-    GLCHECK(displayShaderID = _displayVerticesShader.getNativeHandle());
+void Particles::draw(GLFramebuffer const& target, Camera const& camera, bool clear) const
+{
+    GLFramebuffer::bind(&target);
+    if (clear)
+        GLCHECK(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    drawParticles(camera);
+    GLFramebuffer::bind(nullptr);
+}
 
-    GLuint texCoordAttributeID = 0, colorAttributeID = 0, viewMatrixUniformID = 0;
-    GLCHECK(texCoordAttributeID = glGetAttribLocation(displayShaderID, "coordsOnBuffer"));
-    GLCHECK(colorAttributeID = glGetAttribLocation(displayShaderID, "color"));
-    GLCHECK(viewMatrixUniformID = glGetUniformLocation(displayShaderID, "viewMatrix"));
+void Particles::drawParticles(Camera const& camera) const
+{
+    int previousBufferIndex = (_currentBufferIndex + 1) % 2;
 
-//    std::cout << "shaderID : " << displayShaderID << std::endl;
-//    std::cout << "texCoord ; color ; viewMatrix  ->  " << texCoordAttributeID << " ; " << colorAttributeID << " ; " << viewMatrixUniformID << std::endl;
+    GLProgram::bind(&_displayVerticesProgram);
+    if (_backend == Backend::FragmentShaders) {
+        GLTexture::bind(&_positions[_currentBufferIndex], 0);
+        GLTexture::bind(&_positions[previousBufferIndex], 2);
+    }
 
     /* Sending the view matrix */
-    GLCHECK(glUniformMatrix3fv(viewMatrixUniformID, 1, GL_FALSE, &camera.getViewMatrix()[0][0]));
+    GLCHECK(glUniformMatrix3fv(_viewMatrixLocation, 1, GL_FALSE, &camera.getViewMatrix()[0][0]));
+    GLCHECK(glUniform1f(_interpolationLocation, _interpolation));
 
-    /* Enabling texture coordinates buffer */
-    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _texCoordBufferID));
-    GLCHECK(glEnableVertexAttribArray(texCoordAttributeID));
-    GLCHECK(glVertexAttribPointer(texCoordAttributeID, 2, GL_FLOAT, GL_FALSE, 0, (void*)0));
+    /* Enabling the buffer locating each particle: either its position, or
+     * its coordinates on the positions texture. None with gl_VertexID addressing */
+    if (_locationAttributeID >= 0) {
+        if (_backend == Backend::CPU) {
+            /* Positions buffer, filled by the CPU */
+            GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _positionBufferID));
+            GLCHECK(glEnableVertexAttribArray(_locationAttributeID));
+            GLCHECK(glVertexAttribPointer(_locationAttributeID, 2, GL_FLOAT, GL_FALSE, 0, (void*)0));
+        } else if (_backend == Backend::ComputeShader || _backend == Backend::TransformFeedback) {
+            /* The state buffers are read directly as vertex buffers: positions are
+             * the first two components of each vec4 */
+            std::array<GLuint, 2> const& stateBufferIDs = (_backend == Backend::ComputeShader) ? _stateBufferIDs : _transformFeedbackBufferIDs;
+            GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, stateBufferIDs[_currentBufferIndex]));
+            GLCHECK(glEnableVertexAttribArray(_locationAttributeID));
+            GLCHECK(glVertexAttribPointer(_locationAttributeID, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0));
+            GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, stateBufferIDs[previousBufferIndex]));
+            GLCHECK(glEnableVertexAttribArray(_previousPositionAttributeID));
+            GLCHECK(glVertexAttribPointer(_previousPositionAttributeID, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0));
+        } else {
+            /* Texture coordinates buffer */
+            GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _texCoordBufferID));
+            GLCHECK(glEnableVertexAttribArray(_locationAttributeID));
+            GLCHECK(glVertexAttribPointer(_locationAttributeID, 2, GL_FLOAT, GL_FALSE, 0, (void*)0));
+        }
+    }
 
-    /* Enabling color buffer */
-    GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _colorBufferID));
-    GLCHECK(glEnableVertexAttribArray(colorAttributeID));
-    GLCHECK(glVertexAttribPointer(colorAttributeID, 4, GL_FLOAT, GL_FALSE, 0, (void*)0));
+    /* Enabling colors, either from a texture or from the color buffer */
+    if (_colorsFromTexture) {
+        GLTexture::bind(&_colorTexture, 1);
+    } else {
+        GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, _colorBufferID));
+        GLCHECK(glEnableVertexAttribArray(_colorAttributeID));
+        GLCHECK(glVertexAttribPointer(_colorAttributeID, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, (void*)0));
+    }
 
     GLCHECK(glPointSize(1.f));
 
-    /* Actual drawing */
-    GLCHECK(glDrawArrays(GL_POINTS, 0, getNbParticles()));
+    /* Actual drawing. With emitters, only the live particles, whose
+     * indices and count were written by the last step */
+    _passTimer.begin(PassTimer::DrawPass);
+    if (_emitters) {
+        GLCHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _liveIndicesBufferID));
+        GLCHECK(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _emissionCountersBufferID));
+        GLCHECK(glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, nullptr));
+        GLCHECK(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+        GLCHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    } else {
+        GLCHECK(glDrawArrays(GL_POINTS, 0, getNbParticles()));
+    }
+    _passTimer.end(PassTimer::DrawPass);
 
-    /* Don't forget to unbind buffers */
+    /* Don't forget to unbind buffers: the state buffers of the transform
+     * feedback backend can't stay attached while they are written */
+    if (_locationAttributeID >= 0)
+        GLCHECK(glDisableVertexAttribArray(_locationAttributeID));
+    if (_previousPositionAttributeID >= 0)
+        GLCHECK(glDisableVertexAttribArray(_previousPositionAttributeID));
+    if (_colorAttributeID >= 0)
+        GLCHECK(glDisableVertexAttribArray(_colorAttributeID));
     GLCHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    GLProgram::bind(nullptr);
 
 
 //    window.setActive(true);
@@ -0,0 +1,242 @@
+#include "PassTimer.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "GLCheck.hpp"
+
+
+float PassTimer::Statistics::getBinUpperBound(unsigned int bin)
+{
+    /* Doubles from 1/32 ms to 32 ms, the last bin is unbounded */
+    static const float bounds[NB_BINS] = {0.03125f, 0.0625f, 0.125f, 0.25f, 0.5f, 1.f,
+                                          2.f, 4.f, 8.f, 16.f, 32.f, 1e30f};
+    return bounds[std::min(bin, NB_BINS - 1)];
+}
+
+PassTimer::PassTimer():
+            _enabled (false),
+            _source (Source::CPUClock)
+#ifdef PARTICLES_TRACE
+            , _gpuClockOffset (0),
+            _nbCollectsSinceCalibration (0)
+#endif
+{
+    for (PassRecord &record : _passes) {
+        record.queryIDs.fill(0);
+        record.firstPending = 0;
+        record.nbPending = 0;
+        record.measuring = false;
+        record.cpuPass = false;
+        record.nextSample = 0;
+    }
+}
+
+PassTimer::~PassTimer()
+{
+    for (PassRecord &record : _passes) {
+        if (record.queryIDs[0] != 0)
+            GLCHECK(glDeleteQueries(record.queryIDs.size(), record.queryIDs.data()));
+    }
+}
+
+void PassTimer::enable(Source source)
+{
+    if (source == Source::GPUQueries && !GLEW_VERSION_3_3 && !GLEW_ARB_timer_query)
+        source = Source::CPUClock;
+
+    if (source == Source::GPUQueries) {
+        for (PassRecord &record : _passes) {
+            if (record.queryIDs[0] == 0)
+                GLCHECK(glGenQueries(record.queryIDs.size(), record.queryIDs.data()));
+        }
+#ifdef PARTICLES_TRACE
+        calibrateGPUClock();
+#endif
+    }
+
+    _enabled = true;
+    _source = source;
+}
+
+bool PassTimer::isEnabled() const
+{
+    return _enabled;
+}
+
+PassTimer::Source PassTimer::getSource() const
+{
+    return _source;
+}
+
+const char* PassTimer::getPassName(Pass pass)
+{
+    switch (pass) {
+        case VelocityPass:
+            return "velocity";
+        case PositionPass:
+            return "position";
+        case BinningPass:
+            return "binning";
+        case EmissionPass:
+            return "emission";
+        case StatePass:
+            return "state";
+        case UploadPass:
+            return "upload";
+        case DrawPass:
+            return "draw";
+        case NB_PASSES:
+            break;
+    }
+    return "unknown";
+}
+
+void PassTimer::begin(Pass pass, bool cpuPass)
+{
+    if (!_enabled)
+        return;
+
+    PassRecord &record = _passes[pass];
+    record.cpuPass = cpuPass || _source == Source::CPUClock;
+
+    if (record.cpuPass) {
+        record.cpuBegin = std::chrono::steady_clock::now();
+        record.measuring = true;
+        return;
+    }
+
+    /* Ring full: skipped rather than waiting for the oldest results */
+    if (record.nbPending == RING_SIZE)
+        collect();
+    if (record.nbPending == RING_SIZE)
+        return;
+
+    unsigned int slot = (record.firstPending + record.nbPending) % RING_SIZE;
+    GLCHECK(glQueryCounter(record.queryIDs[2*slot], GL_TIMESTAMP));
+    record.measuring = true;
+}
+
+void PassTimer::end(Pass pass)
+{
+    PassRecord &record = _passes[pass];
+    if (!_enabled || !record.measuring)
+        return;
+    record.measuring = false;
+
+    if (record.cpuPass) {
+        /* The GPU part of the pass is included, unless it's a pure CPU pass */
+        if (_source == Source::CPUClock)
+            GLCHECK(glFinish());
+        std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - record.cpuBegin;
+        addSample(pass, duration.count());
+        return;
+    }
+
+    unsigned int slot = (record.firstPending + record.nbPending) % RING_SIZE;
+    GLCHECK(glQueryCounter(record.queryIDs[2*slot + 1], GL_TIMESTAMP));
+    ++record.nbPending;
+}
+
+void PassTimer::collect()
+{
+    if (!_enabled || _source != Source::GPUQueries)
+        return;
+
+#ifdef PARTICLES_TRACE
+    if (++_nbCollectsSinceCalibration == 256)
+        calibrateGPUClock();
+#endif
+
+    for (unsigned int pass = 0 ; pass < NB_PASSES ; ++pass) {
+        PassRecord &record = _passes[pass];
+        while (record.nbPending > 0) {
+            unsigned int slot = record.firstPending;
+
+            /* Results are available in order: the end of the oldest
+             * slot is the first one to check */
+            GLint available = GL_FALSE;
+            GLCHECK(glGetQueryObjectiv(record.queryIDs[2*slot + 1], GL_QUERY_RESULT_AVAILABLE, &available));
+            if (available == GL_FALSE)
+                break;
+
+            GLuint64 beginTime = 0, endTime = 0;
+            GLCHECK(glGetQueryObjectui64v(record.queryIDs[2*slot], GL_QUERY_RESULT, &beginTime));
+            GLCHECK(glGetQueryObjectui64v(record.queryIDs[2*slot + 1], GL_QUERY_RESULT, &endTime));
+            addSample(static_cast<Pass>(pass), static_cast<float>(endTime - beginTime) * 1e-6f);
+#ifdef PARTICLES_TRACE
+            Tracer::addGPUZone(getPassName(static_cast<Pass>(pass)),
+                               static_cast<GLint64>(beginTime) + _gpuClockOffset,
+                               static_cast<GLint64>(endTime) + _gpuClockOffset);
+#endif
+
+            record.firstPending = (record.firstPending + 1) % RING_SIZE;
+            --record.nbPending;
+        }
+    }
+}
+
+void PassTimer::addSample(Pass pass, float duration)
+{
+    PassRecord &record = _passes[pass];
+    if (record.samples.size() < WINDOW_SIZE)
+        record.samples.push_back(duration);
+    else
+        record.samples[record.nextSample] = duration;
+    record.nextSample = (record.nextSample + 1) % WINDOW_SIZE;
+}
+
+#ifdef PARTICLES_TRACE
+void PassTimer::calibrateGPUClock()
+{
+    /* Unlike timestamp queries, this returns the GPU time when the
+     * commands issued so far reach the GPU, without waiting for them */
+    GLint64 gpuTime = 0;
+    GLCHECK(glGetInteger64v(GL_TIMESTAMP, &gpuTime));
+    _gpuClockOffset = Tracer::now() - gpuTime;
+    _nbCollectsSinceCalibration = 0;
+}
+#endif
+
+PassTimer::Statistics PassTimer::getStatistics(Pass pass) const
+{
+    Statistics statistics;
+    statistics.nbSamples = _passes[pass].samples.size();
+    statistics.average = 0.f;
+    statistics.max = 0.f;
+    statistics.histogram.fill(0);
+
+    for (float sample : _passes[pass].samples) {
+        statistics.average += sample;
+        statistics.max = std::max(statistics.max, sample);
+
+        unsigned int bin = 0;
+        while (sample > Statistics::getBinUpperBound(bin))
+            ++bin;
+        ++statistics.histogram[bin];
+    }
+    if (statistics.nbSamples > 0)
+        statistics.average /= static_cast<float>(statistics.nbSamples);
+
+    return statistics;
+}
+
+void PassTimer::printReport(std::ostream& stream) const
+{
+    stream << "pass timings (" << (_source == Source::GPUQueries ? "GPU queries" : "CPU clock")
+           << ", last " << WINDOW_SIZE << " samples), histogram bins up to "
+           << Statistics::getBinUpperBound(0) << " ms doubling:" << std::endl;
+
+    for (unsigned int pass = 0 ; pass < NB_PASSES ; ++pass) {
+        Statistics statistics = getStatistics(static_cast<Pass>(pass));
+        if (statistics.nbSamples == 0)
+            continue;
+
+        stream << "  " << std::setw(8) << getPassName(static_cast<Pass>(pass)) << ": "
+               << std::fixed << std::setprecision(3) << statistics.average << " ms avg, "
+               << statistics.max << " ms max  [";
+        for (unsigned int bin = 0 ; bin < Statistics::NB_BINS ; ++bin)
+            stream << (bin > 0 ? " " : "") << statistics.histogram[bin];
+        stream << "]" << std::defaultfloat << std::endl;
+    }
+}
@@ -0,0 +1,183 @@
+#include "ProgramCache.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include "GLCheck.hpp"
+#include "Tracer.hpp"
+#include "Utilities.hpp"
+
+
+namespace
+{
+    const char MAGIC[8] = {'P', 'A', 'R', 'T', 'P', 'R', 'O', 'G'};
+
+    /* At the beginning of each file, followed by the binary */
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint64_t key;
+        std::uint32_t binaryFormat;
+        std::uint32_t binaryLength;
+    };
+
+    /* With its terminating null, so that consecutive strings can't be confused */
+    std::uint64_t hashString(std::string const& string, std::uint64_t hash)
+    {
+        return hashBytes(string.c_str(), string.size() + 1, hash);
+    }
+
+    std::string getDriverString(GLenum name)
+    {
+        GLubyte const* string = nullptr;
+        GLCHECK(string = glGetString(name));
+        return (string != nullptr) ? reinterpret_cast<char const*>(string) : "";
+    }
+}
+
+
+ProgramCache::ProgramCache(std::string const& directory):
+            _directory (directory),
+            _available (false),
+            _nbLoaded (0),
+            _nbCompiled (0)
+{
+    _driver = getDriverString(GL_VENDOR) + '\n' + getDriverString(GL_RENDERER) + '\n' + getDriverString(GL_VERSION);
+
+    /* Some drivers support the entry points without any binary format */
+    GLint nbFormats = 0;
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+        GLCHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbFormats));
+    if (nbFormats <= 0) {
+        std::cerr << "The driver can't save programs, they are compiled at every launch" << std::endl;
+        return;
+    }
+
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Unable to create " << directory << ", programs are compiled at every launch" << std::endl;
+        return;
+    }
+    _available = true;
+}
+
+bool ProgramCache::isAvailable() const
+{
+    return _available;
+}
+
+std::uint64_t ProgramCache::computeKey(std::vector<GLProgram::Source> const& sources,
+                                       std::vector<std::string> const& feedbackVaryings) const
+{
+    std::uint64_t hash = hashString(_driver, FNV_OFFSET_BASIS);
+    for (GLProgram::Source const& source : sources) {
+        const std::uint32_t stage = source.first;
+        hash = hashBytes(&stage, sizeof(stage), hash);
+        hash = hashString(source.second, hash);
+    }
+    for (std::string const& varying : feedbackVaryings)
+        hash = hashString(varying, hash);
+    return hash;
+}
+
+GLuint ProgramCache::load(std::uint64_t key)
+{
+    TRACE_ZONE("load program binary");
+    std::ifstream file(getPath(key), std::ios::binary | std::ios::ate);
+    if (!_available || !file.is_open()) {
+        ++_nbCompiled;
+        return 0;
+    }
+    const std::streamoff fileSize = file.tellg();
+    file.seekg(0);
+
+    /* A length past the end of the file, corrupted, isn't allocated */
+    FileHeader header;
+    std::vector<char> binary;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.key == key &&
+        static_cast<std::streamoff>(header.binaryLength) <= fileSize - static_cast<std::streamoff>(sizeof(header))) {
+        binary.resize(header.binaryLength);
+        if (!file.read(binary.data(), binary.size()))
+            binary.clear();
+    }
+
+    GLuint programID = 0;
+    GLint linked = GL_FALSE;
+    if (!binary.empty()) {
+        GLCHECK(programID = glCreateProgram());
+        GLCHECK(glProgramBinary(programID, header.binaryFormat, binary.data(), binary.size()));
+        GLCHECK(glGetProgramiv(programID, GL_LINK_STATUS, &linked));
+    }
+
+    /* Truncated, or made by another build of the driver */
+    if (linked == GL_FALSE) {
+        if (programID != 0)
+            GLCHECK(glDeleteProgram(programID));
+        ++_nbCompiled;
+        return 0;
+    }
+
+    ++_nbLoaded;
+    return programID;
+}
+
+void ProgramCache::store(std::uint64_t key, GLuint programID)
+{
+    if (!_available)
+        return;
+
+    TRACE_ZONE("store program binary");
+    GLint binaryLength = 0;
+    GLCHECK(glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength));
+    if (binaryLength <= 0)
+        return;
+
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.key = key;
+    GLenum binaryFormat = 0;
+    std::vector<char> binary(binaryLength);
+    GLsizei length = 0;
+    GLCHECK(glGetProgramBinary(programID, binary.size(), &length, &binaryFormat, binary.data()));
+    header.binaryFormat = binaryFormat;
+    header.binaryLength = length;
+
+    /* Renamed once complete, so that a launch never reads half a binary */
+    const std::string path = getPath(key);
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        file.close();
+        if (!file) {
+            std::cerr << "Unable to write " << temporaryPath << std::endl;
+            std::remove(temporaryPath.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+        std::cerr << "Unable to replace " << path << std::endl;
+}
+
+unsigned int ProgramCache::getNbLoaded() const
+{
+    return _nbLoaded;
+}
+
+unsigned int ProgramCache::getNbCompiled() const
+{
+    return _nbCompiled;
+}
+
+std::string ProgramCache::getPath(std::uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return _directory + "/" + name;
+}
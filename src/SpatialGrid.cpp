@@ -0,0 +1,141 @@
+#include "SpatialGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Tracer.hpp"
+
+
+namespace
+{
+    /* Buckets scanned by a thread at once by the prefix sum */
+    const std::size_t SCAN_BLOCK = 16384;
+
+    /* Particles binned by a thread at once */
+    const std::size_t BINNING_GRANULARITY = 1024;
+}
+
+
+std::uint32_t SpatialGrid::getNbBuckets(std::size_t nbParticles)
+{
+    std::uint32_t nbBuckets = MIN_BUCKETS;
+    while (nbBuckets < nbParticles && nbBuckets < MAX_BUCKETS)
+        nbBuckets *= 2;
+    return nbBuckets;
+}
+
+SpatialGrid::SpatialGrid(std::size_t nbParticles, ThreadPool& threadPool):
+            _nbParticles (nbParticles),
+            _nbBuckets (getNbBuckets(nbParticles)),
+            _bucketsWidth (1),
+            _cellSize (1.f),
+            _threadPool (threadPool),
+            _bucketCounts (new std::atomic<std::uint32_t>[_nbBuckets]),
+            _bucketStarts (_nbBuckets + 1, 0),
+            _blockOffsets ((_nbBuckets + SCAN_BLOCK - 1) / SCAN_BLOCK, 0),
+            _particleBuckets (nbParticles),
+            _particleRanks (nbParticles),
+            _sortedIndices (nbParticles)
+{
+    /* Square table, or twice as wide as high */
+    while (_bucketsWidth * _bucketsWidth < _nbBuckets)
+        _bucketsWidth *= 2;
+}
+
+std::uint32_t SpatialGrid::getNbBuckets() const
+{
+    return _nbBuckets;
+}
+
+std::int32_t SpatialGrid::getCell(float coordinate) const
+{
+    return static_cast<std::int32_t>(std::floor(coordinate / _cellSize));
+}
+
+std::uint32_t SpatialGrid::getBucket(std::int32_t cellX, std::int32_t cellY) const
+{
+    std::uint32_t x = static_cast<std::uint32_t>(cellX) & (_bucketsWidth - 1u);
+    std::uint32_t y = static_cast<std::uint32_t>(cellY) & (_nbBuckets / _bucketsWidth - 1u);
+    return y * _bucketsWidth + x;
+}
+
+void SpatialGrid::build(float const* positionsX, float const* positionsY, float cellSize)
+{
+    TRACE_ZONE("spatial grid");
+    _cellSize = cellSize;
+
+    _threadPool.parallelFor(_nbBuckets, [this](std::size_t begin, std::size_t end) {
+        for (std::size_t bucket = begin ; bucket < end ; ++bucket)
+            _bucketCounts[bucket].store(0, std::memory_order_relaxed);
+    }, SCAN_BLOCK);
+
+    /* Bucket of each particle, and its rank among the particles of the bucket */
+    _threadPool.parallelFor(_nbParticles, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; ++i) {
+            std::uint32_t bucket = getBucket(getCell(positionsX[i]), getCell(positionsY[i]));
+            _particleBuckets[i] = bucket;
+            _particleRanks[i] = _bucketCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+        }
+    }, BINNING_GRANULARITY);
+
+    /* Exclusive prefix sum of the counts: the sum of each block of buckets,
+     * then the offsets of the blocks, then the scan within each block */
+    const std::size_t nbBlocks = _blockOffsets.size();
+    _threadPool.parallelFor(nbBlocks, [this](std::size_t beginBlock, std::size_t endBlock) {
+        for (std::size_t block = beginBlock ; block < endBlock ; ++block) {
+            std::size_t end = std::min<std::size_t>((block + 1) * SCAN_BLOCK, _nbBuckets);
+            std::uint32_t sum = 0;
+            for (std::size_t bucket = block * SCAN_BLOCK ; bucket < end ; ++bucket)
+                sum += _bucketCounts[bucket].load(std::memory_order_relaxed);
+            _blockOffsets[block] = sum;
+        }
+    });
+
+    std::uint32_t offset = 0;
+    for (std::uint32_t &blockOffset : _blockOffsets) {
+        std::uint32_t sum = blockOffset;
+        blockOffset = offset;
+        offset += sum;
+    }
+
+    _threadPool.parallelFor(nbBlocks, [this](std::size_t beginBlock, std::size_t endBlock) {
+        for (std::size_t block = beginBlock ; block < endBlock ; ++block) {
+            std::size_t end = std::min<std::size_t>((block + 1) * SCAN_BLOCK, _nbBuckets);
+            std::uint32_t start = _blockOffsets[block];
+            for (std::size_t bucket = block * SCAN_BLOCK ; bucket < end ; ++bucket) {
+                _bucketStarts[bucket] = start;
+                start += _bucketCounts[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    });
+    _bucketStarts[_nbBuckets] = _nbParticles;
+
+    _threadPool.parallelFor(_nbParticles, [this](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; ++i)
+            _sortedIndices[_bucketStarts[_particleBuckets[i]] + _particleRanks[i]] = i;
+    }, BINNING_GRANULARITY);
+
+    /* The ranks depend on the order of the increments: buckets are small,
+     * sorting them makes the neighbour sums reproducible */
+    _threadPool.parallelFor(_nbBuckets, [this](std::size_t begin, std::size_t end) {
+        for (std::size_t bucket = begin ; bucket < end ; ++bucket) {
+            std::sort(_sortedIndices.begin() + _bucketStarts[bucket],
+                      _sortedIndices.begin() + _bucketStarts[bucket + 1]);
+        }
+    }, SCAN_BLOCK);
+}
+
+std::vector<std::uint32_t> const& SpatialGrid::getSortedIndices() const
+{
+    return _sortedIndices;
+}
+
+std::uint32_t SpatialGrid::getBucketBegin(std::uint32_t bucket) const
+{
+    return _bucketStarts[bucket];
+}
+
+std::uint32_t SpatialGrid::getBucketEnd(std::uint32_t bucket) const
+{
+    return _bucketStarts[bucket + 1];
+}
@@ -0,0 +1,115 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+#include "Tracer.hpp"
+
+ThreadPool::ThreadPool(unsigned int nbThreads):
+            _jobIndex (0),
+            _nbBusyWorkers (0),
+            _stopping (false),
+            _task (nullptr),
+            _count (0),
+            _chunkSize (1),
+            _nextChunk (0)
+{
+    if (nbThreads == 0)
+        nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 1 ; i < nbThreads ; ++i)
+        _workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _jobAvailable.notify_all();
+
+    for (std::thread &worker : _workers)
+        worker.join();
+}
+
+unsigned int ThreadPool::getNbThreads() const
+{
+    return _workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(std::size_t count,
+                             std::function<void(std::size_t, std::size_t)> const& task,
+                             std::size_t granularity)
+{
+    if (count == 0)
+        return;
+
+    /* Several chunks per thread so that faster threads can steal work */
+    std::size_t nbChunks = 4 * getNbThreads();
+    std::size_t chunkSize = (count + nbChunks - 1) / nbChunks;
+    granularity = std::max<std::size_t>(1, granularity);
+    chunkSize = ((chunkSize + granularity - 1) / granularity) * granularity;
+
+    if (_workers.empty() || chunkSize >= count) {
+        task(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _count = count;
+        _chunkSize = chunkSize;
+        _nextChunk = 0;
+        _nbBusyWorkers = _workers.size();
+        ++_jobIndex;
+    }
+    _jobAvailable.notify_all();
+
+    {
+        TRACE_ZONE("parallelFor");
+        processChunks();
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _jobDone.wait(lock, [this]() { return _nbBusyWorkers == 0; });
+    _task = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    TRACE_THREAD_NAME("worker");
+    unsigned long lastJobIndex = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _jobAvailable.wait(lock, [&]() { return _stopping || _jobIndex != lastJobIndex; });
+            if (_stopping)
+                return;
+            lastJobIndex = _jobIndex;
+        }
+
+        {
+            TRACE_ZONE("parallelFor");
+            processChunks();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            --_nbBusyWorkers;
+        }
+        _jobDone.notify_one();
+    }
+}
+
+void ThreadPool::processChunks()
+{
+    while (true) {
+        std::size_t begin = _nextChunk.fetch_add(_chunkSize);
+        if (begin >= _count)
+            return;
+
+        (*_task)(begin, std::min(begin + _chunkSize, _count));
+    }
+}
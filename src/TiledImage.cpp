@@ -0,0 +1,188 @@
+#include "TiledImage.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Tracer.hpp"
+
+
+namespace
+{
+    /* Values of the compression field of BITMAPINFOHEADER */
+    const std::uint32_t BI_RGB = 0;
+    const std::uint32_t BI_BITFIELDS = 3;
+    const std::uint32_t BI_ALPHABITFIELDS = 6;
+
+    /* BITMAPFILEHEADER, then BITMAPINFOHEADER at least */
+    const std::size_t FILE_HEADER_SIZE = 14;
+    const std::size_t MIN_INFO_HEADER_SIZE = 40;
+
+    /* Little endian fields */
+    template<typename T>
+    T readField(std::uint8_t const* bytes, std::size_t offset)
+    {
+        T value;
+        std::memcpy(&value, bytes + offset, sizeof(T));
+        return value;
+    }
+
+    /* Byte of a pixel selected by a mask, if it selects a whole one */
+    bool getMaskByte(std::uint32_t mask, unsigned int& byte)
+    {
+        for (byte = 0 ; byte < 4 ; ++byte) {
+            if (mask == (0xffu << (8 * byte)))
+                return true;
+        }
+        return false;
+    }
+}
+
+
+TiledImage::TiledImage(std::string const& path):
+            _size (0, 0),
+            _mapping (nullptr),
+            _mappingSize (0),
+            _topRow (nullptr),
+            _rowStride (0),
+            _bytesPerPixel (0),
+            _channelBytes ({{2, 1, 0, 3}}),
+            _hasAlpha (false)
+{
+    TRACE_ZONE("open image");
+    if (mapBitmap(path))
+        return;
+
+    if (!_image.loadFromFile(path))
+        throw std::runtime_error("unable to open " + path);
+    _size = _image.getSize();
+}
+
+TiledImage::~TiledImage()
+{
+    unmap();
+}
+
+sf::Vector2u const& TiledImage::getSize() const
+{
+    return _size;
+}
+
+bool TiledImage::isMapped() const
+{
+    return _mapping != nullptr;
+}
+
+void TiledImage::readTile(sf::Vector2u const& origin, sf::Vector2u const& size, sf::Image& tile) const
+{
+    TRACE_ZONE("read tile");
+    if (origin.x >= _size.x || origin.y >= _size.y)
+        throw std::runtime_error("tile outside of the picture");
+    const unsigned int width = std::min(size.x, _size.x - origin.x);
+    const unsigned int height = std::min(size.y, _size.y - origin.y);
+
+    std::vector<std::uint8_t> pixels(4 * static_cast<std::size_t>(width) * height);
+    for (unsigned int y = 0 ; y < height ; ++y) {
+        std::uint8_t* destination = &pixels[4 * static_cast<std::size_t>(y) * width];
+
+        if (!isMapped()) {
+            std::uint8_t const* source = _image.getPixelsPtr() + 4 * ((origin.y + y) * static_cast<std::size_t>(_size.x) + origin.x);
+            std::memcpy(destination, source, 4 * static_cast<std::size_t>(width));
+            continue;
+        }
+
+        /* Only the pages of these rows are read from the file */
+        std::uint8_t const* source = _topRow + static_cast<std::ptrdiff_t>(origin.y + y) * _rowStride
+                                     + static_cast<std::size_t>(origin.x) * _bytesPerPixel;
+        for (unsigned int x = 0 ; x < width ; ++x, source += _bytesPerPixel, destination += 4) {
+            destination[0] = source[_channelBytes[0]];
+            destination[1] = source[_channelBytes[1]];
+            destination[2] = source[_channelBytes[2]];
+            destination[3] = _hasAlpha ? source[_channelBytes[3]] : 255;
+        }
+    }
+
+    tile.create(width, height, pixels.data());
+}
+
+bool TiledImage::mapBitmap(std::string const& path)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || static_cast<std::size_t>(status.st_size) < FILE_HEADER_SIZE + MIN_INFO_HEADER_SIZE) {
+        close(file);
+        return false;
+    }
+    _mappingSize = static_cast<std::size_t>(status.st_size);
+    _mapping = mmap(nullptr, _mappingSize, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (_mapping == MAP_FAILED) {
+        _mapping = nullptr;
+        return false;
+    }
+
+    std::uint8_t const* bytes = static_cast<std::uint8_t const*>(_mapping);
+    const std::uint32_t pixelsOffset = readField<std::uint32_t>(bytes, 10);
+    const std::uint32_t infoHeaderSize = readField<std::uint32_t>(bytes, 14);
+    const std::int32_t width = readField<std::int32_t>(bytes, 18);
+    const std::int32_t height = readField<std::int32_t>(bytes, 22);
+    const std::uint16_t bitsPerPixel = readField<std::uint16_t>(bytes, 28);
+    const std::uint32_t compression = readField<std::uint32_t>(bytes, 30);
+
+    /* Palettes, RLE and 16 bits layouts are left to sf::Image */
+    bool supported = (bytes[0] == 'B' && bytes[1] == 'M' && infoHeaderSize >= MIN_INFO_HEADER_SIZE &&
+                      width > 0 && height != 0 && height != INT32_MIN &&
+                      ((compression == BI_RGB && (bitsPerPixel == 24 || bitsPerPixel == 32)) ||
+                       ((compression == BI_BITFIELDS || compression == BI_ALPHABITFIELDS) && bitsPerPixel == 32)));
+
+    /* The masks follow BITMAPINFOHEADER, the alpha one only with later headers */
+    if (supported && compression != BI_RGB) {
+        const std::size_t masksOffset = FILE_HEADER_SIZE + MIN_INFO_HEADER_SIZE;
+        const bool hasAlphaMask = (compression == BI_ALPHABITFIELDS || infoHeaderSize >= MIN_INFO_HEADER_SIZE + 16);
+        supported = (masksOffset + 16 <= _mappingSize);
+        for (unsigned int channel = 0 ; supported && channel < 3 ; ++channel)
+            supported = getMaskByte(readField<std::uint32_t>(bytes, masksOffset + 4 * channel), _channelBytes[channel]);
+
+        const std::uint32_t alphaMask = hasAlphaMask ? readField<std::uint32_t>(bytes, masksOffset + 12) : 0;
+        _hasAlpha = (alphaMask != 0);
+        if (supported && _hasAlpha)
+            supported = getMaskByte(alphaMask, _channelBytes[3]);
+    }
+
+    /* Rows are padded to 4 bytes */
+    const std::size_t nbRows = static_cast<std::size_t>(height < 0 ? -static_cast<std::int64_t>(height) : height);
+    const std::size_t rowSize = (static_cast<std::size_t>(width) * bitsPerPixel + 31) / 32 * 4;
+    if (!supported || pixelsOffset > _mappingSize || (_mappingSize - pixelsOffset) / rowSize < nbRows) {
+        unmap();
+        return false;
+    }
+
+    _size = sf::Vector2u(static_cast<unsigned int>(width), static_cast<unsigned int>(nbRows));
+    _bytesPerPixel = bitsPerPixel / 8;
+    if (height > 0) {
+        _topRow = bytes + pixelsOffset + (nbRows - 1) * rowSize;
+        _rowStride = -static_cast<std::ptrdiff_t>(rowSize);
+    } else {
+        _topRow = bytes + pixelsOffset;
+        _rowStride = static_cast<std::ptrdiff_t>(rowSize);
+    }
+    return true;
+}
+
+void TiledImage::unmap()
+{
+    if (_mapping != nullptr)
+        munmap(_mapping, _mappingSize);
+    _mapping = nullptr;
+    _mappingSize = 0;
+    _topRow = nullptr;
+}
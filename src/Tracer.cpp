@@ -0,0 +1,208 @@
+#include "Tracer.hpp"
+
+#ifdef PARTICLES_TRACE
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace
+{
+    struct Event
+    {
+        const char* name;
+        std::int64_t begin;
+        std::int64_t end;
+    };
+
+    /* Events of one track. Only its owner thread appends to it, without
+     * locking: new blocks and events are published with release stores,
+     * so that write() can read them from another thread */
+    class TrackBuffer
+    {
+        public:
+            static const std::size_t BLOCK_SIZE = 4096;
+            static const std::size_t MAX_BLOCKS = 1024; //at most 4M events per track
+
+        public:
+            explicit TrackBuffer(unsigned int trackID):
+                        _trackID (trackID),
+                        _size (0)
+            {
+                for (std::atomic<Event*> &block : _blocks)
+                    block.store(nullptr, std::memory_order_relaxed);
+            }
+
+            ~TrackBuffer()
+            {
+                for (std::atomic<Event*> &block : _blocks)
+                    delete[] block.load(std::memory_order_relaxed);
+            }
+
+            /* Owner thread only. Events beyond MAX_BLOCKS are dropped */
+            void append(const char* name, std::int64_t begin, std::int64_t end)
+            {
+                std::size_t index = _size.load(std::memory_order_relaxed);
+                std::size_t blockIndex = index / BLOCK_SIZE;
+                if (blockIndex >= MAX_BLOCKS)
+                    return;
+
+                Event* block = _blocks[blockIndex].load(std::memory_order_relaxed);
+                if (block == nullptr) {
+                    block = new Event[BLOCK_SIZE];
+                    _blocks[blockIndex].store(block, std::memory_order_release);
+                }
+
+                Event &event = block[index % BLOCK_SIZE];
+                event.name = name;
+                event.begin = begin;
+                event.end = end;
+                _size.store(index + 1, std::memory_order_release);
+            }
+
+            /* Any thread: the events published so far */
+            template <typename F>
+            void forEach(F const& function) const
+            {
+                std::size_t size = _size.load(std::memory_order_acquire);
+                for (std::size_t index = 0 ; index < size ; ++index) {
+                    Event const* block = _blocks[index / BLOCK_SIZE].load(std::memory_order_acquire);
+                    function(block[index % BLOCK_SIZE]);
+                }
+            }
+
+            unsigned int getTrackID() const
+            {
+                return _trackID;
+            }
+
+        private:
+            TrackBuffer(TrackBuffer const&);
+            TrackBuffer& operator=(TrackBuffer const&);
+
+        private:
+            const unsigned int _trackID;
+            std::atomic<std::size_t> _size;
+            std::array<std::atomic<Event*>, MAX_BLOCKS> _blocks;
+    };
+
+    /* Every track ever created. Buffers are never freed before exit,
+     * so that the events of finished threads can still be written */
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<TrackBuffer>> tracks;
+        std::vector<std::string> names; //indexed by track ID
+    };
+
+    Registry& getRegistry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    TrackBuffer& createTrack(std::string const& name)
+    {
+        Registry &registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.tracks.emplace_back(new TrackBuffer(registry.tracks.size()));
+        registry.names.push_back(name);
+        return *registry.tracks.back();
+    }
+
+    /* Registered once per thread, the only time a lock is taken while recording */
+    TrackBuffer& getThreadTrack()
+    {
+        thread_local TrackBuffer* track = &createTrack("thread");
+        return *track;
+    }
+
+    TrackBuffer& getGPUTrack()
+    {
+        static TrackBuffer &track = createTrack("GPU");
+        return track;
+    }
+
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    /* Chrome traces are in microseconds */
+    double toMicroseconds(std::int64_t nanoseconds)
+    {
+        return static_cast<double>(nanoseconds) * 1e-3;
+    }
+}
+
+
+Tracer::Zone::Zone(const char* name):
+            _name (name),
+            _begin (Tracer::now())
+{
+}
+
+Tracer::Zone::~Zone()
+{
+    Tracer::addZone(_name, _begin, Tracer::now());
+}
+
+std::int64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Tracer::setThreadName(const char* name)
+{
+    TrackBuffer &track = getThreadTrack();
+
+    Registry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.names[track.getTrackID()] = name;
+}
+
+void Tracer::addZone(const char* name, std::int64_t begin, std::int64_t end)
+{
+    getThreadTrack().append(name, begin, end);
+}
+
+void Tracer::addGPUZone(const char* name, std::int64_t begin, std::int64_t end)
+{
+    getGPUTrack().append(name, begin, end);
+}
+
+bool Tracer::write(std::string const& filename)
+{
+    std::ofstream file(filename.c_str());
+    if (!file)
+        return false;
+
+    Registry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+    file << std::fixed << std::setprecision(3);
+
+    bool first = true;
+    for (std::unique_ptr<TrackBuffer> const& track : registry.tracks) {
+        unsigned int trackID = track->getTrackID();
+        file << (first ? "" : ",\n")
+             << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << trackID
+             << ", \"args\": {\"name\": \"" << registry.names[trackID] << "\"}}";
+        first = false;
+
+        track->forEach([&file, trackID](Event const& event) {
+            file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << trackID
+                 << ", \"ts\": " << toMicroseconds(event.begin)
+                 << ", \"dur\": " << toMicroseconds(event.end - event.begin) << "}";
+        });
+    }
+
+    file << std::endl << "]}" << std::endl;
+    return static_cast<bool>(file);
+}
+
+#endif // PARTICLES_TRACE
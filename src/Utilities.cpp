@@ -26,3 +26,21 @@ void searchAndReplace (std::string const& tobeReplaced,
      pos += replacement.length();
   }
 }
+
+void insertDefine (std::string const& name,
+                   std::string& shaderSource)
+{
+  std::string::size_type pos = shaderSource.find("#version");
+  pos = (pos == std::string::npos) ? 0u : shaderSource.find('\n', pos) + 1u;
+  shaderSource.insert(pos, "#define " + name + "\n");
+}
+
+std::uint64_t hashBytes (void const* data, std::size_t size,
+                         std::uint64_t hash)
+{
+  const std::uint64_t prime = 1099511628211ULL;
+  unsigned char const* bytes = static_cast<unsigned char const*>(data);
+  for (std::size_t i = 0 ; i < size ; ++i)
+     hash = (hash ^ bytes[i]) * prime;
+  return hash;
+}
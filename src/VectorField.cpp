@@ -0,0 +1,190 @@
+#include "VectorField.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "Tracer.hpp"
+
+
+namespace
+{
+    const float PI = 3.14159265f;
+
+    /* Index in [0, size) of any integer, negative ones included */
+    inline int wrap(int index, int size)
+    {
+        index %= size;
+        return (index < 0) ? index + size : index;
+    }
+
+    inline std::uint32_t hash(std::uint32_t x, std::uint32_t y)
+    {
+        std::uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u;
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        h *= 0x846ca68bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    /* Unit gradient of a lattice point, turning at a speed of +1 or -1
+     * radian per unit of time */
+    inline glm::vec2 getGradient(int x, int y, float time)
+    {
+        std::uint32_t h = hash(static_cast<std::uint32_t>(x), static_cast<std::uint32_t>(y));
+        float angle = 2.f * PI * static_cast<float>(h >> 8) / 16777216.f;
+        angle += (h & 1u) ? time : -time;
+        return glm::vec2(std::cos(angle), std::sin(angle));
+    }
+
+    inline float fade(float t)
+    {
+        return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+    }
+
+    /* Gradient noise of period cells in both directions */
+    float getNoise(float u, float v, int period, float time)
+    {
+        int x0 = static_cast<int>(std::floor(u));
+        int y0 = static_cast<int>(std::floor(v));
+        float fx = u - static_cast<float>(x0);
+        float fy = v - static_cast<float>(y0);
+        int x1 = wrap(x0 + 1, period), y1 = wrap(y0 + 1, period);
+        x0 = wrap(x0, period);
+        y0 = wrap(y0, period);
+
+        float n00 = glm::dot(getGradient(x0, y0, time), glm::vec2(fx, fy));
+        float n10 = glm::dot(getGradient(x1, y0, time), glm::vec2(fx - 1.f, fy));
+        float n01 = glm::dot(getGradient(x0, y1, time), glm::vec2(fx, fy - 1.f));
+        float n11 = glm::dot(getGradient(x1, y1, time), glm::vec2(fx - 1.f, fy - 1.f));
+
+        float sx = fade(fx), sy = fade(fy);
+        return glm::mix(glm::mix(n00, n10, sx), glm::mix(n01, n11, sx), sy);
+    }
+}
+
+
+VectorField::VectorField():
+            _width (0),
+            _height (0),
+            _origin (0.f, 0.f),
+            _size (1.f, 1.f)
+{
+}
+
+VectorField::VectorField(unsigned int width, unsigned int height,
+                         glm::vec2 const& origin, glm::vec2 const& size):
+            _width (width),
+            _height (height),
+            _origin (origin),
+            _size (size),
+            _values (width * height, glm::vec2(0.f, 0.f))
+{
+}
+
+unsigned int VectorField::getWidth() const
+{
+    return _width;
+}
+
+unsigned int VectorField::getHeight() const
+{
+    return _height;
+}
+
+bool VectorField::isEmpty() const
+{
+    return _values.empty();
+}
+
+glm::vec2 const& VectorField::getOrigin() const
+{
+    return _origin;
+}
+
+glm::vec2 const& VectorField::getSize() const
+{
+    return _size;
+}
+
+std::vector<glm::vec2> const& VectorField::getValues() const
+{
+    return _values;
+}
+
+glm::vec2& VectorField::at(unsigned int x, unsigned int y)
+{
+    return _values[y * _width + x];
+}
+
+glm::vec2 VectorField::sample(glm::vec2 const& position) const
+{
+    if (isEmpty())
+        return glm::vec2(0.f, 0.f);
+
+    /* In cells, relative to the center of the first one */
+    float u = (position.x - _origin.x) / _size.x * static_cast<float>(_width) - 0.5f;
+    float v = (position.y - _origin.y) / _size.y * static_cast<float>(_height) - 0.5f;
+    float floorU = std::floor(u), floorV = std::floor(v);
+    float fx = u - floorU, fy = v - floorV;
+
+    int width = static_cast<int>(_width), height = static_cast<int>(_height);
+    int x0 = wrap(static_cast<int>(floorU), width), x1 = wrap(x0 + 1, width);
+    int y0 = wrap(static_cast<int>(floorV), height), y1 = wrap(y0 + 1, height);
+
+    glm::vec2 bottom = glm::mix(_values[y0 * width + x0], _values[y0 * width + x1], fx);
+    glm::vec2 top = glm::mix(_values[y1 * width + x0], _values[y1 * width + x1], fx);
+    return glm::mix(bottom, top, fy);
+}
+
+void VectorField::computeCurlNoise(unsigned int period, float time, float amplitude,
+                                   ThreadPool& threadPool)
+{
+    TRACE_ZONE("curl noise");
+    if (isEmpty())
+        return;
+
+    const int width = _width, height = _height;
+    period = std::max(1u, period);
+
+    /* Potential at the center of each cell */
+    std::vector<float> potential(_values.size());
+    threadPool.parallelFor(height, [&](std::size_t begin, std::size_t end) {
+        for (int y = begin ; y < static_cast<int>(end) ; ++y) {
+            float v = (static_cast<float>(y) + 0.5f) * static_cast<float>(period) / static_cast<float>(height);
+            for (int x = 0 ; x < width ; ++x) {
+                float u = (static_cast<float>(x) + 0.5f) * static_cast<float>(period) / static_cast<float>(width);
+                potential[y * width + x] = getNoise(u, v, period, time);
+            }
+        }
+    });
+
+    /* Curl (dP/dy, -dP/dx) by central differences, the largest norm of each row
+     * being kept for the normalization */
+    const glm::vec2 cellSize = _size / glm::vec2(width, height);
+    std::vector<float> rowMaxima(height, 0.f);
+    threadPool.parallelFor(height, [&](std::size_t begin, std::size_t end) {
+        for (int y = begin ; y < static_cast<int>(end) ; ++y) {
+            int below = wrap(y - 1, height) * width, above = wrap(y + 1, height) * width;
+            for (int x = 0 ; x < width ; ++x) {
+                int left = wrap(x - 1, width), right = wrap(x + 1, width);
+                glm::vec2 curl((potential[above + x] - potential[below + x]) / (2.f * cellSize.y),
+                               -(potential[y * width + right] - potential[y * width + left]) / (2.f * cellSize.x));
+                _values[y * width + x] = curl;
+                rowMaxima[y] = std::max(rowMaxima[y], glm::length(curl));
+            }
+        }
+    });
+
+    float maximum = *std::max_element(rowMaxima.begin(), rowMaxima.end());
+    if (maximum <= 0.f)
+        return;
+
+    const float scale = amplitude / maximum;
+    threadPool.parallelFor(_values.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin ; i < end ; ++i)
+            _values[i] *= scale;
+    });
+}
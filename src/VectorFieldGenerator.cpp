@@ -0,0 +1,79 @@
+#include "VectorFieldGenerator.hpp"
+
+#include <utility>
+
+#include "Tracer.hpp"
+
+
+VectorFieldGenerator::VectorFieldGenerator(unsigned int nbThreads):
+            _threadPool (nbThreads),
+            _ready (false),
+            _stopping (false),
+            _thread (&VectorFieldGenerator::run, this)
+{
+}
+
+VectorFieldGenerator::~VectorFieldGenerator()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _taskAvailable.notify_all();
+    _thread.join();
+}
+
+bool VectorFieldGenerator::start(unsigned int width, unsigned int height,
+                                 glm::vec2 const& origin, glm::vec2 const& size,
+                                 Task const& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_task || _ready)
+            return false;
+
+        /* The storage is reused when the size doesn't change */
+        if (_field.getWidth() != width || _field.getHeight() != height ||
+            _field.getOrigin() != origin || _field.getSize() != size)
+            _field = VectorField(width, height, origin, size);
+        _task = task;
+    }
+    _taskAvailable.notify_one();
+    return true;
+}
+
+bool VectorFieldGenerator::poll(VectorField& field)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_ready)
+        return false;
+
+    std::swap(field, _field);
+    _ready = false;
+    return true;
+}
+
+void VectorFieldGenerator::run()
+{
+    TRACE_THREAD_NAME("vector field");
+
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _taskAvailable.wait(lock, [this]() { return _stopping || static_cast<bool>(_task); });
+            if (_stopping)
+                return;
+            task = _task;
+        }
+
+        /* _field is only touched by this thread until _ready is set */
+        task(_field, _threadPool);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _task = nullptr;
+            _ready = true;
+        }
+    }
+}
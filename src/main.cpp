@@ -1,26 +1,480 @@
 #include <cstdlib>
 #include <cmath>
+#include <exception>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <string>
 
 #include <SFML/System/Clock.hpp>
+#include <SFML/System/Sleep.hpp>
 #include <SFML/System/Time.hpp>
 #include <SFML/Graphics.hpp>
 
 #include <GL/glew.h>
 
 #include "Particles.hpp"
+#include "ParticlePages.hpp"
 #include "Camera.hpp"
+#include "GLFramebuffer.hpp"
+#include "GLTexture.hpp"
+#include "HeadlessContext.hpp"
+#include "InputLog.hpp"
+#include "InputRecorder.hpp"
+#include "Options.hpp"
+#include "ProgramCache.hpp"
+#include "TiledImage.hpp"
+#include "Tracer.hpp"
+#include "VectorFieldGenerator.hpp"
 
-int main()
+namespace
 {
-    /* Creation of the window and the OpenGL 3+ context */
+    /* Options of the viewer, besides the Particles::Settings ones */
+    struct ViewerOptions
+    {
+        bool synchronousTimings = false;
+        bool passTimings = false;
+        PassTimer::Source passTimerSource = PassTimer::Source::GPUQueries;
+
+        /* Fixed time step of the simulation, and substeps per frame at most */
+        int stepRate = 60;
+        int maxSubsteps = 4;
+
+        bool headless = false;
+        bool headlessRender = false;
+        int nbHeadlessFrames = 1000;
+
+        /* Larger pictures are cut into pages, of pageSize particles wide
+         * at most (0: as large as the driver allows) */
+        std::string imagePath = "rc/pic.bmp";
+        int pageSize = 0;
+
+        /* Saved with F5, restored with F9, or at startup with restore */
+        std::string checkpointPath = "particles.checkpoint";
+        bool restore = false;
+
+        /* The input of each frame is recorded to recordPath, or read from
+         * replayPath instead of the mouse, keyboard and clock: with the
+         * durations recorded, or as fast as possible with replayFast */
+        std::string recordPath;
+        std::string replayPath;
+        bool replayFast = false;
+
+        /* Binaries of the programs, reused by the next launches (empty: none) */
+        std::string programCachePath = "program_cache";
+    };
+
+    /* Two fountains crossing each other below the center of the page,
+     * using about 90% of its particles on average */
+    std::vector<Particles::Emitter> createFountains(unsigned int nbParticles, glm::vec2 const& center)
+    {
+        const float lifetime = 4.f;
+        std::vector<Particles::Emitter> emitters(2);
+        for (std::size_t i = 0 ; i < emitters.size() ; ++i) {
+            float side = (i == 0) ? -1.f : 1.f;
+            emitters[i].position = center + glm::vec2(150.f * side, -200.f);
+            emitters[i].direction = glm::vec2(-0.3f * side, 1.f);
+            emitters[i].spread = 0.15f;
+            emitters[i].speed = 8.f;
+            emitters[i].rate = Particles::computeEmitterRate(nbParticles, emitters.size(), lifetime, 0.9f);
+            emitters[i].lifetime = lifetime;
+        }
+        return emitters;
+    }
+
+    /* Trace builds always time the passes, to fill the GPU track of the trace */
+    void applyOptions(ParticlePages& pages, ViewerOptions const& options)
+    {
+        pages.setTimeStep(sf::seconds(1.f / static_cast<float>(options.stepRate)), options.maxSubsteps);
+        for (unsigned int i = 0 ; i < pages.getNbPages() ; ++i) {
+            Particles& particles = pages.getPage(i);
+            if (particles.hasEmitters())
+                particles.setEmitters(createFountains(particles.getNbParticles(), particles.getLayoutCenter()));
+
+            if (options.passTimings)
+                particles.enablePassTimer(options.passTimerSource);
+#ifdef PARTICLES_TRACE
+            else
+                particles.enablePassTimer(PassTimer::Source::GPUQueries);
+#endif
+        }
+    }
+
+    /* Checkpoints that can't be written or read are reported, the
+     * simulation going on. Returns whether the checkpoint is still being saved */
+    bool pollCheckpoint(ParticlePages& particles, std::string const& path)
+    {
+        try {
+            if (particles.isSavingCheckpoint())
+                return true;
+            std::cout << "checkpoint saved to " << path << std::endl;
+        } catch (std::exception const& e) {
+            std::cerr << "Unable to save the checkpoint: " << e.what() << std::endl;
+        }
+        return false;
+    }
+
+    void restoreCheckpoint(ParticlePages& particles, std::string const& path)
+    {
+        try {
+            particles.loadCheckpoint(path);
+            std::cout << "checkpoint restored from " << path << std::endl;
+        } catch (std::exception const& e) {
+            std::cerr << "Unable to restore the checkpoint: " << e.what() << std::endl;
+        }
+    }
+
+    /* Parts of the simulation that depend on the timing of threads, which
+     * a replay doesn't reproduce: it then ends with another state */
+    void warnIfNotReproducible(ParticlePages const& particles)
+    {
+        Particles const& page = particles.getPage(0);
+        if (page.hasVectorField())
+            std::cerr << "Warning: runs with --curl-noise aren't reproducible, the fields are handed over when the background thread is done" << std::endl;
+        if (page.hasNeighbourForces() && page.getBackend() == Particles::Backend::ComputeShader)
+            std::cerr << "Warning: runs with --flocking on the compute shader backend aren't reproducible, the order of the neighbours varies" << std::endl;
+        if (page.hasEmitters())
+            std::cerr << "Warning: runs with --emitters aren't reproducible, the order of the live and dead particles varies" << std::endl;
+    }
+
+    /* Mostly spent compiling the programs, unless they all come from the
+     * cache: compare a cold launch with the next, warm, one */
+    void printStartupTime(sf::Time const& time, ProgramCache const* cache)
+    {
+        std::cout << "startup: " << 1000.f * time.asSeconds() << " ms";
+        if (cache != nullptr && cache->isAvailable())
+            std::cout << " (" << ((cache->getNbCompiled() == 0) ? "warm" : "cold") << ", programs: "
+                      << cache->getNbLoaded() << " from the cache, " << cache->getNbCompiled() << " compiled)";
+        std::cout << std::endl;
+    }
+
+    /* Gravity is only available on the CPU backend */
+    void switchForceModel(ParticlePages& particles)
+    {
+        if (particles.getPage(0).getBackend() != Particles::Backend::CPU)
+            return;
+
+        Particles::ForceModel model = (particles.getPage(0).getForceModel() == Particles::ForceModel::Gravity) ?
+                                      Particles::ForceModel::Attractors : Particles::ForceModel::Gravity;
+        for (unsigned int i = 0 ; i < particles.getNbPages() ; ++i)
+            particles.getPage(i).setForceModel(model);
+        std::cout << "force model: " << Particles::getForceModelName(model) << std::endl;
+    }
+
+    /* A live frame and its replay make the same calls, in the same order.
+     * The camera moves first, the magnet following the mouse over the
+     * moved view */
+    void applyCameraInput(InputLog::Frame const& frame, Camera& camera)
+    {
+        if (frame.cameraMovement != glm::vec2(0.f))
+            camera.moveInPixels(frame.cameraMovement);
+        if (frame.cameraZoom != 1.f)
+            camera.zoom(frame.cameraZoom);
+    }
+
+    void applyParticlesInput(InputLog::Frame const& frame, ParticlePages& particles)
+    {
+        if (frame.reinitialized)
+            particles.initialize();
+        if (frame.forceModelSwitched)
+            switchForceModel(particles);
+        particles.setMagnetState(frame.magnetActive);
+        particles.setMagnetPosition(frame.magnetPosition);
+    }
+
+    /* Compared between runs replaying the same log */
+    void printStateHash(ParticlePages const& particles)
+    {
+        std::cout << "state hash: " << std::hex << std::setfill('0') << std::setw(16)
+                  << particles.computeStateHash() << std::dec << std::setfill(' ') << std::endl;
+    }
+
+    void printPassTimes(ParticlePages const& pages)
+    {
+        for (unsigned int i = 0 ; i < pages.getNbPages() ; ++i) {
+            if (pages.getNbPages() > 1)
+                std::cout << "page " << i << ":" << std::endl;
+            pages.getPage(i).getPassTimer().printReport(std::cout);
+        }
+    }
+
+    /* With --curl-noise, a new field is computed in the background every
+     * CURL_NOISE_INTERVAL seconds, and handed to the particles once ready */
+    const float CURL_NOISE_INTERVAL = 0.25f;
+
+    class CurlNoiseAnimation
+    {
+        public:
+            CurlNoiseAnimation():
+                        _nextStart (0.f)
+            {
+            }
+
+            void update(ParticlePages& pages, float time)
+            {
+                if (_generator.poll(_field)) {
+                    for (unsigned int i = 0 ; i < pages.getNbPages() ; ++i)
+                        pages.getPage(i).setVectorField(_field);
+                }
+
+                /* A tile of 1024x1024 around the picture, the gradients turning slowly */
+                if (time >= _nextStart &&
+                    _generator.start(128, 128, glm::vec2(-512.f, -512.f), glm::vec2(1024.f, 1024.f),
+                                     [time](VectorField& field, ThreadPool& threadPool) {
+                                         field.computeCurlNoise(6, 0.3f * time, 0.2f, threadPool);
+                                     }))
+                    _nextStart = time + CURL_NOISE_INTERVAL;
+            }
+
+        private:
+            VectorFieldGenerator _generator;
+            VectorField _field;
+            float _nextStart;
+    };
+
+#ifdef PARTICLES_TRACE
+    const char* const TRACE_FILENAME = "particles_trace.json";
+
+    void writeTrace()
+    {
+        if (Tracer::write(TRACE_FILENAME))
+            std::cout << "trace written to " << TRACE_FILENAME << std::endl;
+        else
+            std::cerr << "Unable to write " << TRACE_FILENAME << std::endl;
+    }
+#endif
+
+    /* The settings are those of every page */
+    void printParticlesInfo(ParticlePages const& pages)
+    {
+        Particles const& particles = pages.getPage(0);
+        if (pages.getNbPages() > 1)
+            std::cout << "particles: " << pages.getNbParticles() << " in " << pages.getNbPages() << " pages" << std::endl;
+        std::cout << "simulation backend: " << Particles::getBackendName(particles.getBackend()) << std::endl;
+        std::cout << "integrator: " << Particles::getIntegratorName(particles.getIntegrator()) << std::endl;
+        if (particles.getBackend() == Particles::Backend::FragmentShaders) {
+            std::cout << "state storage: " << Particles::getStorageName(particles.getStorage()) << std::endl;
+            std::cout << "update passes: " << (particles.isUpdateFused() ? "1 (fused)" : "2") << std::endl;
+            std::cout << "texels addressed by: " << (particles.isAddressedByVertexID() ? "gl_VertexID" : "texture coordinates buffer") << std::endl;
+        }
+        if (particles.hasNeighbourForces())
+            std::cout << "neighbour forces: radius " << particles.getNeighbourForces().radius << ", at most "
+                      << particles.getNeighbourForces().maxNeighbours << " neighbours" << std::endl;
+        if (particles.hasEmitters())
+            std::cout << "emitters: " << pages.getNbParticles() << " slots recycled" << std::endl;
+        if (particles.getForceModel() == Particles::ForceModel::Gravity)
+            std::cout << "force model: " << Particles::getForceModelName(particles.getForceModel())
+                      << ", opening angle " << particles.getGravity().openingAngle << std::endl;
+        if (particles.getBackend() == Particles::Backend::CPU) {
+            std::cout << "simulation on CPU: " << CPUSimulation::getInstructionSet() << " kernels, "
+                      << particles.getNbThreads() << " threads" << std::endl;
+        }
+    }
+
+    void printSimulationTimes(ParticlePages const& pages, int nbFrames, int nbSteps, float totalSimulation)
+    {
+        Particles const& particles = pages.getPage(0);
+        std::cout << "average simulation per frame (" << Particles::getBackendName(particles.getBackend()) << "): "
+                  << 1000.f * totalSimulation / static_cast<float>(nbFrames) << " ms ("
+                  << static_cast<float>(nbSteps) / static_cast<float>(nbFrames) << " steps of "
+                  << 1000.f * particles.getTimeStep().asSeconds() << " ms, "
+                  << static_cast<float>(pages.getNbParticles()) * static_cast<float>(nbSteps) / totalSimulation
+                  << " particles/s)" << std::endl;
+    }
+
+    /* Runs nbHeadlessFrames frames as fast as possible, without window nor vsync,
+     * or the frames of the log being replayed.
+     * With headlessRender, each step is also drawn into an offscreen framebuffer */
+    int runHeadless(Particles::Settings const& settings, ViewerOptions const& options)
+    {
+        bool needsCompute = (settings.backend == Particles::Backend::ComputeShader);
+        HeadlessContext context(needsCompute ? 4 : 3, needsCompute ? 3 : 0);
+
+        std::cout << "openGL version: " << context.getMajorVersion() << "." << context.getMinorVersion()
+                  << " (headless)" << std::endl << std::endl;
+        if (context.getMajorVersion() < 3) {
+            std::cerr << "This program requires at least OpenGL 3.0" << std::endl << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        /* GLEW may look for a GLX display and fail, the entry points
+         * are loaded anyway */
+        glewExperimental = GL_TRUE;
+        glewInit();
+
+        if (!options.recordPath.empty())
+            std::cerr << "There is no input to record without a window, ignoring --record" << std::endl;
+        std::unique_ptr<InputLog> replay;
+        try {
+            if (!options.replayPath.empty())
+                replay.reset(new InputLog(options.replayPath));
+        } catch (std::exception const& e) {
+            std::cerr << "Unable to replay the input: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::unique_ptr<ProgramCache> programCache;
+        if (!options.programCachePath.empty())
+            programCache.reset(new ProgramCache(options.programCachePath));
+        GLProgram::setCache(programCache.get());
+
+        sf::Clock startupClock;
+        ParticlePages particles(TiledImage(options.imagePath), settings, options.pageSize);
+        printStartupTime(startupClock.getElapsedTime(), programCache.get());
+        printParticlesInfo(particles);
+        applyOptions(particles, options);
+        if (options.restore)
+            restoreCheckpoint(particles, options.checkpointPath);
+        if (replay)
+            warnIfNotReproducible(particles);
+
+        const unsigned int width = 800, height = 600;
+        Camera camera(width, height, glm::vec2(0.f,0.f), 1.f);
+        GLTexture renderTexture;
+        GLFramebuffer renderTarget;
+        if (options.headlessRender && (!renderTexture.create(width, height, GL_RGBA8) || !renderTarget.create({&renderTexture}))) {
+            std::cerr << "Unable to create the offscreen framebuffer" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        /* As if running at 60 fps, the magnet standing still */
+        InputLog::Frame fixedFrame;
+        fixedFrame.frameTime = sf::seconds(1.f / 60.f);
+        const int nbFrames = replay ? static_cast<int>(replay->getFrames().size()) : options.nbHeadlessFrames;
+
+        std::unique_ptr<CurlNoiseAnimation> curlNoise;
+        if (particles.getPage(0).hasVectorField())
+            curlNoise.reset(new CurlNoiseAnimation());
+
+        float time = 0.f;
+        float totalSimulation = 0.f;
+        int nbSteps = 0;
+        sf::Clock clock;
+        sf::Clock simulationClock;
+        for (int i = 0 ; i < nbFrames ; ++i) {
+            TRACE_ZONE("frame");
+            /* The framebuffer keeps its size: resizes are ignored */
+            InputLog::Frame const& frame = replay ? replay->getFrames()[i] : fixedFrame;
+            if (replay) {
+                applyCameraInput(frame, camera);
+                applyParticlesInput(frame, particles);
+            }
+            if (curlNoise)
+                curlNoise->update(particles, time);
+            time += frame.frameTime.asSeconds();
+            simulationClock.restart();
+            {
+                TRACE_ZONE("update");
+                nbSteps += particles.update(frame.frameTime);
+                if (options.synchronousTimings)
+                    glFinish();
+            }
+            totalSimulation += simulationClock.getElapsedTime().asSeconds();
+
+            if (options.headlessRender) {
+                TRACE_ZONE("draw");
+                particles.draw(renderTarget, camera);
+            }
+        }
+        glFinish();
+
+        std::cout << nbFrames << " frames in " << clock.getElapsedTime().asSeconds() << " s" << std::endl;
+        printSimulationTimes(particles, nbFrames, nbSteps, totalSimulation);
+        printStateHash(particles);
+        if (options.passTimings)
+            printPassTimes(particles);
+#ifdef PARTICLES_TRACE
+        writeTrace();
+#endif
+
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    TRACE_THREAD_NAME("main");
+
+    /* Command line options */
+    Particles::Settings settings;
+    ViewerOptions options;
+    for (int i = 1 ; i < argc ; ++i) {
+        std::string option(argv[i]);
+        if (parseSettingsOption(option, settings) ||
+            parsePositiveOption(option, "--step-rate", options.stepRate) ||
+            parsePositiveOption(option, "--max-substeps", options.maxSubsteps) ||
+            parsePositiveOption(option, "--frames", options.nbHeadlessFrames) ||
+            parsePositiveOption(option, "--page-size", options.pageSize))
+            continue;
+
+        if (option == "--timings") {
+            options.synchronousTimings = true;
+        } else if (option == "--pass-timings" || option == "--pass-timings=gpu") {
+            options.passTimings = true;
+            options.passTimerSource = PassTimer::Source::GPUQueries;
+        } else if (option == "--pass-timings=cpu") {
+            options.passTimings = true;
+            options.passTimerSource = PassTimer::Source::CPUClock;
+        } else if (option == "--headless") {
+            options.headless = true;
+        } else if (option == "--render") {
+            options.headlessRender = true;
+        } else if (option.compare(0, 8, "--image=") == 0 && option.size() > 8) {
+            options.imagePath = option.substr(8);
+        } else if (option.compare(0, 13, "--checkpoint=") == 0 && option.size() > 13) {
+            options.checkpointPath = option.substr(13);
+        } else if (option == "--restore") {
+            options.restore = true;
+        } else if (option.compare(0, 9, "--record=") == 0 && option.size() > 9) {
+            options.recordPath = option.substr(9);
+        } else if (option.compare(0, 9, "--replay=") == 0 && option.size() > 9) {
+            options.replayPath = option.substr(9);
+        } else if (option == "--replay-fast") {
+            options.replayFast = true;
+        } else if (option.compare(0, 16, "--program-cache=") == 0 && option.size() > 16) {
+            options.programCachePath = option.substr(16);
+        } else if (option == "--no-program-cache") {
+            options.programCachePath.clear();
+        } else {
+            std::cerr << "Unknown option " << option << std::endl;
+            std::cerr << "Usage: " << argv[0] << " " << getSettingsUsage()
+                      << " [--step-rate=HZ] [--max-substeps=N] [--timings] [--pass-timings[=gpu|cpu]]"
+                      << " [--headless [--frames=N] [--render]] [--image=PATH] [--page-size=N]"
+                      << " [--checkpoint=PATH] [--restore] [--record=PATH | --replay=PATH [--replay-fast]]"
+                      << " [--program-cache=DIR | --no-program-cache]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!options.recordPath.empty() && !options.replayPath.empty()) {
+        std::cerr << "--record and --replay can't be used together" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (options.headless)
+        return runHeadless(settings, options);
+
+    std::unique_ptr<InputLog> replay;
+    try {
+        if (!options.replayPath.empty())
+            replay.reset(new InputLog(options.replayPath));
+    } catch (std::exception const& e) {
+        std::cerr << "Unable to replay the input: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    /* Creation of the window and the OpenGL 3+ context.
+     * Compute shaders need OpenGL 4.3, Particles falls back to fragment shaders otherwise */
+    bool needsCompute = (settings.backend == Particles::Backend::ComputeShader);
     sf::ContextSettings openGLContext(0, 0, 0, //no depth, no stencil, no antialiasing
-                                      3, 0, //openGL 3.0 requested
+                                      needsCompute ? 4 : 3, needsCompute ? 3 : 0,
                                       sf::ContextSettings::Default);
     sf::RenderWindow window(sf::VideoMode(800, 600), "Particles",
                             sf::Style::Default,
                             openGLContext);
-    window.setVerticalSyncEnabled(true);
+    /* A replay keeps the pace of the log instead */
+    window.setVerticalSyncEnabled(!replay);
+    if (replay && replay->getScreenSize() != window.getSize())
+        window.setSize(replay->getScreenSize());
 
     /* Checking if the requested OpenGL version is available */
     std::cout << "openGL version: " << window.getSettings().majorVersion << "." << window.getSettings().minorVersion << std::endl << std::endl;
@@ -41,76 +495,209 @@ int main()
 
     /* Creates still, centered particles and assigns them the colors found in
      * the picture */
-    Particles particles("rc/pic.bmp");
+    std::unique_ptr<ProgramCache> programCache;
+    if (!options.programCachePath.empty())
+        programCache.reset(new ProgramCache(options.programCachePath));
+    GLProgram::setCache(programCache.get());
 
+    sf::Clock startupClock;
+    ParticlePages particles(TiledImage(options.imagePath), settings, options.pageSize);
+    printStartupTime(startupClock.getElapsedTime(), programCache.get());
+    printParticlesInfo(particles);
+    applyOptions(particles, options);
+    if (options.restore)
+        restoreCheckpoint(particles, options.checkpointPath);
+    bool savingCheckpoint = false;
+
+    std::unique_ptr<InputRecorder> recorder;
+    try {
+        if (!options.recordPath.empty())
+            recorder.reset(new InputRecorder(options.recordPath, window.getSize()));
+    } catch (std::exception const& e) {
+        std::cerr << "Unable to record the input: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (recorder || replay)
+        warnIfNotReproducible(particles);
+
+    std::unique_ptr<CurlNoiseAnimation> curlNoise;
+    if (particles.getPage(0).hasVectorField())
+        curlNoise.reset(new CurlNoiseAnimation());
+
+    /* Input of the current frame, the magnet staying active between them */
+    InputLog::Frame frame;
+    bool magnetActive = false;
+
+    float time = 0.f;
     float total = 0.f;
+    float totalSimulation = 0.f;
     int loops = 0;
+    int nbSteps = 0;
     sf::Clock clock;
+    sf::Clock simulationClock;
     /* Main loop */
     while (window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            switch (event.type) {
-                case sf::Event::Closed:
-                    window.close();
-                break;
-                case sf::Event::Resized:
-                    glViewport(0, 0, event.size.width, event.size.height);
-                    camera.setScreenSize(window.getSize().x, window.getSize().y);
-                break;
-                case sf::Event::KeyReleased:
-                    if (event.key.code == sf::Keyboard::R) {
-                        particles.initialize();
-                    }
-                break;
-                case sf::Event::MouseButtonPressed:
-                    if (event.mouseButton.button == sf::Mouse::Left) {
-                        particles.setMagnetState(true);
-                    }
-                break;
-                case sf::Event::MouseButtonReleased:
-                    if (event.mouseButton.button == sf::Mouse::Left) {
-                        particles.setMagnetState(false);
-                    }
-                break;
-                default:
+        TRACE_ZONE("frame");
+
+        frame = InputLog::Frame();
+        {
+            TRACE_ZONE("events");
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                switch (event.type) {
+                    case sf::Event::Closed:
+                        window.close();
+                    break;
+                    case sf::Event::Resized:
+                        glViewport(0, 0, event.size.width, event.size.height);
+                        camera.setScreenSize(window.getSize().x, window.getSize().y);
+                        frame.screenSize = window.getSize();
+                    break;
+                    case sf::Event::KeyReleased:
+#ifdef PARTICLES_TRACE
+                        if (event.key.code == sf::Keyboard::T) {
+                            writeTrace();
+                        }
+#endif
+                        /* Only the log drives a replay */
+                        if (replay)
+                            break;
+                        if (event.key.code == sf::Keyboard::R) {
+                            frame.reinitialized = true;
+                        }
+                        /* Written in the background, reported once done */
+                        if (event.key.code == sf::Keyboard::F5) {
+                            try {
+                                savingCheckpoint = particles.saveCheckpoint(options.checkpointPath) || savingCheckpoint;
+                            } catch (std::exception const& e) {
+                                std::cerr << "Unable to save the checkpoint: " << e.what() << std::endl;
+                            }
+                        }
+                        if (event.key.code == sf::Keyboard::F9) {
+                            restoreCheckpoint(particles, options.checkpointPath);
+                        }
+                        if (event.key.code == sf::Keyboard::G) {
+                            frame.forceModelSwitched = !frame.forceModelSwitched;
+                        }
                     break;
+                    case sf::Event::MouseButtonPressed:
+                        if (event.mouseButton.button == sf::Mouse::Left) {
+                            magnetActive = true;
+                        }
+                    break;
+                    case sf::Event::MouseButtonReleased:
+                        if (event.mouseButton.button == sf::Mouse::Left) {
+                            magnetActive = false;
+                        }
+                    break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        /* Duration of the frame: measured, or read from the log, waiting
+         * for it to elapse unless replaying as fast as possible */
+        if (replay) {
+            if (static_cast<std::size_t>(loops) >= replay->getFrames().size()) {
+                window.close();
+                break;
             }
+            frame = replay->getFrames()[loops];
+            if (frame.screenSize != sf::Vector2u())
+                window.setSize(frame.screenSize);
+            if (!options.replayFast && clock.getElapsedTime() < frame.frameTime)
+                sf::sleep(frame.frameTime - clock.getElapsedTime());
+        } else {
+            frame.frameTime = clock.getElapsedTime();
+            frame.magnetActive = magnetActive;
         }
+        total += clock.restart().asSeconds();
 
         /* Camera movement management */
         {
-            sf::Vector2i movement;
-            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Z))
-                movement.y++;
-            if (sf::Keyboard::isKeyPressed(sf::Keyboard::S))
-                movement.y--;
-            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q))
-                movement.x--;
-            if (sf::Keyboard::isKeyPressed(sf::Keyboard::D))
-                movement.x++;
-            
-            if (movement.x != 0 || movement.y != 0)
-                camera.moveInPixels(glm::normalize(glm::vec2(movement.x,movement.y)) * cameraSpeed * clock.getElapsedTime().asSeconds());
-            
-            if (sf::Keyboard::isKeyPressed(sf::Keyboard::A))
-                camera.zoom( pow(1.f/cameraZoomSpeed, clock.getElapsedTime().asSeconds()) );
-            if (sf::Keyboard::isKeyPressed(sf::Keyboard::E))
-                camera.zoom( pow(cameraZoomSpeed, clock.getElapsedTime().asSeconds()) );
-        }
-
-        particles.setMagnetPosition(camera.pixelToCoords(sf::Mouse::getPosition(window)));
-        particles.computeNewPositions( clock.getElapsedTime());
+            TRACE_ZONE("camera");
+            if (!replay) {
+                const float elapsed = frame.frameTime.asSeconds();
+                sf::Vector2i movement;
+                if (sf::Keyboard::isKeyPressed(sf::Keyboard::Z))
+                    movement.y++;
+                if (sf::Keyboard::isKeyPressed(sf::Keyboard::S))
+                    movement.y--;
+                if (sf::Keyboard::isKeyPressed(sf::Keyboard::Q))
+                    movement.x--;
+                if (sf::Keyboard::isKeyPressed(sf::Keyboard::D))
+                    movement.x++;
+
+                if (movement.x != 0 || movement.y != 0)
+                    frame.cameraMovement = glm::normalize(glm::vec2(movement.x,movement.y)) * cameraSpeed * elapsed;
+
+                if (sf::Keyboard::isKeyPressed(sf::Keyboard::A))
+                    frame.cameraZoom *= pow(1.f/cameraZoomSpeed, elapsed);
+                if (sf::Keyboard::isKeyPressed(sf::Keyboard::E))
+                    frame.cameraZoom *= pow(cameraZoomSpeed, elapsed);
+            }
+            applyCameraInput(frame, camera);
+        }
+
+        {
+            TRACE_ZONE("setMagnetPosition");
+            if (!replay)
+                frame.magnetPosition = camera.pixelToCoords(sf::Mouse::getPosition(window));
+            applyParticlesInput(frame, particles);
+        }
+        if (recorder) {
+            try {
+                recorder->record(frame);
+            } catch (std::exception const& e) {
+                std::cerr << "Unable to record the input: " << e.what() << std::endl;
+                recorder.reset();
+            }
+        }
+
+        if (curlNoise)
+            curlNoise->update(particles, time);
+        time += frame.frameTime.asSeconds();
+        simulationClock.restart();
+        {
+            TRACE_ZONE("update");
+            nbSteps += particles.update(frame.frameTime);
+            /* Without it, only the time taken to submit GPU commands is measured */
+            if (options.synchronousTimings)
+                glFinish();
+        }
+        totalSimulation += simulationClock.getElapsedTime().asSeconds();
+        if (savingCheckpoint)
+            savingCheckpoint = pollCheckpoint(particles, options.checkpointPath);
 
         ++loops;
-        total += clock.getElapsedTime().asSeconds();
-        clock.restart();
-        
-        particles.draw(window, camera);
-        window.display();
+        /* About every 5 seconds with vsync */
+        if (options.passTimings && loops % 300 == 0)
+            printPassTimes(particles);
+
+        {
+            TRACE_ZONE("draw");
+            particles.draw(window, camera);
+        }
+        {
+            TRACE_ZONE("display");
+            window.display();
+        }
     }
 
     std::cout << "average fps: " << static_cast<float>(loops) / total << std::endl;
+    printSimulationTimes(particles, loops, nbSteps, totalSimulation);
+    if (recorder)
+        std::cout << recorder->getNbFrames() << " frames recorded to " << options.recordPath << std::endl;
+    if (replay)
+        std::cout << loops << " of " << replay->getFrames().size() << " frames replayed from " << options.replayPath << std::endl;
+    if (recorder || replay)
+        printStateHash(particles);
+    if (options.passTimings)
+        printPassTimes(particles);
+#ifdef PARTICLES_TRACE
+    writeTrace();
+#endif
 
     return EXIT_SUCCESS;
 }